@@ -0,0 +1,251 @@
+/**
+ * @file bench_harness.hpp
+ * @brief Self-contained timing and JSON reporting for the benchmark executables
+ */
+#ifndef BENCH_HARNESS_HPP
+#define BENCH_HARNESS_HPP
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+namespace bench
+{
+    /** @brief One timed measurement */
+    struct result
+    {
+        /** @brief Name of the benchmarked operation */
+        std::string name;
+        /** @brief Parameters of the measurement (resolution, pins, ...) */
+        std::map<std::string, double> params;
+        /** @brief What one item is ("pixel", "chord", "call", "step") */
+        std::string unit;
+        /** @brief Items processed by one call of the benchmarked function */
+        double items_per_call;
+        /** @brief Median time of one call, in nanoseconds */
+        double ns_per_call;
+        /** @brief Total calls timed */
+        size_t calls;
+        /** @brief Extra labels (e.g. the input used) */
+        std::map<std::string, std::string> tags;
+        /** @brief Extra measurements that aren't times per call (e.g. memory, error) */
+        std::map<std::string, double> metrics;
+
+        double ns_per_item() const
+        {
+            return (items_per_call > 0) ? ns_per_call / items_per_call : 0;
+        }
+    };
+
+    /** @brief Keeps a value from being optimized away */
+    template <typename T>
+    inline void keep(const T &value)
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    /**
+     * @brief Time a function
+     * @details Calls f once to warm up, then in batches until each of `repeats` batches takes at least min_seconds.
+     *          Reports the median batch.
+     * @param f Function to time
+     * @param calls Set to the total number of timed calls
+     * @return Nanoseconds per call
+     */
+    template <typename F>
+    double time_ns(F &&f, size_t &calls, const double min_seconds = 0.05, const int repeats = 5)
+    {
+        using clock = std::chrono::steady_clock;
+        f();
+        size_t batch = 1;
+        for (;;)
+        {
+            const auto start = clock::now();
+            for (size_t i = 0; i < batch; i++)
+                f();
+            const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+            if (seconds >= min_seconds || batch >= ((size_t)1 << 30))
+                break;
+            batch = (seconds <= 0) ? batch * 10 : std::max(batch + 1, (size_t)(batch * 1.2 * min_seconds / seconds));
+        }
+        std::vector<double> per_call(repeats);
+        for (int r = 0; r < repeats; r++)
+        {
+            const auto start = clock::now();
+            for (size_t i = 0; i < batch; i++)
+                f();
+            per_call[r] = std::chrono::duration<double, std::nano>(clock::now() - start).count() / batch;
+        }
+        calls = batch * repeats;
+        std::nth_element(per_call.begin(), per_call.begin() + repeats / 2, per_call.end());
+        return per_call[repeats / 2];
+    }
+
+    /** @brief Collects results, prints them as they come in, and writes them as JSON */
+    class reporter
+    {
+    public:
+        /**
+         * @param _filter Only run benchmarks whose name contains this (empty = all)
+         */
+        reporter(const std::string &_filter = "") : filter(_filter) {}
+
+        /** @brief Test whether a benchmark passes the filter */
+        bool enabled(const std::string &name) const
+        {
+            return filter.empty() || name.find(filter) != std::string::npos;
+        }
+
+        /**
+         * @brief Time a function and record the result
+         * @param name Name of the benchmarked operation
+         * @param params Parameters of the measurement
+         * @param unit What one item is
+         * @param items_per_call Items processed by one call of f
+         * @param f Function to time
+         */
+        template <typename F>
+        void run(const std::string &name, const std::map<std::string, double> &params, const std::string &unit, const double items_per_call, F &&f, const double min_seconds = 0.05)
+        {
+            if (!enabled(name))
+                return;
+            result r{name, params, unit, items_per_call, 0, 0, {}, {}};
+            r.ns_per_call = time_ns(f, r.calls, min_seconds);
+            add(r);
+        }
+
+        /** @brief Record a result timed elsewhere */
+        void add(const result &r)
+        {
+            const std::ios_base::fmtflags flags = std::cout.flags();
+            const std::streamsize precision = std::cout.precision();
+            std::cout << std::left << std::setw(28) << r.name;
+            for (const auto &t : r.tags)
+                std::cout << ' ' << t.first << '=' << t.second;
+            for (const auto &p : r.params)
+                std::cout << ' ' << p.first << '=' << p.second;
+            std::cout << std::right << std::fixed << std::setprecision(2)
+                      << "  " << r.ns_per_item() << " ns/" << r.unit
+                      << "  (" << r.ns_per_call << " ns/call, " << r.calls << " calls)";
+            for (const auto &m : r.metrics)
+                std::cout << "  " << m.first << '=' << m.second;
+            std::cout << '\n';
+            std::cout.flags(flags);
+            std::cout.precision(precision);
+            results.push_back(r);
+        }
+
+        /**
+         * @brief Write every result as JSON
+         * @param out Stream to write to
+         * @param executable Name of the benchmark executable
+         */
+        void write_json(std::ostream &out, const std::string &executable) const
+        {
+            char date[32];
+            const std::time_t now = std::time(nullptr);
+            std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+            out << std::defaultfloat << std::setprecision(6) << "{\n  \"context\": {\n"
+                << "    \"executable\": \"" << executable << "\",\n"
+                << "    \"date\": \"" << date << "\",\n"
+                << "    \"compiler\": \"" << compiler() << "\",\n"
+                << "    \"headless\": " << (headless() ? "true" : "false") << ",\n"
+                << "    \"threads\": " << omp_get_max_threads() << "\n  },\n  \"benchmarks\": [";
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                const result &r = results[i];
+                out << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\"";
+                for (const auto &t : r.tags)
+                    out << ", \"" << t.first << "\": \"" << t.second << "\"";
+                for (const auto &p : r.params)
+                    out << ", \"" << p.first << "\": " << p.second;
+                out << ", \"unit\": \"" << r.unit << "\", \"items_per_call\": " << r.items_per_call
+                    << ", \"ns_per_call\": " << r.ns_per_call << ", \"ns_per_item\": " << r.ns_per_item()
+                    << ", \"calls\": " << r.calls;
+                for (const auto &m : r.metrics)
+                    out << ", \"" << m.first << "\": " << m.second;
+                out << "}";
+            }
+            out << "\n  ]\n}\n";
+        }
+
+        /**
+         * @brief Write the JSON report to a file, or to stdout for "-"
+         * @return False if the file couldn't be opened
+         */
+        bool save_json(const std::string &filename, const std::string &executable) const
+        {
+            if (filename == "-")
+            {
+                write_json(std::cout, executable);
+                return true;
+            }
+            std::ofstream file(filename);
+            if (!file)
+                return false;
+            write_json(file, executable);
+            return true;
+        }
+
+    private:
+        std::string filter;
+        std::vector<result> results;
+
+        static std::string compiler()
+        {
+            std::stringstream name;
+#if defined(__clang__)
+            name << "clang " << __clang_major__ << '.' << __clang_minor__;
+#elif defined(__GNUC__)
+            name << "gcc " << __GNUC__ << '.' << __GNUC_MINOR__;
+#else
+            name << "unknown";
+#endif
+            return name.str();
+        }
+
+        static bool headless()
+        {
+#ifdef STRING_ART_HEADLESS
+            return true;
+#else
+            return false;
+#endif
+        }
+    };
+
+    /**
+     * @brief Read the common benchmark options
+     * @details --json <file|-> writes the JSON report, --filter <text> runs only matching benchmarks,
+     *          --quick runs only the smallest configuration.
+     * @return False if the arguments are invalid
+     */
+    inline bool parse_args(int argc, char **argv, std::string &json_file, std::string &filter, bool &quick)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (!strcmp(argv[i], "--json") && i + 1 < argc)
+                json_file = argv[++i];
+            else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+                filter = argv[++i];
+            else if (!strcmp(argv[i], "--quick"))
+                quick = true;
+            else
+            {
+                std::cerr << "Usage: " << argv[0] << " [--json <file|->] [--filter <text>] [--quick]\n";
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,333 @@
+/**
+ * @file micro_bench.cpp
+ * @brief Micro-benchmarks of the geometry, raster and scoring primitives
+ * @details Every benchmark runs at each resolution and pin count in RESOLUTIONS x PIN_COUNTS, on a synthetic image,
+ *          and reports ns/pixel, ns/chord or ns/call. <br>
+ *          Also checks the fixed-point rasterizer (line_raster::walk()) against the float one it replaced
+ *          (line_raster::float_walk()) on every line: both must take the same number of steps, and no step may land more
+ *          than one pixel away. The share of steps that differ is reported as raster_conformance. Exits with 1 on a
+ *          failed check. <br>
+ *          The scoring and darkening kernels also run on the compact image types (see pixel_traits.hpp), as
+ *          masked_sum_<type> and multiply_line_raster_<type>. <br>
+ *          crossing_lines times line_set::crossing_lines() per line tested. crossing_conformance compares it with the
+ *          pin-index interval test, which only holds for pins in order around a circle, and reports the share of lines they
+ *          disagree on. <br>
+ *          sized_light_regions times the labelling behind string_art's region size map. <br>
+ *          Usage: micro_bench [--json <file|->] [--filter <text>] [--quick]
+ */
+#include <bench_harness.hpp>
+#include <string_art.hpp>
+#include <random>
+
+#define RESOLUTIONS {1024, 2048, 4096}
+#define PIN_COUNTS {150, 250, 400}
+#define MIN_SEPARATION 10
+/** Chords sampled for the per-chord primitives */
+#define SAMPLE_CHORDS 1000
+/** Lines drawn per call of the update_score benchmark */
+#define SAMPLE_DRAWS 16
+/** End buffer of the rasterizer comparisons (the line_raster default) */
+#define RASTER_BUFFER 3
+typedef float IMG_TYPE;
+typedef cimg_library::CImg<IMG_TYPE> tcimg;
+typedef coord<short> scoord;
+
+/**
+ * @brief Benchmarks of string_art's private scoring functions
+ * @details Declared a friend of string_art.
+ */
+class string_art_bench
+{
+public:
+    static void run(bench::reporter &report, const std::map<std::string, double> &params, string_art<IMG_TYPE> &sa, const vector<int> &draws)
+    {
+        // update_score: every line overlapping each drawn line, with the pixels they share
+        vector<line_overlaps> overlaps(draws.size());
+        double overlap_lines = 0, overlap_pixels = 0;
+        for (size_t d = 0; d < draws.size(); d++)
+        {
+            sa.pixel_index.overlaps(draws[d], sa.raster, overlaps[d]);
+            overlap_lines += overlaps[d].size();
+            for (size_t i = 0; i < overlaps[d].size(); i++)
+                overlap_pixels += overlaps[d].pixel_count(i);
+        }
+        const vector<IMG_TYPE> saved_scores = sa.line_scores;
+        const vector<float> saved_totals = sa.line_totals;
+        auto update_all = [&]()
+        {
+            for (const line_overlaps &o : overlaps)
+            {
+                for (size_t i = 0; i < o.size(); i++)
+                    sa.update_score(o.lines[i], o.pixels_of(i), o.pixel_count(i), sa.string_delta);
+            }
+        };
+        report.run("update_score", params, "chord", overlap_lines, update_all);
+        report.run("update_score_pixels", params, "pixel", overlap_pixels, update_all);
+        sa.line_scores = saved_scores;
+        sa.line_totals = saved_totals;
+
+        // best_pin_for: the score tree root (depth 1), and the beam search (depth 3)
+        IMG_TYPE score;
+        short from = 0;
+        report.run("best_pin_for_depth_1", params, "call", 1, [&]()
+        {
+            bench::keep(sa.best_pin_for(from, score, 1));
+            from = (from + 1) % sa.pin_count;
+        });
+        report.run("best_pin_for_depth_3", params, "call", 1, [&]()
+        {
+            bench::keep(sa.best_pin_for(from, score, 3));
+            from = (from + 1) % sa.pin_count;
+        });
+
+        // update_scores: one whole step (draw, overlaps, rescoring, tree updates), on a copy
+        if (report.enabled("update_scores"))
+        {
+            string_art<IMG_TYPE> copy(sa);
+            size_t d = 0;
+            report.run("update_scores", params, "step", 1, [&]()
+            {
+                const scoord &pair = copy.line_pairs[draws[d]];
+                copy.update_scores(pair.x, pair.y);
+                d = (d + 1) % draws.size();
+            });
+        }
+    }
+};
+
+/** @brief Synthetic RGB input: smooth gradients with noise, so line scores vary */
+tcimg synthetic_image(const int resolution)
+{
+    tcimg image(resolution, resolution, 1, 3);
+    std::mt19937 random(resolution);
+    std::uniform_real_distribution<float> noise(-20.f, 20.f);
+    cimg_forXYC(image, x, y, c)
+    {
+        const float fx = (float)x / resolution, fy = (float)y / resolution;
+        image(x, y, c) = std::max(0.f, std::min(255.f, 128.f + 100.f * std::sin(9.f * fx + c) * std::cos(7.f * fy) + noise(random)));
+    }
+    return image;
+}
+
+/**
+ * @brief Benchmarks of the per-pixel kernels on an image of type T
+ * @param image Darkness in grey levels, converted to T
+ */
+template <typename T>
+void typed_kernels(bench::reporter &report, const std::map<std::string, double> &params, const std::string &type_name,
+                   const tcimg &image, const line_raster &raster, const double raster_pixels)
+{
+    cimg_library::CImg<T> typed(image * pixel_traits<T>::darkness_scale);
+    report.run("masked_sum_" + type_name, params, "pixel", raster_pixels, [&]()
+    {
+        float sum = 0, length = 0;
+        for (int i = 0; i < raster.line_count(); i++)
+            line_kernels::masked_sum<T>(typed.data(), raster.data(i), raster.size(i), sum, length);
+        bench::keep(sum);
+    });
+    report.run("multiply_line_raster_" + type_name, params, "pixel", raster_pixels, [&]()
+    {
+        for (int i = 0; i < raster.line_count(); i++)
+            image_editing::multiply_line<T>(typed, raster, i, 0.999f);
+    });
+}
+
+int main(int argc, char **argv)
+{
+    std::string json_file, filter;
+    bool quick = false;
+    if (!bench::parse_args(argc, argv, json_file, filter, quick))
+        return 1;
+    bench::reporter report(filter);
+    bool rasters_conform = true;
+
+    for (const int resolution : RESOLUTIONS)
+    {
+        auto rgb = std::make_shared<const tcimg>(synthetic_image(resolution));
+        tcimg image = rgb->get_channel(0);
+        for (const int pins : PIN_COUNTS)
+        {
+            const std::map<std::string, double> params{{"resolution", resolution}, {"pins", pins}};
+            std::cout << "Preparing resolution " << resolution << ", " << pins << " pins...\n";
+            auto lines = string_art<IMG_TYPE>::make_lines(*rgb, 0.95f, pins, MIN_SEPARATION);
+
+            // Sample chords, with their coordinates and pixel counts
+            std::mt19937 random(pins);
+            std::uniform_int_distribution<int> pick(0, lines->line_count - 1);
+            vector<int> sample(SAMPLE_CHORDS);
+            vector<scoord> sample_pins, sample_pairs;
+            for (int &l : sample)
+            {
+                l = pick(random);
+                sample_pairs.emplace_back(sample_pins.size(), sample_pins.size() + 1);
+                sample_pins.push_back(lines->pins[lines->line_pairs[l].x]);
+                sample_pins.push_back(lines->pins[lines->line_pairs[l].y]);
+            }
+            const line_raster sample_raster(resolution, resolution, sample_pins.data(), sample_pairs.data(), SAMPLE_CHORDS);
+            vector<line<IMG_TYPE>> sample_lines;
+            double line_pixels = 0;
+            for (int i = 0; i < SAMPLE_CHORDS; i++)
+            {
+                sample_lines.emplace_back(sample_pins[2 * i], sample_pins[2 * i + 1], &image);
+                line_pixels += sample_lines.back().size();
+            }
+            const double raster_pixels = sample_raster.total_pixels();
+
+            if (report.enabled("raster_conformance"))
+            {
+                // Every line, compared step by step
+                vector<uint32_t> float_pixels, fixed_pixels;
+                double steps = 0, differing = 0;
+                for (int l = 0; l < lines->line_count; l++)
+                {
+                    const scoord &a = lines->pins[lines->line_pairs[l].x], &b = lines->pins[lines->line_pairs[l].y];
+                    line_raster::float_walk(a, b, resolution, RASTER_BUFFER, float_pixels);
+                    line_raster::walk(a, b, resolution, RASTER_BUFFER, fixed_pixels);
+                    bool conforms = float_pixels.size() == fixed_pixels.size();
+                    for (size_t i = 0; conforms && i < float_pixels.size(); i++)
+                    {
+                        if (float_pixels[i] == fixed_pixels[i])
+                            continue;
+                        differing++;
+                        conforms = std::abs((int)(float_pixels[i] % resolution) - (int)(fixed_pixels[i] % resolution)) <= 1 &&
+                                   std::abs((int)(float_pixels[i] / resolution) - (int)(fixed_pixels[i] / resolution)) <= 1;
+                    }
+                    steps += float_pixels.size();
+                    if (!conforms)
+                    {
+                        std::cerr << "Line " << l << " (" << a.x << ',' << a.y << ")-(" << b.x << ',' << b.y << ") doesn't conform to the float rasterizer\n";
+                        rasters_conform = false;
+                    }
+                }
+                bench::result r{"raster_conformance", params, "pixel", steps, 0, 0, {}, {}};
+                r.metrics["differing_pixel_ratio"] = differing / steps;
+                report.add(r);
+            }
+            vector<uint32_t> walked;
+            double walked_pixels = 0;
+            for (int i = 0; i < SAMPLE_CHORDS; i++)
+            {
+                line_raster::walk(sample_pins[2 * i], sample_pins[2 * i + 1], resolution, RASTER_BUFFER, walked);
+                walked_pixels += walked.size();
+            }
+            report.run("raster_walk_float", params, "pixel", walked_pixels, [&]()
+            {
+                for (int i = 0; i < SAMPLE_CHORDS; i++)
+                {
+                    line_raster::float_walk(sample_pins[2 * i], sample_pins[2 * i + 1], resolution, RASTER_BUFFER, walked);
+                    bench::keep(walked.data());
+                }
+            });
+            report.run("raster_walk", params, "pixel", walked_pixels, [&]()
+            {
+                for (int i = 0; i < SAMPLE_CHORDS; i++)
+                {
+                    line_raster::walk(sample_pins[2 * i], sample_pins[2 * i + 1], resolution, RASTER_BUFFER, walked);
+                    bench::keep(walked.data());
+                }
+            });
+
+            vector<int> crossing;
+            if (report.enabled("crossing_conformance"))
+            {
+                // Pins are in order around a circle here, so the pin-index interval test is the reference
+                double tested = 0, mismatches = 0;
+                for (const int l : sample)
+                {
+                    const short a = lines->line_pairs[l].x, b = lines->line_pairs[l].y;
+                    lines->crossing_lines(a, b, crossing);
+                    int interval_crossings = 0;
+                    for (const scoord &pair : lines->line_pairs)
+                        interval_crossings += (pair.x < a && pair.y > a && pair.y < b) || (pair.x > a && pair.x < b && pair.y > b);
+                    mismatches += std::abs(interval_crossings - (int)crossing.size());
+                    tested += lines->line_count;
+                }
+                bench::result r{"crossing_conformance", params, "line", tested, 0, 0, {}, {}};
+                r.metrics["crossing_mismatch_ratio"] = mismatches / tested;
+                report.add(r);
+            }
+            report.run("crossing_lines", params, "line", (double)SAMPLE_CHORDS * lines->line_count, [&]()
+            {
+                for (const int l : sample)
+                {
+                    lines->crossing_lines(lines->line_pairs[l].x, lines->line_pairs[l].y, crossing);
+                    bench::keep(crossing.data());
+                }
+            });
+
+            report.run("line_construct", params, "chord", SAMPLE_CHORDS, [&]()
+            {
+                for (int i = 0; i < SAMPLE_CHORDS; i++)
+                {
+                    line<IMG_TYPE> l(sample_pins[2 * i], sample_pins[2 * i + 1], &image);
+                    bench::keep(l);
+                }
+            });
+            report.run("line_iterate", params, "pixel", line_pixels, [&]()
+            {
+                float sum = 0;
+                for (const line<IMG_TYPE> &l : sample_lines)
+                {
+                    for (auto p = l.begin(); p < l.end(); ++p)
+                        sum += *p;
+                }
+                bench::keep(sum);
+            });
+            report.run("line_intersect", params, "chord", SAMPLE_CHORDS - 1, [&]()
+            {
+                for (int i = 0; i + 1 < SAMPLE_CHORDS; i++)
+                {
+                    line<IMG_TYPE> overlap = sample_lines[i] & sample_lines[i + 1];
+                    bench::keep(overlap);
+                }
+            });
+            report.run("draw_line", params, "pixel", line_pixels, [&]()
+            {
+                for (int i = 0; i < SAMPLE_CHORDS; i++)
+                    image_editing::draw_line<IMG_TYPE>(image, sample_pins[2 * i], sample_pins[2 * i + 1], 1.f);
+            });
+            report.run("multiply_line", params, "pixel", line_pixels, [&]()
+            {
+                for (int i = 0; i < SAMPLE_CHORDS; i++)
+                    image_editing::multiply_line<IMG_TYPE>(image, sample_pins[2 * i], sample_pins[2 * i + 1], 1.f);
+            });
+            report.run("draw_line_raster", params, "pixel", raster_pixels, [&]()
+            {
+                for (int i = 0; i < SAMPLE_CHORDS; i++)
+                    image_editing::draw_line<IMG_TYPE>(image, sample_raster, i, 1.f);
+            });
+            report.run("multiply_line_raster", params, "pixel", raster_pixels, [&]()
+            {
+                for (int i = 0; i < SAMPLE_CHORDS; i++)
+                    image_editing::multiply_line<IMG_TYPE>(image, sample_raster, i, 1.f);
+            });
+            report.run("sized_light_regions", params, "pixel", image.size(), [&]()
+            {
+                const cimg_library::CImg<int> sizes = image_analysis<IMG_TYPE>::sized_light_regions(image, 0.1f * SCORE_RESOLUTION, true);
+                bench::keep(sizes.data());
+            });
+            typed_kernels<float>(report, params, "float", image, sample_raster, raster_pixels);
+            typed_kernels<u_short>(report, params, "u_short", image, sample_raster, raster_pixels);
+            typed_kernels<u_char>(report, params, "u_char", image, sample_raster, raster_pixels);
+
+            const bool scoring = report.enabled("update_score") || report.enabled("update_score_pixels") || report.enabled("update_scores") ||
+                                 report.enabled("best_pin_for_depth_1") || report.enabled("best_pin_for_depth_3");
+            if (scoring)
+            {
+                string_art<IMG_TYPE> sa(rgb, lines, 0.95f, 0, 0.8f, 1, 0.f, 0.f, false, false);
+                string_art_bench::run(report, params, sa, vector<int>(sample.begin(), sample.begin() + SAMPLE_DRAWS));
+            }
+            if (quick)
+                break;
+        }
+        if (quick)
+            break;
+    }
+
+    if (!json_file.empty() && !report.save_json(json_file, "micro_bench"))
+    {
+        std::cerr << "Could not write " << json_file << '\n';
+        return 1;
+    }
+    return rasters_conform ? 0 : 1;
+}
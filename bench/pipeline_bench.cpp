@@ -0,0 +1,455 @@
+/**
+ * @file pipeline_bench.cpp
+ * @brief End-to-end benchmark of string_art on synthetic inputs
+ * @details Generates each target in TARGETS in memory, then times line building, the rest of the constructor
+ *          (darkness map, region map, initial scoring) and generate(), once with eager and once with lazy score updates.
+ *          Reports the time of each phase, steps per second, p50/p99 step latency, chords and pixels per step
+ *          (see instrumentation.hpp), peak resident memory, the final residual_error() and whether the lazy path matches
+ *          the eager one, and writes them to DEFAULT_JSON. <br>
+ *          Each run also checks that the error tracked while generating (string_art::tracked_error()) matches
+ *          residual_error(), and exits with 1 if it drifted by more than MAX_ERROR_DRIFT. <br>
+ *          Then generates the path with an error plateau stop (PLATEAU_RATIO over an eighth of the steps, see
+ *          string_art::set_stop_criteria()), and reports the steps it stopped at. <br>
+ *          In builds with the debug display, and when an X server is set in $DISPLAY, repeats the lazy run with the display
+ *          open, and reports its generation time as a ratio of the lazy run's (display_cost_ratio). Compare its
+ *          steps_per_second with the lazy run of a headless build (cmake -DSTRING_ART_HEADLESS=ON). <br>
+ *          Then repeats the lazy run with the compact u_char and u_short images (see pixel_traits.hpp), and reports how
+ *          many of their first steps match the float path. <br>
+ *          Then generates the path coarse-to-fine with COARSE_TO_FINE (see string_art::generate_coarse_to_fine()), and
+ *          reports its error and run time (setup and generation) as ratios of the lazy full-resolution run's. Like the
+ *          full-resolution lines, the stages' lines are built before the timed run (see string_art::prepare_stages()),
+ *          and reported as stage_lines_seconds. <br>
+ *          Then generates one path per color of PALETTE on the same lines (see color_layers.hpp), with STEPS steps in
+ *          total, and reports its time and the memory of the shared line_set. <br>
+ *          Then repeats the lazy run with the pins on FRAME_LAYOUT instead of a circle, and reports its generation time as
+ *          a ratio of the circle's (step_cost_ratio). <br>
+ *          Then generates half the path with checkpoints, resumes the rest from the last checkpoint
+ *          (see string_art::set_checkpoint()), and checks that the resumed path matches the uninterrupted one.
+ *          Exits with 1 if it doesn't. <br>
+ *          Usage: pipeline_bench [--json <file|->] [--filter <target>] [--quick]
+ */
+#include <bench_harness.hpp>
+#include <string_art.hpp>
+#include <color_layers.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sys/resource.h>
+
+#define RESOLUTION 1024
+#define PIN_COUNT 250
+#define MIN_SEPARATION 10
+#define SCORE_MODIFIER 0.8f
+#define SCORE_DEPTH 1
+#define STEPS 4000
+/** --quick settings */
+#define QUICK_RESOLUTION 512
+#define QUICK_STEPS 1000
+/** Largest relative difference between the tracked and the recalculated error */
+#define MAX_ERROR_DRIFT 1e-4
+/** Plateau of the early stop run */
+#define PLATEAU_RATIO 0.02f
+/** Stages of the coarse-to-fine run, as {scale, until} */
+#define COARSE_TO_FINE {{0.25f, 0.5f}, {0.5f, 0.75f}}
+/** Frame of the layout run (see pin_layout.hpp) */
+#define FRAME_LAYOUT pin_layout(pin_layout::rectangle, 0.95f)
+/** String colors of the color run: black, cyan, magenta, yellow */
+#define PALETTE {{0, 0, 0}, {0, 255, 255}, {255, 0, 255}, {255, 255, 0}}
+/** Report written when --json isn't given */
+#define DEFAULT_JSON "pipeline_bench.json"
+typedef float IMG_TYPE;
+typedef cimg_library::CImg<IMG_TYPE> tcimg;
+
+namespace targets
+{
+    /** @brief Diagonal light-to-dark ramp */
+    tcimg gradient(const int size)
+    {
+        tcimg image(size, size, 1, 3);
+        cimg_forXYC(image, x, y, c)
+        {
+            image(x, y, c) = 255.f * (x + y) / (2.f * size);
+        }
+        return image;
+    }
+
+    /** @brief Dark rings and discs on white */
+    tcimg circles(const int size)
+    {
+        tcimg image(size, size, 1, 3, 255);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(0.2f * size, 0.8f * size), radius(0.03f * size, 0.2f * size);
+        for (int i = 0; i < 12; i++)
+        {
+            const float cx = position(random), cy = position(random), r = radius(random);
+            const bool ring = (i % 2 == 0);
+            cimg_forXY(image, x, y)
+            {
+                const float d = std::sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
+                if (ring ? std::abs(d - r) < 0.01f * size : d < r)
+                {
+                    cimg_forC(image, c)
+                    {
+                        image(x, y, c) = 0;
+                    }
+                }
+            }
+        }
+        return image;
+    }
+
+    /** @brief Rows of thin dark strokes on grainy paper, like a page of large text
+     *  @details The strokes cover less than the 10% of the darkest pixels that make_darkness_image() keeps, so on pure
+     *           white its darkness image would be blank and there'd be no line to draw.
+     */
+    tcimg text(const int size)
+    {
+        tcimg image(size, size, 1, 3);
+        std::mt19937 random(2);
+        std::uniform_real_distribution<float> paper(224, 255);
+        cimg_forXY(image, x, y)
+        {
+            const float shade = paper(random);
+            cimg_forC(image, c)
+            {
+                image(x, y, c) = shade;
+            }
+        }
+        const int glyph = size / 24;
+        const int stroke = std::max(1, glyph / 6);
+        std::uniform_int_distribution<int> shape(0, 15);
+        for (int row = 2; row < 22; row += 2)
+        {
+            for (int col = 2; col < 22; col++)
+            {
+                // Each bit of the shape draws one stroke of the glyph: left, right, top, middle
+                const int bits = shape(random);
+                const int x0 = col * glyph, y0 = row * glyph;
+                cimg_forXY(image, x, y)
+                {
+                    if (x < x0 || x >= x0 + glyph - stroke || y < y0 || y >= y0 + glyph)
+                        continue;
+                    const int gx = x - x0, gy = y - y0;
+                    const bool dark = ((bits & 1) && gx < stroke) ||
+                                      ((bits & 2) && gx >= glyph - 2 * stroke) ||
+                                      ((bits & 4) && gy < stroke) ||
+                                      ((bits & 8) && std::abs(gy - glyph / 2) < stroke / 2 + 1);
+                    if (dark)
+                    {
+                        cimg_forC(image, c)
+                        {
+                            image(x, y, c) = 0;
+                        }
+                    }
+                }
+            }
+        }
+        return image;
+    }
+
+    /** @brief Smooth large-scale shapes with fine grain, like a photo */
+    tcimg photo(const int size)
+    {
+        std::mt19937 random(3);
+        std::uniform_real_distribution<float> coarse(0.f, 255.f), grain(-25.f, 25.f);
+        tcimg image(8, 8, 1, 1);
+        cimg_forXY(image, x, y)
+        {
+            image(x, y) = coarse(random);
+        }
+        image.resize(size, size, 1, 1, 3);
+        cimg_forXY(image, x, y)
+        {
+            image(x, y) = std::max(0.f, std::min(255.f, image(x, y) + grain(random)));
+        }
+        return image.resize(size, size, 1, 3);
+    }
+}
+
+#define TARGETS {"gradient", "circles", "text", "photo"}
+
+tcimg make_target(const std::string &name, const int size)
+{
+    if (name == "gradient")
+        return targets::gradient(size);
+    if (name == "circles")
+        return targets::circles(size);
+    if (name == "text")
+        return targets::text(size);
+    return targets::photo(size);
+}
+
+/** @brief Peak resident memory of the process so far, in MB */
+double peak_rss_mb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+double seconds_since(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Time a lazy run with a compact image type
+ * @param float_path The path of the float run, to count the matching steps
+ */
+template <typename T>
+bench::result compact_run(const std::string &target, const std::string &type_name, const tcimg &rgb, std::shared_ptr<const line_set> lines,
+                          const std::map<std::string, double> &params, const short steps, const vector<short> &float_path)
+{
+    auto rgb_t = std::make_shared<const cimg_library::CImg<T>>(rgb);
+    instrumentation::reset();
+    auto start = std::chrono::steady_clock::now();
+    string_art<T> sa(rgb_t, lines, 0.95f, 0, SCORE_MODIFIER, SCORE_DEPTH, 0.f, 0.f, false, false);
+    const double setup_seconds = seconds_since(start);
+    sa.set_lazy_updates(true);
+
+    start = std::chrono::steady_clock::now();
+    short *path = sa.generate(steps);
+    const double generate_seconds = seconds_since(start);
+    short matching_steps = 0;
+    while (matching_steps < steps && path[matching_steps] == float_path[matching_steps])
+        matching_steps++;
+    delete[] path;
+
+    bench::result r{"pipeline", params, "step", (double)steps, generate_seconds * 1e9, 1,
+                    {{"target", target}, {"updates", "lazy"}, {"img_type", type_name}}, {}};
+    r.metrics["setup_seconds"] = setup_seconds;
+    r.metrics["generate_seconds"] = generate_seconds;
+    r.metrics["steps_per_second"] = steps / generate_seconds;
+    r.metrics["peak_rss_mb"] = peak_rss_mb();
+    r.metrics["residual_error"] = sa.residual_error();
+    r.metrics["matching_float_steps"] = matching_steps;
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    std::string json_file, filter;
+    bool quick = false;
+    if (!bench::parse_args(argc, argv, json_file, filter, quick))
+        return 1;
+    if (json_file.empty())
+        json_file = DEFAULT_JSON;
+    bench::reporter report;
+    const int resolution = quick ? QUICK_RESOLUTION : RESOLUTION;
+    const short steps = quick ? QUICK_STEPS : STEPS;
+    const std::map<std::string, double> params{{"resolution", resolution}, {"pins", PIN_COUNT}, {"min_separation", MIN_SEPARATION},
+                                               {"score_modifier", SCORE_MODIFIER}, {"score_depth", SCORE_DEPTH}, {"steps", steps}};
+
+    bool resumes_match = true, errors_match = true;
+    for (const std::string target : TARGETS)
+    {
+        if (!filter.empty() && target.find(filter) == std::string::npos)
+            continue;
+        std::cout << "Running " << target << "...\n";
+        auto rgb = std::make_shared<const tcimg>(make_target(target, resolution));
+
+        auto start = std::chrono::steady_clock::now();
+        auto lines = string_art<IMG_TYPE>::make_lines(*rgb, 0.95f, PIN_COUNT, MIN_SEPARATION);
+        const double lines_seconds = seconds_since(start);
+
+        // Eager updates first: the lazy path must match it (see string_art::set_lazy_updates())
+        vector<short> eager_path;
+        double lazy_seconds = 0, lazy_generate_seconds = 0, lazy_error = 0;
+        for (const bool lazy : {false, true})
+        {
+            instrumentation::reset();
+            start = std::chrono::steady_clock::now();
+            string_art<IMG_TYPE> sa(rgb, lines, 0.95f, 0, SCORE_MODIFIER, SCORE_DEPTH, 0.f, 0.f, false, false);
+            const double setup_seconds = seconds_since(start);
+            sa.set_lazy_updates(lazy);
+
+            start = std::chrono::steady_clock::now();
+            short *path = sa.generate(steps);
+            const double generate_seconds = seconds_since(start);
+            const vector<short> path_steps(path, path + steps);
+            delete[] path;
+            if (!lazy)
+                eager_path = path_steps;
+
+            bench::result r{"pipeline", params, "step", (double)steps, generate_seconds * 1e9, 1,
+                            {{"target", target}, {"updates", lazy ? "lazy" : "eager"}, {"img_type", "float"}}, {}};
+            r.metrics["lines_seconds"] = lines_seconds;
+            r.metrics["setup_seconds"] = setup_seconds;
+            r.metrics["generate_seconds"] = generate_seconds;
+            r.metrics["steps_per_second"] = steps / generate_seconds;
+            r.metrics["peak_rss_mb"] = peak_rss_mb();
+            r.metrics["residual_error"] = sa.residual_error();
+            r.metrics["matches_eager"] = (path_steps == eager_path);
+            r.metrics["tracked_error_drift"] = std::abs(sa.tracked_error() - sa.residual_error()) / sa.residual_error();
+            if (r.metrics["tracked_error_drift"] > MAX_ERROR_DRIFT)
+            {
+                std::cerr << target << ": the tracked error drifted by " << r.metrics["tracked_error_drift"] << '\n';
+                errors_match = false;
+            }
+            if (lazy)
+            {
+                lazy_seconds = setup_seconds + generate_seconds;
+                lazy_generate_seconds = generate_seconds;
+                lazy_error = r.metrics["residual_error"];
+            }
+            const instrumentation::accumulator timings = instrumentation::snapshot();
+            r.metrics["step_p50_us"] = timings.step_percentile(50) * 1e6;
+            r.metrics["step_p99_us"] = timings.step_percentile(99) * 1e6;
+            r.metrics["chords_per_step"] = (double)timings.counts[instrumentation::chords_touched] / timings.step_seconds.size();
+            r.metrics["pixels_per_step"] = (double)timings.counts[instrumentation::pixels_visited] / timings.step_seconds.size();
+            report.add(r);
+        }
+        {
+            string_art<IMG_TYPE> sa(rgb, lines, 0.95f, 0, SCORE_MODIFIER, SCORE_DEPTH, 0.f, 0.f, false, false);
+            sa.set_lazy_updates(true);
+            stop_criteria stop;
+            stop.plateau_ratio = PLATEAU_RATIO;
+            stop.plateau_steps = steps / 8;
+            sa.set_stop_criteria(stop);
+            start = std::chrono::steady_clock::now();
+            short stopped_steps;
+            delete[] sa.generate(steps, stopped_steps);
+            const double generate_seconds = seconds_since(start);
+
+            bench::result r{"pipeline", params, "step", (double)stopped_steps, generate_seconds * 1e9, 1,
+                            {{"target", target}, {"updates", "plateau_stop"}, {"img_type", "float"}}, {}};
+            r.metrics["generate_seconds"] = generate_seconds;
+            r.metrics["stopped_steps"] = stopped_steps;
+            r.metrics["residual_error"] = sa.residual_error();
+            r.metrics["error_ratio"] = sa.residual_error() / lazy_error;
+            report.add(r);
+        }
+#if STRING_ART_DISPLAY
+        // The cost of the display thread, to compare with a headless build's lazy run (cmake -DSTRING_ART_HEADLESS=ON)
+        if (std::getenv("DISPLAY"))
+        {
+            string_art<IMG_TYPE> sa(rgb, lines, 0.95f, 0, SCORE_MODIFIER, SCORE_DEPTH, 0.f, 0.f, true, false);
+            sa.set_lazy_updates(true);
+            start = std::chrono::steady_clock::now();
+            delete[] sa.generate(steps);
+            const double generate_seconds = seconds_since(start);
+
+            bench::result r{"pipeline", params, "step", (double)steps, generate_seconds * 1e9, 1,
+                            {{"target", target}, {"updates", "lazy_display"}, {"img_type", "float"}}, {}};
+            r.metrics["generate_seconds"] = generate_seconds;
+            r.metrics["steps_per_second"] = steps / generate_seconds;
+            r.metrics["display_cost_ratio"] = generate_seconds / lazy_generate_seconds;
+            report.add(r);
+        }
+#endif //STRING_ART_DISPLAY
+        report.add(compact_run<u_short>(target, "u_short", *rgb, lines, params, steps, eager_path));
+        report.add(compact_run<u_char>(target, "u_char", *rgb, lines, params, steps, eager_path));
+
+        {
+            instrumentation::reset();
+            start = std::chrono::steady_clock::now();
+            string_art<IMG_TYPE> sa(rgb, lines, 0.95f, 0, SCORE_MODIFIER, SCORE_DEPTH, 0.f, 0.f, false, false);
+            const double setup_seconds = seconds_since(start);
+            sa.set_lazy_updates(true);
+            const vector<resolution_stage> schedule COARSE_TO_FINE;
+            start = std::chrono::steady_clock::now();
+            sa.prepare_stages(schedule);
+            const double stage_lines_seconds = seconds_since(start);
+            start = std::chrono::steady_clock::now();
+            delete[] sa.generate_coarse_to_fine(steps, schedule);
+            const double generate_seconds = seconds_since(start);
+
+            bench::result r{"pipeline", params, "step", (double)steps, generate_seconds * 1e9, 1,
+                            {{"target", target}, {"updates", "coarse_to_fine"}, {"img_type", "float"}}, {}};
+            r.metrics["stage_lines_seconds"] = stage_lines_seconds;
+            r.metrics["setup_seconds"] = setup_seconds;
+            r.metrics["generate_seconds"] = generate_seconds;
+            r.metrics["steps_per_second"] = steps / generate_seconds;
+            r.metrics["residual_error"] = sa.residual_error();
+            r.metrics["error_ratio"] = sa.residual_error() / lazy_error;
+            r.metrics["time_ratio"] = (setup_seconds + generate_seconds) / lazy_seconds;
+            report.add(r);
+        }
+
+        {
+            instrumentation::reset();
+            start = std::chrono::steady_clock::now();
+            color_layers<IMG_TYPE> layers(rgb, lines, PALETTE, 0.95f, 0, SCORE_MODIFIER, SCORE_DEPTH, true);
+            const double setup_seconds = seconds_since(start);
+            start = std::chrono::steady_clock::now();
+            layers.generate(steps);
+            const double generate_seconds = seconds_since(start);
+
+            bench::result r{"pipeline", params, "step", (double)steps, generate_seconds * 1e9, 1,
+                            {{"target", target}, {"updates", "color_layers"}, {"img_type", "float"}}, {}};
+            r.metrics["layers"] = layers.layer_count();
+            r.metrics["setup_seconds"] = setup_seconds;
+            r.metrics["generate_seconds"] = generate_seconds;
+            r.metrics["steps_per_second"] = steps / generate_seconds;
+            r.metrics["line_set_mb"] = lines->memory_usage() / 1048576.0;
+            r.metrics["peak_rss_mb"] = peak_rss_mb();
+            report.add(r);
+        }
+
+        {
+            start = std::chrono::steady_clock::now();
+            auto frame_lines = string_art<IMG_TYPE>::make_lines(*rgb, FRAME_LAYOUT, PIN_COUNT, MIN_SEPARATION);
+            const double frame_lines_seconds = seconds_since(start);
+            instrumentation::reset();
+            string_art<IMG_TYPE> sa(rgb, frame_lines, FRAME_LAYOUT, 0, SCORE_MODIFIER, SCORE_DEPTH, 0.f, 0.f, false, false);
+            sa.set_lazy_updates(true);
+            start = std::chrono::steady_clock::now();
+            delete[] sa.generate(steps);
+            const double generate_seconds = seconds_since(start);
+
+            bench::result r{"pipeline", params, "step", (double)steps, generate_seconds * 1e9, 1,
+                            {{"target", target}, {"updates", "lazy"}, {"layout", FRAME_LAYOUT.name()}, {"img_type", "float"}}, {}};
+            r.metrics["lines_seconds"] = frame_lines_seconds;
+            r.metrics["generate_seconds"] = generate_seconds;
+            r.metrics["steps_per_second"] = steps / generate_seconds;
+            r.metrics["residual_error"] = sa.residual_error();
+            r.metrics["step_cost_ratio"] = generate_seconds / lazy_generate_seconds;
+            const instrumentation::accumulator timings = instrumentation::snapshot();
+            r.metrics["chords_per_step"] = (double)timings.counts[instrumentation::chords_touched] / timings.step_seconds.size();
+            r.metrics["pixels_per_step"] = (double)timings.counts[instrumentation::pixels_visited] / timings.step_seconds.size();
+            report.add(r);
+        }
+
+        // Half a path, then the rest resumed from its checkpoint
+        const std::string checkpoint_file = "pipeline_bench_" + target + ".checkpoint";
+        {
+            string_art<IMG_TYPE> sa(rgb, lines, 0.95f, 0, SCORE_MODIFIER, SCORE_DEPTH, 0.f, 0.f, false, false);
+            sa.set_lazy_updates(true);
+            sa.set_checkpoint(checkpoint_file, steps / 8);
+            delete[] sa.generate(steps / 2);
+        }
+        instrumentation::reset();
+        start = std::chrono::steady_clock::now();
+        string_art<IMG_TYPE> resumed(rgb, lines, checkpoint_file, false, false);
+        const double resume_seconds = seconds_since(start);
+        resumed.set_lazy_updates(true);
+        start = std::chrono::steady_clock::now();
+        short *path = resumed.generate(steps);
+        const double generate_seconds = seconds_since(start);
+        const vector<short> path_steps(path, path + steps);
+        delete[] path;
+        std::remove(checkpoint_file.c_str());
+
+        const short resumed_steps = steps - steps / 2;
+        bench::result r{"pipeline", params, "step", (double)resumed_steps, generate_seconds * 1e9, 1,
+                        {{"target", target}, {"updates", "resumed"}, {"img_type", "float"}}, {}};
+        r.metrics["setup_seconds"] = resume_seconds;
+        r.metrics["generate_seconds"] = generate_seconds;
+        r.metrics["steps_per_second"] = resumed_steps / generate_seconds;
+        r.metrics["residual_error"] = resumed.residual_error();
+        r.metrics["matches_eager"] = (path_steps == eager_path);
+        report.add(r);
+        if (path_steps != eager_path)
+        {
+            std::cerr << target << ": the resumed path doesn't match the uninterrupted one\n";
+            resumes_match = false;
+        }
+    }
+
+    if (!report.save_json(json_file, "pipeline_bench"))
+    {
+        std::cerr << "Could not write " << json_file << '\n';
+        return 1;
+    }
+    return (resumes_match && errors_match) ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file checkpoint.hpp
+ * @brief Snapshots of a string art generation, saved in the background so a long run can be resumed
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include <CImg.h>
+#include <coord.hpp>
+#include <pixel_traits.hpp>
+#include <pin_layout.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using coordinates::coord;
+using std::vector;
+
+/**
+ * @brief The mutable state of a string_art object, and the parameters it was made with
+ * @details Files are written in native byte order, for resuming on the same kind of machine. They're only read by the
+ *          same IMG_TYPE they were written with.
+ * @tparam IMG_TYPE Image type of the string_art object
+ */
+template <typename IMG_TYPE>
+struct checkpoint
+{
+    typedef cimg_library::CImg<IMG_TYPE> tcimg;
+    typedef coord<short> scoord;
+
+    /** @brief Written after the magic. Bumped on any change to the format. */
+    static constexpr uint16_t version = 4;
+
+    /** @brief Frame the pins were placed on, with a custom layout's points, so a resume places pins the same way */
+    pin_layout layout;
+    uint8_t score_method = 0;
+    float score_modifier = 0;
+    int16_t score_depth = 1;
+    float wg_localsize = 0;
+    float wg_neighbor = 0;
+    /** @brief Lookahead search size (see string_art::set_lookahead())*/
+    int16_t beam_width = 0;
+    int16_t beam_candidates = 0;
+    uint8_t lazy_updates = 0;
+    int16_t error_blur = 0;
+    /** @brief Stop criteria (see stop_criteria) */
+    float plateau_ratio = 0;
+    int16_t plateau_steps = 0;
+    float min_score = 0;
+    float time_budget = 0;
+    /** @brief Step that started the current plateau window, and the tracked error at it */
+    int16_t plateau_start = 0;
+    float plateau_error = 0;
+    /** @brief Pins of the line set, to check that a resume uses the same lines */
+    vector<scoord> pins;
+    /** @brief Steps of the path so far */
+    vector<short> path;
+    tcimg darkness_image;
+    cimg_library::CImg<typename pixel_traits<IMG_TYPE>::coverage_type> string_image;
+    /** @brief Only changes at construction, so snapshots share it */
+    std::shared_ptr<const tcimg> region_size_map;
+    vector<IMG_TYPE> line_scores;
+    vector<float> line_lengths;
+    vector<float> line_totals;
+    vector<char> culled;
+
+    /**
+     * @brief Save to a file
+     * @details Writes to filename + ".tmp" and renames it over filename, so the file is never half-written.
+     * @return False if the file couldn't be written
+     */
+    bool save(const std::string &filename) const;
+
+    /**
+     * @brief Load a file saved by save()
+     * @throws std::runtime_error If the file can't be read, or wasn't saved by this version with this IMG_TYPE
+     */
+    static checkpoint load(const std::string &filename);
+};
+
+/**
+ * @brief Saves checkpoints on a background thread
+ * @details submit() never waits for a save in progress. If a snapshot is already waiting to be saved, the newer one
+ *          replaces it, so a slow disk skips checkpoints instead of stalling generation.
+ * @tparam IMG_TYPE Image type of the string_art object
+ */
+template <typename IMG_TYPE>
+class checkpoint_writer
+{
+public:
+    /** @param _filename File every checkpoint is saved to */
+    explicit checkpoint_writer(const std::string &_filename);
+
+    /** @brief Saves the waiting snapshot, if any */
+    ~checkpoint_writer();
+
+    checkpoint_writer(const checkpoint_writer &) = delete;
+    checkpoint_writer &operator=(const checkpoint_writer &) = delete;
+
+    /** @brief Queue a snapshot to be saved */
+    void submit(std::unique_ptr<checkpoint<IMG_TYPE>> snapshot);
+
+    /** @brief Wait until every submitted snapshot is saved (or skipped) */
+    void wait();
+
+    /** @brief Number of snapshots saved */
+    int saved() const;
+
+    /** @brief Number of saves that failed */
+    int failed() const;
+
+    const std::string filename;
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::unique_ptr<checkpoint<IMG_TYPE>> waiting;
+    bool saving = false;
+    bool stopping = false;
+    int saved_count = 0;
+    int failed_count = 0;
+    std::thread thread;
+
+    void run();
+};
+
+#endif
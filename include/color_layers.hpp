@@ -0,0 +1,116 @@
+/**
+ * @file color_layers.hpp
+ * @brief String art with several string colors, one path per color
+ */
+#ifndef COLOR_LAYERS_H
+#define COLOR_LAYERS_H
+#include <string_art.hpp>
+#include <array>
+#include <memory>
+#include <vector>
+using std::vector;
+
+/**
+ * @brief Generates one string art path per string color, on one shared line_set
+ * @details Each color of the palette gets a layer: a string_art object that covers the color's target map (see
+ *          make_targets()). The layers share the pins, lines, rasters and pixel index, so the memory cost is one
+ *          line_set plus the images, scores and score trees of each layer. <br>
+ *          Layers whose targets share pixels interact: a string of one color hides the others under it. They're
+ *          generated in rounds. In each round every layer adds its share of steps concurrently, then each layer's darkness
+ *          is darkened under the other interacting layers' new strings (see string_art::cover_line()), so the next round
+ *          doesn't cover the same pixels twice. Layers that interact with no other layer are generated in one round.
+ * @tparam IMG_TYPE Image type of the layers
+ */
+template <typename IMG_TYPE>
+class color_layers
+{
+    typedef cimg_library::CImg<IMG_TYPE> tcimg;
+
+public:
+    /** @brief RGB color of a string, from 0 to 255 */
+    typedef std::array<unsigned char, 3> color;
+
+    /**
+     * @brief Build the layers
+     * @param _rgb_image Resized input image
+     * @param _lines Pins and lines, built for the size of _rgb_image
+     * @param _palette String colors. Each gets a layer.
+     * @param layout Shape of the frame the pins are placed on (see pin_layout)
+     * @param score_method Method for scoring the lines (see string_art)
+     * @param score_modifier Darkening modifier of every layer (see string_art)
+     * @param score_depth Number of steps to look ahead when finding the next best pin
+     * @param lazy Use lazy score updates (see string_art::set_lazy_updates())
+     * @throws std::domain_error If the palette is empty
+     */
+    color_layers(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, const vector<color> &_palette, const pin_layout &layout,
+                 const u_char score_method = 0, const float score_modifier = 0, const short score_depth = 1, const bool lazy = false);
+
+    /**
+     * @brief Generate the paths
+     * @details The steps are split between the layers by the total darkness of their targets.
+     * @param path_steps Total number of steps of all paths
+     * @param rounds Number of rounds interacting layers are generated in. More rounds follow each other's strings more
+     *        closely, at the cost of more darkening between rounds.
+     */
+    void generate(const int path_steps, const short rounds = 8);
+
+    /** @brief Number of layers (the size of the palette) */
+    short layer_count() const
+    {
+        return palette.size();
+    }
+
+    /** @brief Generated path of a layer */
+    const vector<short> &path(const short layer) const
+    {
+        return paths[layer];
+    }
+
+    /** @brief Target map of a layer (see make_targets()) */
+    const tcimg &target(const short layer) const
+    {
+        return targets[layer];
+    }
+
+    /**
+     * @brief Draw the strings of every layer in their colors on white
+     * @details Strings are drawn in the order they'd be wound: round by round, and within a round layer by layer.
+     */
+    cimg_library::CImg<unsigned char> render() const;
+
+    /** @brief Save render() to an image file */
+    bool save_image(const char *image_file) const;
+
+    /** @brief Write each layer's path to <prefix>_<layer>.csv (see instruction_writer) */
+    bool write_to_csv(const std::string &prefix) const;
+
+    /**
+     * @brief Split an image into one darkness map per string color
+     * @details A pixel's darkness for a color falls linearly with its distance to the color in Lab space (see
+     *          image_analysis::color_difference()): from the most darkness at the color itself, to none at the color's
+     *          distance from white. Where the maps of several colors add up to more than the most darkness, they're scaled
+     *          down to it. Pixels outside the frame have none.
+     * @param rgb_image Input image
+     * @param palette String colors
+     * @param layout Shape of the frame the pins are placed on (see pin_layout)
+     * @return One map per color, from 0 to string_art::darkness_max
+     */
+    static vector<tcimg> make_targets(const tcimg &rgb_image, const vector<color> &palette, const pin_layout &layout);
+
+private:
+    std::shared_ptr<const tcimg> rgb_image;
+    std::shared_ptr<const line_set> lines;
+    const vector<color> palette;
+    /** @brief Darkness map of each layer */
+    vector<tcimg> targets;
+    /** @brief Generation state of each layer. All share lines.*/
+    vector<std::unique_ptr<string_art<IMG_TYPE>>> layers;
+    /** @brief Non-zero for pairs of layers whose targets share pixels, indexed [a * layer_count() + b]*/
+    vector<char> interacts;
+    /** @brief Path of each layer */
+    vector<vector<short>> paths;
+    /** @brief Steps of each layer's path at the end of each round (see render())*/
+    vector<vector<short>> round_ends;
+};
+
+#endif
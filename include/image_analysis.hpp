@@ -25,14 +25,19 @@ class image_analysis
     public:
     /**
      * @brief Map the size of all thresholded regions of the input image
-     * 
+     * @details Regions are 4-connected. Labelled in parallel (see image_analysis.cpp).
      * @param input_image Image to analyze
      * @param threshold Threshold of calculated regions (pixels with higher values are not in a region)
-     * @param ignore_zeros Zero values are considered outside of the threshold when \c true
+     * @param ignore_zeros Zero values don't add to the size of their region, and map to 0, when \c true. They still connect it.
      * @return Region size map
      */
     static CImg<int> sized_dark_regions(const CImg<T>& input_image,const T threshold, bool ignore_zeros = true);
-    
+
+    /**
+     * @brief Map the size of all regions at or above a threshold
+     * @param ignore_zeros Leave out the region containing pixel (0,0) (the background around the pin circle) when \c true
+     * @return Region size map, 0 outside of regions
+     */
     static CImg<int> sized_light_regions(const CImg<T>& input_image,const T threshold, bool ignore_zeros = true);
     
     static CImg<T> color_difference(const CImg<T>& rgb, const T* color);
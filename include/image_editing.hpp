@@ -3,10 +3,14 @@
 #include <CImg/CImg.h>
 //#include "image_analysis.hpp"
 #include <line.hpp>
+#include <line_raster.hpp>
+#include <pixel_delta.hpp>
 #include <coord.hpp>
 #include <math.h>
 #include <map>
 #include <vector>
+#include <type_traits>
+#include <cstdint>
 
 using namespace cimg_library;
 using namespace coordinates;
@@ -19,15 +23,69 @@ namespace image_editing
     template<typename T> 
     void draw_points(CImg<T>& img, vector<int>& idxs, T color = 255);
 
+    /**
+     * @brief Throw if a line doesn't fit in an image, like the coordinates::line constructor
+     */
+    template <class T>
+    void check_line(const CImg<T> &image, const coord<short> line_a, const coord<short> line_b)
+    {
+        if (!image.containsXYZC(line_a.x, line_a.y, 0, 0) || !image.containsXYZC(line_b.x, line_b.y, 0, 0))
+            throw CImgArgumentException("Line does not fit within image.\n");
+    }
+
+    /**
+     * @brief Draw a line, rasterized with line_raster::for_each_walked()
+     * @param image Image to modify
+     * @param line_a Start coordinate of line
+     * @param line_b End coordinate of line
+     * @param color Value to draw
+     * @param buffer Steps to skip at start / end of line
+     */
     template <class T>
     void draw_line(CImg<T> &image, const coord<short> line_a, const coord<short> line_b, const T color, const short buffer = 0)
     {
-        line<T> l(line_a, line_b, &image);
-        for(auto a = l.begin() + buffer; a < l.end() - buffer; a++)
+        check_line(image, line_a, line_b);
+        T *data = image.data();
+        line_raster::for_each_walked(line_a, line_b, image.width(), buffer, [data, color](const uint32_t p)
+                                     { data[p] = color; });
+    }
+
+    /**
+     * @brief Draw a line from a line_raster cache
+     * @param image Image to modify. Must be the size the cache was built for.
+     * @param raster Cached line pixels
+     * @param line_index Index of the line in the cache
+     * @param color Value to draw
+     */
+    template <class T>
+    void draw_line(CImg<T> &image, const line_raster &raster, const int line_index, const T color)
+    {
+        T *data = image.data();
+        raster.for_each(line_index, [data, color](const uint32_t p)
+                        { data[p] = color; });
+    }
+
+    /**
+     * @brief Draw a line from a line_raster cache, and record the pixels it changes
+     * @param image Image to modify. Must be the size the cache was built for.
+     * @param raster Cached line pixels
+     * @param line_index Index of the line in the cache
+     * @param color Value to draw
+     * @param delta Cleared, then filled with the pixels that changed and their previous values
+     */
+    template <class T>
+    void draw_line(CImg<T> &image, const line_raster &raster, const int line_index, const T color, pixel_delta<T> &delta)
+    {
+        T *data = image.data();
+        delta.clear();
+        raster.for_each(line_index, [data, color, &delta](const uint32_t p)
         {
-            (*a) = color;
-        }
-        return;
+            if (data[p] != color)
+            {
+                delta.add(p, data[p]);
+                data[p] = color;
+            }
+        });
     }
 
     /**
@@ -39,10 +97,20 @@ namespace image_editing
      * @param multiplier Amount to multiply each pixel by
      * @param buffer Steps to skip at start / end of line
      * @param multiply_LR If \c true pixels to the left and right (oriented to the line) are also multiplied. If \c false , only pixels in the line are modified.
+     *                    Only the line's own pixels are rasterized with line_raster::for_each_walked(). The left and right
+     *                    neighbours need the line_iterator.
      */
     template<typename T>
     void multiply_line(CImg<T>& image, const coord<short> line_a, const coord<short> line_b, const float multiplier, const short buffer = 0, const bool multiply_LR = false)
     {
+        if (!multiply_LR)
+        {
+            check_line(image, line_a, line_b);
+            T *data = image.data();
+            line_raster::for_each_walked(line_a, line_b, image.width(), buffer, [data, multiplier](const uint32_t p)
+                                         { data[p] *= multiplier; });
+            return;
+        }
         line<T> l(line_a, line_b, &image);
         for(auto a = l.begin() + buffer; a < l.end() - buffer; a++)
         {
@@ -54,7 +122,93 @@ namespace image_editing
             }
         }
         return;
-        return;
+    }
+
+    /**
+     * @brief Multiplies pixel values by a constant, rounded the way multiply_line() stores them
+     * @details Unsigned integer types (the compact types of pixel_traits) multiply by a multiplier from 0 to 1 in 16.16
+     *          fixed point. Other types multiply in float, and integer types truncate the product. <br>
+     *          Anything that predicts the darkened pixels (e.g. string_art's score updates) should use the same multiplier.
+     * @tparam T Pixel type
+     */
+    template <typename T>
+    class pixel_multiplier
+    {
+    public:
+        explicit pixel_multiplier(const float _multiplier)
+            : multiplier(_multiplier),
+              fixed_multiplier((uint32_t)std::lround(std::min(std::max(_multiplier, 0.f), 1.f) * 65536.f)),
+              fixed(std::is_integral<T>::value && std::is_unsigned<T>::value && sizeof(T) <= 2 && _multiplier >= 0 && _multiplier <= 1)
+        {
+        }
+
+        /** @brief A pixel value after the multiply */
+        T operator()(const T value) const
+        {
+            if constexpr (std::is_integral<T>::value && std::is_unsigned<T>::value && sizeof(T) <= 2)
+            {
+                if (fixed)
+                    return (T)(((uint64_t)value * fixed_multiplier) >> 16);
+            }
+            return (T)(value * multiplier);
+        }
+
+    private:
+        float multiplier;
+        uint32_t fixed_multiplier;
+        bool fixed;
+    };
+
+    /**
+     * @brief Shared by the multiply_line() overloads for cached lines
+     * @param visit Called with each pixel index and its value before the multiply, after the pixel is multiplied
+     */
+    template <typename T, typename F>
+    void multiply_line_visit(CImg<T> &image, const line_raster &raster, const int line_index, const float multiplier, F &&visit)
+    {
+        T *data = image.data();
+        const pixel_multiplier<T> multiply(multiplier);
+        raster.for_each(line_index, [data, &multiply, &visit](const uint32_t p)
+        {
+            const T old_value = data[p];
+            data[p] = multiply(old_value);
+            visit(p, old_value);
+        });
+    }
+
+    /**
+     * @brief Multiply pixels along a line from a line_raster cache by a constant
+     * @details Rounded by a pixel_multiplier: unsigned integer images (the compact types of pixel_traits) multiply by a
+     *          multiplier from 0 to 1 in 16.16 fixed point, truncating like the float multiply of the other integer types.
+     * @param image Image to modify. Must be the size the cache was built for.
+     * @param raster Cached line pixels
+     * @param line_index Index of the line in the cache
+     * @param multiplier Amount to multiply each pixel by
+     */
+    template <typename T>
+    void multiply_line(CImg<T> &image, const line_raster &raster, const int line_index, const float multiplier)
+    {
+        multiply_line_visit(image, raster, line_index, multiplier, [](const uint32_t, const T) {});
+    }
+
+    /**
+     * @brief Multiply pixels along a line from a line_raster cache by a constant, and record the pixels it changes
+     * @param image Image to modify. Must be the size the cache was built for.
+     * @param raster Cached line pixels
+     * @param line_index Index of the line in the cache
+     * @param multiplier Amount to multiply each pixel by
+     * @param delta Cleared, then filled with the pixels that changed and their previous values
+     */
+    template <typename T>
+    void multiply_line(CImg<T> &image, const line_raster &raster, const int line_index, const float multiplier, pixel_delta<T> &delta)
+    {
+        delta.clear();
+        const T *data = image.data();
+        multiply_line_visit(image, raster, line_index, multiplier, [data, &delta](const uint32_t p, const T old_value)
+        {
+            if (data[p] != old_value)
+                delta.add(p, old_value);
+        });
     }
 
     template<typename T>
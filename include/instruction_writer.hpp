@@ -0,0 +1,123 @@
+/**
+ * @file instruction_writer.hpp
+ * @brief Streams the pins of a generated path to a file while it's generated
+ */
+#ifndef INSTRUCTION_WRITER_H
+#define INSTRUCTION_WRITER_H
+#include <coord.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+using coordinates::coord;
+using std::vector;
+
+/**
+ * @brief What a path was generated from, written at the start of binary instruction files
+ */
+struct instruction_header
+{
+    typedef coord<short> scoord;
+
+    /** @brief Width of the image the path was generated on */
+    uint16_t width = 0;
+    /** @brief Height of the image the path was generated on */
+    uint16_t height = 0;
+    /** @brief Radius of the pin circle. A ratio of the image radius */
+    float pin_radius = 0;
+    uint8_t score_method = 0;
+    float score_modifier = 0;
+    uint16_t score_depth = 1;
+    /** @brief Coordinates of the pins, in image space. The path's steps are indices into this. */
+    vector<scoord> pins;
+};
+
+/**
+ * @brief Writes a path one pin at a time, flushing it to the file in blocks
+ * @details Formats:
+ *          - csv: A "step,pin" header line, then one line per step.
+ *          - binary: The magic "SAIN", a version number, then the instruction_header and the blocks. All values are
+ *            little-endian. Each block is the varint count of its steps, the varint size of its payload in bytes, then
+ *            the payload: the difference from the previous pin (the first pin of the path follows pin 0) of each step,
+ *            wrapped to [-pin_count/2, pin_count/2) and zigzag varint encoded. Neighbouring pins of a path are usually
+ *            within a few hundred pins of each other, so most steps take one or two bytes.
+ *
+ *          Blocks are flushed as soon as they're full, so a crash loses at most the last block. read() skips a block
+ *          that was cut off.
+ */
+class instruction_writer
+{
+public:
+    typedef coord<short> scoord;
+
+    enum format
+    {
+        csv,
+        binary
+    };
+
+    /** @brief Written after the magic of binary files. Bumped on any change to the format. */
+    static const uint16_t version = 1;
+
+    /**
+     * @brief Open a file and write its header
+     * @param filename File to write. Overwritten if it exists.
+     * @param _format File format
+     * @param header What the path is generated from (the pin count is needed to encode the pins)
+     * @param _block_steps Steps per flushed block
+     * @throws std::runtime_error If the file can't be opened
+     */
+    instruction_writer(const std::string &filename, const format _format, const instruction_header &header, const int _block_steps = 256);
+
+    /** @brief Flushes the last block */
+    ~instruction_writer();
+
+    instruction_writer(const instruction_writer &) = delete;
+    instruction_writer &operator=(const instruction_writer &) = delete;
+
+    /** @brief Add the next pin of the path */
+    void write(const short pin);
+
+    /** @brief Add several pins */
+    void write(const short *path, const int count);
+
+    /** @brief Write the pending steps to the file as a block, and flush it */
+    void flush();
+
+    /** @brief Steps written so far, including the pending ones */
+    int steps() const
+    {
+        return step_count;
+    }
+
+    /** @brief Test whether every write so far succeeded */
+    bool good() const
+    {
+        return file.good();
+    }
+
+    /**
+     * @brief Read a binary instruction file
+     * @param filename File to read
+     * @param header Set to the file's header, if not null
+     * @return The path, up to the last complete block
+     * @throws std::runtime_error If the file can't be opened, or isn't a binary instruction file of this version
+     */
+    static vector<short> read(const std::string &filename, instruction_header *header = nullptr);
+
+private:
+    std::ofstream file;
+    const format file_format;
+    const short pin_count;
+    const int block_steps;
+    /** @brief Steps of the current block. Encoded for binary files, text for CSV files. */
+    std::string pending;
+    int pending_steps = 0;
+    int step_count = 0;
+    short last_pin = 0;
+
+    /** @brief Write the header of a binary file */
+    void write_header(const instruction_header &header);
+};
+
+#endif
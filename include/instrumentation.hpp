@@ -0,0 +1,223 @@
+/**
+ * @file instrumentation.hpp
+ * @brief Per-phase timers and counters, kept per thread and exported as JSON lines
+ */
+#ifndef INSTRUMENTATION_HPP
+#define INSTRUMENTATION_HPP
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Timers and counters for the string art pipeline
+ * @details Every thread adds to its own accumulator, so recording takes no locks.
+ *          snapshot() merges the accumulators of every thread, and thread_snapshot() reads only the calling thread's. <br>
+ *          Recording is on by default. When it's disabled (see set_enabled()), timers and counters cost one relaxed load
+ *          and don't read the clock.
+ */
+namespace instrumentation
+{
+    typedef std::chrono::steady_clock clock;
+
+    /**
+     * @brief Timed phases
+     * @details Phases can nest (update includes update_darkness), so their times don't add up to the total.
+     */
+    enum phase
+    {
+        /** Loading and resizing the input image */
+        load_image,
+        /** Placing pins and building the line_set */
+        build_lines,
+        /** Converting the input to Lab */
+        lab_image,
+        /** Building the darkness map */
+        darkness_map,
+        /** Building the region size map */
+        region_map,
+        /** Scoring every line */
+        score_lines,
+        /** Filling the score trees */
+        build_trees,
+        /** Choosing the next pin */
+        select,
+        /** Drawing a string and rescoring the lines it overlaps */
+        update,
+        /** Darkening the darkness map under a string */
+        update_darkness,
+        /** Copying the state for a checkpoint (the save runs in the background) */
+        checkpoint,
+        /** One whole step of the path */
+        step,
+        phase_count
+    };
+
+    /** @brief Counted events */
+    enum counter
+    {
+        /** Lines rescored after a string was drawn */
+        chords_touched,
+        /** Pixels read while rescoring: the shared pixels of every rescored line, plus the drawn line */
+        pixels_visited,
+        counter_count
+    };
+
+    /** @brief Name of a phase, as written to JSON */
+    const char *name(const phase p);
+    /** @brief Name of a counter, as written to JSON */
+    const char *name(const counter c);
+
+    /** @brief Times and counts of one step */
+    struct step_record
+    {
+        double seconds[phase_count] = {};
+        uint64_t counts[counter_count] = {};
+    };
+
+    /** @brief Totals recorded by one thread, or merged from several */
+    struct accumulator
+    {
+        /** @brief Total time in each phase */
+        double seconds[phase_count] = {};
+        /** @brief Times each phase was entered */
+        uint64_t calls[phase_count] = {};
+        /** @brief Total of each counter */
+        uint64_t counts[counter_count] = {};
+        /** @brief Time of every step, in order (merged accumulators hold every thread's steps) */
+        std::vector<float> step_seconds;
+        /** @brief Steps in progress and the last finished step (per thread only) */
+        step_record current, last;
+
+        /** @brief Add another accumulator's totals and steps */
+        void merge(const accumulator &other);
+        /** @brief Clear everything */
+        void clear();
+        /**
+         * @brief Step time at a percentile
+         * @param p Percentile, from 0 to 100
+         * @return Seconds, or 0 without steps
+         */
+        double step_percentile(const double p) const;
+        /**
+         * @brief Write the totals as one line of JSON
+         * @param out Stream to write to
+         * @param label Written as the "label" field
+         */
+        void write_json_line(std::ostream &out, const std::string &label) const;
+    };
+
+    namespace detail
+    {
+        extern std::atomic<bool> enabled;
+        /** @brief The calling thread's accumulator, registered on first use */
+        accumulator &local();
+    }
+
+    /** @brief Test whether recording is on */
+    inline bool enabled()
+    {
+        return detail::enabled.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Turn recording on or off, for every thread */
+    void set_enabled(const bool on);
+
+    /** @brief Add to a counter of the calling thread */
+    inline void count(const counter c, const uint64_t n)
+    {
+        if (!enabled())
+            return;
+        accumulator &a = detail::local();
+        a.counts[c] += n;
+        a.current.counts[c] += n;
+    }
+
+    /** @brief Add time to a phase of the calling thread */
+    void add(const phase p, const double seconds);
+
+    /**
+     * @brief Times a scope as one call of a phase
+     * @details Reads the clock only if recording was on when the timer was made.
+     */
+    class scoped_timer
+    {
+    public:
+        explicit scoped_timer(const phase _p) : p(_p), on(enabled())
+        {
+            if (on)
+                start = clock::now();
+        }
+        ~scoped_timer()
+        {
+            if (on)
+                add(p, std::chrono::duration<double>(clock::now() - start).count());
+        }
+        scoped_timer(const scoped_timer &) = delete;
+        scoped_timer &operator=(const scoped_timer &) = delete;
+
+    private:
+        const phase p;
+        const bool on;
+        clock::time_point start;
+    };
+
+    /**
+     * @brief Times a scope as one step
+     * @details Adds to the step phase, saves the step's time to the step latencies, and makes the step's phases and
+     *          counters available from last_step().
+     */
+    class step_timer
+    {
+    public:
+        step_timer();
+        ~step_timer();
+        step_timer(const step_timer &) = delete;
+        step_timer &operator=(const step_timer &) = delete;
+
+    private:
+        const bool on;
+        clock::time_point start;
+    };
+
+    /**
+     * @brief Time a function as one call of a phase
+     * @return What f returns
+     */
+    template <typename F>
+    auto timed(const phase p, F &&f) -> decltype(f())
+    {
+        scoped_timer timer(p);
+        return f();
+    }
+
+    /** @brief Times and counts of the calling thread's last finished step */
+    const step_record &last_step();
+
+    /**
+     * @brief Totals of every thread
+     * @warning Reads other threads' accumulators without locking them, so call it when no instrumented work is running.
+     */
+    accumulator snapshot();
+
+    /** @brief Totals of the calling thread */
+    accumulator thread_snapshot();
+
+    /** @brief Clear the totals of every thread (same warning as snapshot())*/
+    void reset();
+
+    /** @brief Clear the totals of the calling thread */
+    void reset_thread();
+
+    /**
+     * @brief Append snapshot() to a JSON-lines file
+     * @param filename File to append to
+     * @param label Written as the "label" field
+     * @return False if the file couldn't be opened
+     */
+    bool append_json_line(const std::string &filename, const std::string &label);
+}
+
+#endif
@@ -0,0 +1,40 @@
+/**
+ * @file line_kernels.hpp
+ * @brief Bulk per-line pixel reductions, with an AVX2 version picked at runtime
+ */
+#ifndef LINE_KERNELS_HPP
+#define LINE_KERNELS_HPP
+#include <cstdint>
+#include <cstddef>
+
+namespace line_kernels
+{
+    /**
+     * @brief Test whether the AVX2 kernels are used
+     * @details Checked once, on the CPU the program runs on. Only built for x86 with GCC or Clang.
+     */
+    bool avx2_enabled();
+
+    /**
+     * @brief Sum and count the positive values of an image at a list of pixels
+     * @details Gathers 8 pixels at a time with AVX2 when available (int and float images).
+     *          Other types, and CPUs without AVX2, use the scalar loop.
+     * @param image Image data
+     * @param pixels Linear pixel indices into image
+     * @param count Number of pixels
+     * @param sum Set to the sum of the positive values
+     * @param length Set to the number of positive values
+     */
+    template <typename T>
+    void masked_sum(const T *image, const uint32_t *pixels, const size_t count, float &sum, float &length);
+
+    /** @brief Uses AVX2 when available */
+    template <>
+    void masked_sum<int>(const int *image, const uint32_t *pixels, const size_t count, float &sum, float &length);
+
+    /** @brief Uses AVX2 when available */
+    template <>
+    void masked_sum<float>(const float *image, const uint32_t *pixels, const size_t count, float &sum, float &length);
+}
+
+#endif
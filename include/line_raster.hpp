@@ -0,0 +1,211 @@
+/**
+ * @file line_raster.hpp
+ * @brief Cache of the pixels covered by every pin-to-pin line
+ */
+#ifndef LINE_RASTER_H
+#define LINE_RASTER_H
+#include <coord.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+using std::vector;
+using coordinates::coord;
+
+/**
+ * @brief Pixels of every allowed line, rasterized once
+ * @details Each line is stored as a sorted, de-duplicated list of linear pixel indices (\f$y \times width + x\f$),
+ *          with the end buffer already removed. All lines are packed back-to-back in one array, and line i occupies
+ *          [starts[i], starts[i+1]). <br>
+ *          With line_raster::delta encoding, each pixel after the first is stored as a 16-bit difference from the
+ *          previous one. Differences that don't fit are escaped with delta_escape and stored as a full 32-bit index.
+ */
+class line_raster
+{
+    typedef coord<short> scoord;
+
+public:
+    /** @brief Storage format of the pixel indices */
+    enum encoding : unsigned char
+    {
+        /** @brief One 32-bit index per pixel. Fastest to read. */
+        absolute = 0,
+        /** @brief 16-bit deltas between sorted indices. About half the size of absolute. */
+        delta = 1,
+    };
+
+    /** @brief Marks a delta that didn't fit in 16 bits. The next two words hold the full index (high, low). */
+    static constexpr uint16_t delta_escape = 0xFFFF;
+
+    line_raster() {}
+
+    /**
+     * @brief Rasterize every line
+     * @param _width Width of the image the lines are drawn on
+     * @param _height Height of the image the lines are drawn on
+     * @param pins Coordinates of the pins
+     * @param line_pairs Pin pair of each line. Pairs with a negative pin are stored as empty lines.
+     * @param line_count Number of lines in line_pairs
+     * @param buffer Steps to skip at the start / end of each line (see image_editing::draw_line())
+     * @param _format Storage format of the pixel indices
+     * @param show_progress Print the size of the raster
+     */
+    line_raster(const int _width, const int _height, const scoord *pins, const scoord *line_pairs, const int line_count, const short buffer = 3, const encoding _format = absolute, const bool show_progress = true);
+
+    /**
+     * @brief Call f(pixel_index) for every pixel of a line, in ascending order
+     */
+    template <typename F>
+    void for_each(const int line_index, F &&f) const
+    {
+        const size_t start = starts[line_index];
+        const size_t end = starts[line_index + 1];
+        if (format == absolute)
+        {
+            for (size_t i = start; i < end; i++)
+            {
+                f(pixels[i]);
+            }
+            return;
+        }
+        if (start == end)
+            return;
+        uint32_t cur = ((uint32_t)deltas[start] << 16) | deltas[start + 1];
+        f(cur);
+        for (size_t i = start + 2; i < end; i++)
+        {
+            if (deltas[i] == delta_escape)
+            {
+                cur = ((uint32_t)deltas[i + 1] << 16) | deltas[i + 2];
+                i += 2;
+            }
+            else
+            {
+                cur += deltas[i];
+            }
+            f(cur);
+        }
+    }
+
+    /**
+     * @brief Copy the pixels of a line into a buffer
+     * @param line_index Line to decode
+     * @param out Cleared, then filled with the line's pixel indices in ascending order
+     */
+    void decode(const int line_index, vector<uint32_t> &out) const;
+
+    /**
+     * @brief Pixels of a line, without decoding
+     * @return The line's pixel indices in ascending order (size() of them), or nullptr if the format isn't absolute
+     */
+    const uint32_t *data(const int line_index) const
+    {
+        return (format == absolute) ? pixels.data() + starts[line_index] : nullptr;
+    }
+
+    /** @brief Number of pixels in a line */
+    uint32_t size(const int line_index) const
+    {
+        return pixel_counts[line_index];
+    }
+
+    /** @brief Number of lines */
+    int line_count() const
+    {
+        return (int)pixel_counts.size();
+    }
+
+    /** @brief Sum of all line sizes */
+    size_t total_pixels() const
+    {
+        return pixel_total;
+    }
+
+    int width() const
+    {
+        return w;
+    }
+
+    int height() const
+    {
+        return h;
+    }
+
+    encoding get_format() const
+    {
+        return format;
+    }
+
+    /** @brief Bytes used by the cache */
+    size_t memory_usage() const;
+
+    /**
+     * @brief Call f(pixel_index) for every pixel visited by a line, stepping in 32.32 fixed point
+     * @details Takes the same steps as coordinates::line<T>::line_iterator: from the end with the lower x, one unit of
+     *          length at a time. Each position is the start plus a multiple of the step, so no error builds up along
+     *          the line, and each pixel costs two integer adds and a shift instead of two float-to-int conversions.
+     *          The visited pixels are the same as float_walk()'s except where the float sum drifts across a pixel edge,
+     *          and then only by one pixel (see test/raster_test.cpp). Not sorted or de-duplicated.
+     * @param a First end of the line
+     * @param b Second end of the line
+     * @param width Image width, used for the linear index
+     * @param buffer Steps to skip at the start / end of the line
+     * @param f Called with each pixel index
+     */
+    template <typename F>
+    static void for_each_walked(const scoord a, const scoord b, const int width, const short buffer, F f)
+    {
+        const scoord start = (a.x < b.x) ? a : b;
+        const scoord end = (a.x < b.x) ? b : a;
+        const float length = coordinates::distance(coord<float>(start), coord<float>(end));
+        if (length == 0)
+            return;
+        // The same float step as the iterator, rounded to fixed point
+        const int64_t dx = (int64_t)std::llround((double)((end.x - start.x) / length) * fixed_one);
+        const int64_t dy = (int64_t)std::llround((double)((end.y - start.y) / length) * fixed_one);
+        const long steps = (long)length + 1 - buffer;
+        int64_t x = start.x * fixed_one + dx * buffer;
+        int64_t y = start.y * fixed_one + dy * buffer;
+        for (long i = buffer; i < steps; i++)
+        {
+            // Rounding can end a line a hair above row 0
+            const int64_t row = (y < 0) ? 0 : (y >> fixed_shift);
+            f((uint32_t)(row * width + (x >> fixed_shift)));
+            x += dx;
+            y += dy;
+        }
+    }
+
+    /**
+     * @brief Pixels visited by a line (see for_each_walked())
+     * @param out Cleared, then filled with the visited pixel indices
+     */
+    static void walk(const scoord a, const scoord b, const int width, const short buffer, vector<uint32_t> &out);
+
+    /**
+     * @brief Pixels visited by a line, stepping a float position like coordinates::line<T>::line_iterator
+     * @details The rasterizer before walk(). Kept as the reference for its conformance check.
+     * @param out Cleared, then filled with the visited pixel indices
+     */
+    static void float_walk(const scoord a, const scoord b, const int width, const short buffer, vector<uint32_t> &out);
+
+private:
+    /** @brief Fraction bits of for_each_walked()'s positions */
+    static constexpr int fixed_shift = 32;
+    static constexpr double fixed_one = 4294967296.0;
+
+    int w = 0;
+    int h = 0;
+    encoding format = absolute;
+    size_t pixel_total = 0;
+    /** @brief Start of each line in pixels / deltas, plus one past the end */
+    vector<size_t> starts{0};
+    /** @brief Number of pixels in each line */
+    vector<uint32_t> pixel_counts;
+    /** @brief Pixel storage when format == absolute */
+    vector<uint32_t> pixels;
+    /** @brief Pixel storage when format == delta */
+    vector<uint16_t> deltas;
+};
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * @file line_set.hpp
+ * @brief Pins, the lines between them, and their rasters
+ */
+#ifndef LINE_SET_H
+#define LINE_SET_H
+#include <coord.hpp>
+#include <pin_pair_index.hpp>
+#include <line_raster.hpp>
+#include <pixel_line_index.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+using std::vector;
+using coordinates::coord;
+
+/**
+ * @brief Every allowed line between a set of pins, with its pixels and the pixel-to-line index
+ * @details Depends only on the image size, the pins, the minimum separation and the border pairs, and is never modified after construction,
+ *          so any number of string_art instances can share one line_set (see string_art::generate_multi()).
+ */
+struct line_set
+{
+    typedef coord<short> scoord;
+
+    /** @brief Steps skipped at each end of a line's raster (see line_raster)*/
+    static constexpr short raster_buffer = 3;
+
+    /**
+     * @brief Build the lines, rasterize them, and index their pixels
+     * @param _width Width of the image the lines are drawn on
+     * @param _height Height of the image the lines are drawn on
+     * @param _pins Coordinates of the pins, in image space
+     * @param _min_separation Minimum difference between pins in a line
+     * @param _border_pairs Pairs that get no line, as their chord runs along the frame (see pin_layout::border_pairs()).
+     *                      Each pair once, with the lower pin first.
+     * @param raster_encoding Storage format of the line pixels
+     * @param tile_shift Tile size of the pixel index (see pixel_line_index)
+     * @param show_progress Print each stage, and the size of the raster and index
+     * @throws std::domain_error If _min_separation is less than 1 or more than half the pin count
+     */
+    line_set(const int _width, const int _height, const vector<scoord> &_pins, const short _min_separation, const vector<scoord> &_border_pairs = {}, const line_raster::encoding raster_encoding = line_raster::absolute, const short tile_shift = 0, const bool show_progress = true);
+
+    /** @brief Width of the image the lines are drawn on */
+    const int width;
+    /** @brief Height of the image the lines are drawn on */
+    const int height;
+    /** @brief Number of pins */
+    const short pin_count;
+    /** @brief Minimum difference between pins in a line */
+    const short min_separation;
+    /** @brief Coordinates of the pins
+     * @details In image space (e.g. in a 256x556 image, (254,254) corresponds to the top right corner).
+     */
+    const vector<scoord> pins;
+    /** @brief Total number of possible connections: the separated pairs, less the border pairs */
+    const int line_count;
+    /** @brief Every allowed connection
+     * @details Each (x,y) pair corresponds to a pair of pins that may have a string drawn between them.
+     */
+    vector<scoord> line_pairs;
+    /** @brief Index of every line, with pins as indices
+     * @details (a,b) and (b,a) map to the same line.
+     */
+    pin_pair_index index;
+    /** @brief Pixels covered by each line, in the same order as line_pairs */
+    line_raster raster;
+    /** @brief Lines covering each pixel of raster */
+    pixel_line_index pixel_index;
+
+    /**
+     * @brief Index of the line between two pins
+     * @return Index into line_pairs and raster, or pin_pair_index::none if the pair has no line
+     */
+    int line_index(const short pin_a, const short pin_b) const
+    {
+        return index.at(pin_a, pin_b);
+    }
+
+    /**
+     * @brief Whether two lines cross
+     * @details Lines cross if each one's pins are strictly on opposite sides of the other (see crossing_lines()).
+     */
+    bool lines_cross(const int line_a, const int line_b) const;
+
+    /**
+     * @brief Every line that crosses the chord between two pins
+     * @details Uses exact integer orientation tests on the pin coordinates, so it holds for any pin layout, not only for
+     *          pins in order around a convex frame. Lines that share a pin with the chord, or only touch it, don't cross it.
+     *          The tests are branch-free over the pin coordinates of every line (line_ends), so the loop vectorizes. <br>
+     *          Generation doesn't use it: the lines a new string changes are the ones sharing its pixels, found through
+     *          pixel_index for any layout.
+     * @param crossing Cleared, then filled with the indices of the crossing lines, in order
+     */
+    void crossing_lines(const short pin_a, const short pin_b, vector<int> &crossing) const;
+
+    /** @brief Bytes used by the lines, their rasters and the pixel index */
+    size_t memory_usage() const;
+
+    /**
+     * @brief Calculate the number of possible connections
+     * @param pin_count Number of pins
+     * @param pin_separation Minimum difference between pins in connection, from 1 to pin_count / 2
+     * @return short Number of connections
+     */
+    static int calculate_line_count(int pin_count, int min_separation);
+
+private:
+    /** @brief Pin coordinates of every line, one array per coordinate so crossing_lines() vectorizes */
+    struct
+    {
+        vector<int32_t> ax, ay, bx, by;
+    } line_ends;
+
+    /** @brief Fill line_pairs, index and line_ends, skipping border_pairs */
+    void build_lines(const vector<scoord> &border_pairs);
+};
+
+#endif
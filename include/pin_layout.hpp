@@ -0,0 +1,107 @@
+/**
+ * @file pin_layout.hpp
+ * @brief Shapes of the frame the pins are placed on
+ */
+#ifndef PIN_LAYOUT_H
+#define PIN_LAYOUT_H
+#include <CImg.h>
+#include <coord.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+using coordinates::coord;
+using std::vector;
+
+/**
+ * @brief Where the pins go, and which pixels the strings may cover
+ * @details Pins are numbered in order around the frame, which is what min_separation counts along (see line_set). <br>
+ *          - circle: pin_count pins evenly around a circle, the original layout
+ *          - ellipse: pin_count pins evenly spaced in angle around the ellipse inscribed in the image
+ *          - rectangle: pin_count pins evenly spaced along the edges of a rectangle, clockwise from the top left corner
+ *          - custom: pins loaded from a file (see load())
+ *
+ *          A float converts to a circle of that radius, so a radius can be passed wherever a layout is expected.
+ */
+struct pin_layout
+{
+    typedef coord<short> scoord;
+
+    enum shape : uint8_t
+    {
+        circle,
+        ellipse,
+        rectangle,
+        custom
+    };
+
+    /** @param _size Radius of the pin circle. A ratio of the image radius */
+    pin_layout(const float _size = 0.95f);
+
+    /** @param _size Size of the frame. A ratio of the image size */
+    pin_layout(const shape _type, const float _size);
+
+    /**
+     * @brief Custom layout from pins that are already loaded (e.g. from a checkpoint)
+     * @param _points Pins in any unit, in order around the frame (see load())
+     * @param _size Size of the frame. A ratio of the image size
+     * @param _source Returned by name(), e.g. the file the pins were loaded from
+     */
+    pin_layout(const vector<coord<float>> &_points, const float _size, const std::string &_source);
+
+    /** @brief Shape of the frame */
+    shape type;
+    /** @brief Size of the frame. A ratio of the image size (1 = touching the edges)*/
+    float size;
+    /** @brief Pins of a custom layout, in the units of the file they were loaded from */
+    vector<coord<float>> points;
+
+    /**
+     * @brief Coordinates of the pins on an image
+     * @param pin_count Number of pins. Ignored by custom layouts, which have one pin per point.
+     * @return Pins in image space, all inside the image
+     * @throws std::runtime_error If a custom layout has fewer than 3 points
+     */
+    vector<scoord> place(const int width, const int height, const short pin_count) const;
+
+    /**
+     * @brief Pairs of pins whose chord runs along a straight side of the frame
+     * @details Such a chord only covers the border, so it can't add to the image (see line_set). <br>
+     *          - rectangle: both pins on the same edge (a corner pin is on two)
+     *          - custom: every pin between the two, in pin order one way around, is within a pixel of the chord. This
+     *            includes neighbouring pins, whose chord is an edge of the polygon.
+     *          - circle, ellipse: none, as the frame has no straight sides
+     * @param pins Pins placed by place()
+     * @return Each pair once, with the lower pin first, in order
+     */
+    vector<scoord> border_pairs(const vector<scoord> &pins) const;
+
+    /**
+     * @brief 1 for the pixels inside the frame, 0 elsewhere
+     * @details Custom frames are the polygon through their pins, in file order.
+     */
+    cimg_library::CImg<unsigned char> mask(const int width, const int height) const;
+
+    /** @brief Shape name, or the file a custom layout was loaded from (see parse())*/
+    std::string name() const;
+
+    /**
+     * @brief Load a custom layout
+     * @details One pin per line as "x y", in any unit (e.g. millimetres on the frame), in order around the frame. Lines
+     *          that are empty or start with '#' are skipped. The pins are scaled to fit size of the image, centred, keeping
+     *          their aspect ratio.
+     * @throws std::runtime_error If the file can't be read, or has fewer than 3 pins
+     */
+    static pin_layout load(const std::string &pin_file, const float size = 1);
+
+    /**
+     * @brief Layout from a name
+     * @param name "circle", "ellipse", "rectangle", or the filename of a custom layout (see load())
+     */
+    static pin_layout parse(const std::string &name, const float size);
+
+private:
+    /** @brief File a custom layout was loaded from */
+    std::string source;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file pin_pair_index.hpp
+ * @brief Dense lookup table from an unordered pair of pins to a line index
+ */
+#ifndef PIN_PAIR_INDEX_H
+#define PIN_PAIR_INDEX_H
+#include <vector>
+#include <cstddef>
+#include <utility>
+using std::vector;
+
+/**
+ * @brief Maps every unordered pair of pins to the index of its line
+ * @details The pairs are packed into a flat upper-triangular array (no diagonal), so (a,b) and (b,a) share one slot
+ *          and every lookup is a single multiply-add with no pointer chasing. <br>
+ *          Pairs that were never set hold pin_pair_index::none. The index doesn't change after the lines are built: culled
+ *          lines keep their slot, and are flagged by their owner instead (see string_art::culled).
+ */
+class pin_pair_index
+{
+public:
+    /** @brief Sentinel for a pair without a line (too close, or a pin paired with itself)*/
+    static constexpr int none = -1;
+
+    /**
+     * @brief Constructor
+     * @param _pin_count Number of pins
+     */
+    pin_pair_index(const short _pin_count = 0);
+
+    /**
+     * @brief Line index of the connection between two pins
+     * @return The line index, or pin_pair_index::none if the pair has no line
+     */
+    int at(const short pin_a, const short pin_b) const
+    {
+        if (pin_a == pin_b)
+            return none;
+        return slots[slot(pin_a, pin_b)];
+    }
+
+    /**
+     * @brief Test whether two pins have a line between them
+     */
+    bool contains(const short pin_a, const short pin_b) const
+    {
+        return at(pin_a, pin_b) != none;
+    }
+
+    /**
+     * @brief Assign the line index of a pair of pins
+     * @param pin_a First pin
+     * @param pin_b Second pin (must differ from pin_a)
+     * @param line_index Index of the line in the owner's line arrays
+     */
+    void set(const short pin_a, const short pin_b, const int line_index);
+
+    /** @brief Number of pins */
+    short pin_count() const
+    {
+        return pins;
+    }
+
+    /** @brief Bytes used by the lookup table */
+    size_t memory_usage() const
+    {
+        return slots.size() * sizeof(int);
+    }
+
+private:
+    /** @brief Number of pins */
+    short pins;
+    /** @brief Upper triangle of the pin x pin grid, row-major */
+    vector<int> slots;
+
+    /**
+     * @brief Position of the pair in slots
+     * @details Row a of the upper triangle starts after \f$\sum_{i<a}(n-1-i) = a(2n-a-1)/2\f$ elements.
+     */
+    size_t slot(short pin_a, short pin_b) const
+    {
+        if (pin_a > pin_b)
+            std::swap(pin_a, pin_b);
+        return (size_t)pin_a * (2 * pins - pin_a - 1) / 2 + (pin_b - pin_a - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * @file pin_score_tree.hpp
+ * @brief Per-pin tournament trees over line scores
+ */
+#ifndef PIN_SCORE_TREE_H
+#define PIN_SCORE_TREE_H
+#include <vector>
+#include <cstddef>
+using std::vector;
+
+/**
+ * @brief One tournament (winner) tree per pin, over the scores of the lines leaving that pin
+ * @details Tree \c from has one leaf per destination pin. Every internal node holds the destination pin with the
+ *          highest score in its subtree (ties go to the lower pin), so the root is the best line from that pin. <br>
+ *          Changing a score replays the matches on the way to the root: \f$O(\log \textrm{pin\_count})\f$.
+ *          Reading the best line is \f$O(1)\f$. <br>
+ *          Leaves without a line (never set, or removed) never win.
+ * @tparam T Score type
+ */
+template <typename T>
+class pin_score_tree
+{
+public:
+    /** @brief Returned by best() when a pin has no lines */
+    static constexpr short none = -1;
+
+    pin_score_tree() {}
+
+    /**
+     * @brief Constructor
+     * @details Every tree starts empty.
+     * @param _pin_count Number of pins
+     */
+    pin_score_tree(const short _pin_count);
+
+    /**
+     * @brief Set the score of a line in both of its pins' trees
+     */
+    void set_pair(const short pin_a, const short pin_b, const T score)
+    {
+        set(pin_a, pin_b, score);
+        set(pin_b, pin_a, score);
+    }
+
+    /**
+     * @brief Remove a line from both of its pins' trees
+     */
+    void remove_pair(const short pin_a, const short pin_b)
+    {
+        remove(pin_a, pin_b);
+        remove(pin_b, pin_a);
+    }
+
+    /**
+     * @brief Set the score of from_pin -> to_pin in from_pin's tree
+     */
+    void set(const short from_pin, const short to_pin, const T score);
+
+    /**
+     * @brief Remove from_pin -> to_pin from from_pin's tree
+     */
+    void remove(const short from_pin, const short to_pin);
+
+    /**
+     * @brief Destination of the best-scoring line from a pin
+     * @return The destination pin, or pin_score_tree::none if the pin has no lines
+     */
+    short best(const short from_pin) const
+    {
+        return winners[node(from_pin, 1)];
+    }
+
+    /**
+     * @brief Score of the best line from a pin
+     * @warning Only meaningful if best(from_pin) != none
+     */
+    T best_score(const short from_pin) const
+    {
+        return score(from_pin, best(from_pin));
+    }
+
+    /**
+     * @brief The highest-scoring destinations from a pin, best first
+     * @details Walks the tree best-first, so the cost is \f$O(k \log k)\f$ rather than a full sort.
+     * @param from_pin Pin to search from
+     * @param k Maximum number of destinations
+     * @param out Cleared, then filled with up to k destination pins
+     */
+    void top(const short from_pin, const short k, vector<short> &out) const;
+
+    /** @brief Current score of from_pin -> to_pin */
+    T score(const short from_pin, const short to_pin) const
+    {
+        return scores[(size_t)from_pin * leaf_count + to_pin];
+    }
+
+    /** @brief Test whether from_pin -> to_pin is in the tree */
+    bool contains(const short from_pin, const short to_pin) const
+    {
+        return winners[node(from_pin, leaf_count + to_pin)] != none;
+    }
+
+    short pin_count() const
+    {
+        return pins;
+    }
+
+private:
+    short pins = 0;
+    /** @brief Leaves per tree (pin_count rounded up to a power of two) */
+    size_t leaf_count = 0;
+    /** @brief Leaf scores, leaf_count per pin */
+    vector<T> scores;
+    /** @brief Winning destination pin of each node, 2 * leaf_count per pin. Node 1 is the root, node n has children 2n and 2n+1.*/
+    vector<short> winners;
+
+    /** @brief Position of a tree node in winners */
+    size_t node(const short from_pin, const size_t n) const
+    {
+        return (size_t)from_pin * 2 * leaf_count + n;
+    }
+
+    /** @brief Replay the matches from a leaf to the root */
+    void replay(const short from_pin, size_t n);
+};
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file pixel_delta.hpp
+ * @brief The pixels one edit changed, and their previous values
+ */
+#ifndef PIXEL_DELTA_H
+#define PIXEL_DELTA_H
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+using std::vector;
+
+/**
+ * @brief Journal of one edit to an image: the pixels it changed, and what they were before
+ * @details Lets a scorer compare an image before and after an edit without a copy of the whole image.
+ *          Filled by image_editing::draw_line(). Reusing one instance between edits avoids re-allocating.
+ * @tparam T Image type
+ */
+template <typename T>
+struct pixel_delta
+{
+    /** @brief Changed pixel indices, in ascending order */
+    vector<uint32_t> pixels;
+    /** @brief Value of each changed pixel before the edit */
+    vector<T> previous;
+
+    /** @brief Number of changed pixels */
+    size_t size() const
+    {
+        return pixels.size();
+    }
+
+    void clear()
+    {
+        pixels.clear();
+        previous.clear();
+    }
+
+    /**
+     * @brief Record a change
+     * @warning Pixels must be added in ascending order
+     */
+    void add(const uint32_t pixel, const T old_value)
+    {
+        pixels.push_back(pixel);
+        previous.push_back(old_value);
+    }
+
+    /**
+     * @brief Value a pixel had before the edit
+     * @param pixel Pixel index
+     * @param current Value of the pixel now
+     * @return The recorded value if the edit changed the pixel, otherwise current
+     */
+    T before(const uint32_t pixel, const T current) const
+    {
+        const auto p = std::lower_bound(pixels.begin(), pixels.end(), pixel);
+        return (p != pixels.end() && *p == pixel) ? previous[p - pixels.begin()] : current;
+    }
+};
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * @file pixel_line_index.hpp
+ * @brief Inverted index from pixels to the lines that cover them
+ */
+#ifndef PIXEL_LINE_INDEX_H
+#define PIXEL_LINE_INDEX_H
+#include <line_raster.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+using std::vector;
+using std::pair;
+
+/**
+ * @brief Pixels shared between one line and every other line that touches it
+ * @details Grouped by line: the pixels shared with lines[i] are pixels[starts[i]] to pixels[starts[i+1]-1], in ascending order.
+ *          Filled by pixel_line_index::overlaps(). Reusing one instance between calls avoids re-allocating.
+ */
+struct line_overlaps
+{
+    /** @brief Lines that share at least one pixel with the queried line, in ascending order */
+    vector<int> lines;
+    /** @brief Start of each line's pixels, plus one past the end */
+    vector<size_t> starts;
+    /** @brief Shared pixel indices */
+    vector<uint32_t> pixels;
+    /** @brief Working space for pixel_line_index::overlaps() */
+    vector<pair<int, uint32_t>> scratch;
+
+    /** @brief Number of overlapping lines */
+    size_t size() const
+    {
+        return lines.size();
+    }
+
+    /** @brief Number of pixels shared with lines[i] */
+    size_t pixel_count(const size_t i) const
+    {
+        return starts[i + 1] - starts[i];
+    }
+
+    /** @brief First pixel shared with lines[i] */
+    const uint32_t *pixels_of(const size_t i) const
+    {
+        return pixels.data() + starts[i];
+    }
+
+    void clear()
+    {
+        lines.clear();
+        starts.assign(1, 0);
+        pixels.clear();
+        scratch.clear();
+    }
+};
+
+/**
+ * @brief For each pixel (or square tile of pixels), the lines of a line_raster that cover it
+ * @details Stored in compressed-row form: the lines covering tile t are lines[offsets[t]] to lines[offsets[t+1]-1]. <br>
+ *          With tile_shift = 0 every tile is a single pixel and overlaps() reads shared pixels straight from the index.
+ *          Larger tiles use much less memory, and overlaps() then intersects the candidate lines' rasters to recover
+ *          the exact shared pixels.
+ */
+class pixel_line_index
+{
+public:
+    pixel_line_index() {}
+
+    /**
+     * @brief Build the index
+     * @param raster Rasterized lines to index
+     * @param _tile_shift Tiles are \f$2^{tile\_shift}\f$ pixels square
+     * @param show_progress Print the size of the index
+     */
+    pixel_line_index(const line_raster &raster, const short _tile_shift = 0, const bool show_progress = true);
+
+    /**
+     * @brief Find every line that shares pixels with the given line, and the pixels they share
+     * @param line_index Line to compare against. It is not included in the result.
+     * @param raster The raster the index was built from
+     * @param result Cleared, then filled with the overlapping lines and their shared pixels
+     */
+    void overlaps(const int line_index, const line_raster &raster, line_overlaps &result) const;
+
+    /** @brief Lines that cover a tile (lines_at() of them), in ascending order */
+    const int *lines_of(const size_t tile) const
+    {
+        return lines.data() + offsets[tile];
+    }
+
+    /** @brief Number of lines that cover a tile */
+    uint32_t lines_at(const size_t tile) const
+    {
+        return offsets[tile + 1] - offsets[tile];
+    }
+
+    /** @brief Tile that contains a pixel */
+    size_t tile_of(const uint32_t pixel) const
+    {
+        if (tile_shift == 0)
+            return pixel;
+        return (size_t)((pixel / w) >> tile_shift) * tiles_x + ((pixel % w) >> tile_shift);
+    }
+
+    short get_tile_shift() const
+    {
+        return tile_shift;
+    }
+
+    /** @brief Bytes used by the index */
+    size_t memory_usage() const
+    {
+        return offsets.capacity() * sizeof(uint32_t) + lines.capacity() * sizeof(int);
+    }
+
+private:
+    int w = 0;
+    short tile_shift = 0;
+    size_t tiles_x = 0;
+    /** @brief Start of each tile's lines, plus one past the end */
+    vector<uint32_t> offsets;
+    /** @brief Line indices, grouped by tile */
+    vector<int> lines;
+};
+
+#endif
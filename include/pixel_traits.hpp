@@ -0,0 +1,44 @@
+/**
+ * @file pixel_traits.hpp
+ * @brief How each image type stores darkness and strings
+ */
+#ifndef PIXEL_TRAITS_H
+#define PIXEL_TRAITS_H
+#include <sys/types.h>
+
+/**
+ * @brief Storage of the working images of string_art<T>
+ * @details float, int and short images hold darkness in grey levels (0 to 255), and strings are drawn into an image of
+ *          the same type. <br>
+ *          The compact types hold the same darkness in fewer bytes per pixel, and draw strings into a u_char coverage plane:
+ *          - u_char: whole grey levels (1 byte)
+ *          - u_short: 8.8 fixed point, grey level x 256 (2 bytes)
+ *
+ *          Both darken lines in fixed point (see image_editing::pixel_multiplier), and score updates darken with the same
+ *          rounding. Line scores have the same units as the darkness, so u_char scores are whole grey levels.
+ * @tparam T Image type
+ */
+template <typename T>
+struct pixel_traits
+{
+    /** @brief Darkness units per grey level */
+    static constexpr float darkness_scale = 1;
+    /** @brief Pixel type of the string image */
+    typedef T coverage_type;
+};
+
+template <>
+struct pixel_traits<u_char>
+{
+    static constexpr float darkness_scale = 1;
+    typedef u_char coverage_type;
+};
+
+template <>
+struct pixel_traits<u_short>
+{
+    static constexpr float darkness_scale = 256;
+    typedef u_char coverage_type;
+};
+
+#endif
@@ -1,17 +1,40 @@
 #ifndef STRING_ART_H
 #define STRING_ART_H
 #define SCORE_RESOLUTION 255.f
+/** Tiles of the pixel-to-line index are 2^PIXEL_INDEX_TILE_SHIFT pixels square. 0 indexes single pixels (fastest, largest). */
+#ifndef PIXEL_INDEX_TILE_SHIFT
+#define PIXEL_INDEX_TILE_SHIFT 0
+#endif
+/** The debug display and the ascii progress readout. Compiled out by STRING_ART_HEADLESS (see CMakeLists.txt). */
+#if defined(DEBUG) && !defined(STRING_ART_HEADLESS)
+#define STRING_ART_DISPLAY 1
+#else
+#define STRING_ART_DISPLAY 0
+#endif
 #define cimg_use_png 1
 #include <coord.hpp>
 #include <CImg.h>
 #include <line.hpp>
+#if STRING_ART_DISPLAY
 #include <display_manager.hpp>
 #include <ascii_info.hpp>
+#endif
 #include <image_analysis.hpp>
 #include <image_editing.hpp>
+#include <line_set.hpp>
+#include <pin_layout.hpp>
+#include <pin_score_tree.hpp>
+#include <line_kernels.hpp>
+#include <instrumentation.hpp>
+#include <instruction_writer.hpp>
+#include <checkpoint.hpp>
+#include <pixel_traits.hpp>
 
 #include <map>
+#include <unordered_map>
+#include <algorithm>
 #include <vector>
+#include <memory>
 #include <deque>
 #include <numeric>
 #include <math.h>
@@ -33,6 +56,34 @@ using std::vector;
 using namespace cimg_library;
 using image_editing::draw_line;
 
+/**
+ * @brief One stage of a coarse-to-fine generation (see string_art::generate_coarse_to_fine())
+ */
+struct resolution_stage
+{
+    /** @brief Size of the stage's image, as a ratio of the full image size. Less than 1. */
+    float scale;
+    /** @brief Steps of the path at the end of the stage, as a ratio of the full path's steps */
+    float until;
+};
+
+/**
+ * @brief When generate() stops before the last step (see string_art::set_stop_criteria())
+ * @details Each criterion is off at 0. Generation stops at the first one that's met.
+ */
+struct stop_criteria
+{
+    /** @brief Stop once the tracked error fell by less than this ratio over the last plateau_steps steps */
+    float plateau_ratio = 0;
+    /** @brief Steps the plateau is measured over */
+    short plateau_steps = 500;
+    /** @brief Stop once the best step scores less than this, in grey levels (the score of the whole lookahead path at
+     *  score depths above 1). The step isn't taken. */
+    float min_score = 0;
+    /** @brief Stop after this many seconds of generation */
+    float time_budget = 0;
+};
+
 /**
  * @brief Calculates a strings-around-pegs representation of an image.
  *
@@ -42,8 +93,17 @@ using image_editing::draw_line;
 template <typename IMG_TYPE>
 class string_art
 {
+    /** @brief Benchmarks of the private scoring functions (bench/micro_bench.cpp) */
+    friend class string_art_bench;
+    /** @brief Checks of the private scoring state (test/score_test.cpp) */
+    friend class string_art_test;
+    /** @brief Generates the layers step by step, and darkens them with each other's strings */
+    template <typename>
+    friend class color_layers;
     typedef cimg_library::CImg<IMG_TYPE> tcimg;
     typedef cimg_library::CImg<float> fcimg;
+    typedef typename pixel_traits<IMG_TYPE>::coverage_type coverage_type;
+    typedef cimg_library::CImg<coverage_type> ccimg;
     typedef coord<short> scoord;
 
 public:
@@ -53,7 +113,7 @@ public:
      * @param _image_file Filename of the input image
      * @param _resolution Resized width of the input image
      * @param _pin_count Number of pins to generate
-     * @param _pin_radius Radius of the pin circle. A ratio of the image radius
+     * @param _layout Shape of the frame the pins are placed on (see pin_layout). A float is a circle of that radius.
      * @param _mclearin_separation Minimum pin difference between string connections
      * @param _score_method Method for scoring the lines
      * - 0: Line darkening
@@ -61,29 +121,267 @@ public:
      * - 2: Root mean square error / darkening
      * @param _score_modifier Only used for score_method = 1. 1 = no darkening, 0 = 100% darkening
      * @param _score_depth Number of steps to look ahead when finding the next best pin
+     * @param _raster_encoding Storage format of the cached line pixels (line_raster::delta uses about half the memory)
+     * @param _show_display Open the debug display (ignored in headless builds). Without it, generation doesn't use a display thread.
+     */
+    string_art(const char *_image_file, const short _resolution, const short _pin_count, const pin_layout &_layout, short _min_separation = 1, u_char _score_method = 0, float _score_modifier = 0, const short _score_depth = 1, const float localsize_weight = 0, const float neighbor_weight = 0.f, const line_raster::encoding _raster_encoding = line_raster::absolute, const bool _show_display = true);
+
+    /**
+     * @brief Construct a new string art object from an already loaded image and line set
+     * @details Lets several objects share the resized image and the lines (see make_rgb_image() and make_lines()).
+     *          The other parameters are the same as above.
+     * @param _rgb_image Resized input image
+     * @param _lines Pins and lines, built for the size of _rgb_image
+     * @param _show_display Open the debug display (ignored in headless builds)
+     * @param _show_progress Print progress
      */
-    string_art(const char *_image_file, const short _resolution, const short _pin_count, float _pin_radius, short _min_separation = 1, u_char _score_method = 0, float _score_modifier = 0, const short _score_depth = 1, const float localsize_weight = 0, const float neighbor_weight = 0.f);
+    string_art(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, const pin_layout &_layout, u_char _score_method = 0, float _score_modifier = 0, const short _score_depth = 1, const float localsize_weight = 0, const float neighbor_weight = 0.f, const bool _show_display = true, const bool _show_progress = true);
+
+    /**
+     * @brief Construct a new string art object that covers a given darkness map
+     * @details Used instead of make_darkness_image(), e.g. for the layers of color_layers. The other parameters are the
+     *          same as above.
+     * @param _darkness_image Darkness to cover with strings, the size of _rgb_image (0 = white, darkness_max = black)
+     * @throws std::domain_error If _darkness_image isn't the size of _rgb_image
+     */
+    string_art(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, tcimg _darkness_image, const pin_layout &_layout, u_char _score_method = 0, float _score_modifier = 0, const short _score_depth = 1, const float localsize_weight = 0, const float neighbor_weight = 0.f, const bool _show_display = true, const bool _show_progress = true);
+
+    /**
+     * @brief Resume from a checkpoint (see set_checkpoint())
+     * @details The parameters, images, scores and path so far are loaded instead of built, so none of the constructor's
+     *          preprocessing is repeated. The next generate() continues the checkpoint's path. <br>
+     *          The lookahead, update mode, error blur and stop criteria are the ones the checkpoint was made with, and the
+     *          plateau window continues where it was, so the path is the same as an uninterrupted one. The time budget
+     *          starts again with the next generate().
+     * @param _rgb_image Resized input image the checkpoint was made from
+     * @param _lines Lines the checkpoint was made with
+     * @param checkpoint_file Checkpoint to load
+     * @param _show_display Open the debug display (ignored in headless builds)
+     * @param _show_progress Print progress
+     * @throws std::runtime_error If the checkpoint can't be loaded, or doesn't match the image or lines (its pins, or the
+     *         pins its layout places)
+     */
+    string_art(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, const std::string &checkpoint_file, const bool _show_display = true, const bool _show_progress = true);
+
+    /**
+     * @brief Copy the generation state of another string art object
+     * @details The images, scores and score trees are copied. The input images and the line_set are shared, not copied.
+     *          The copy has no display and prints no progress.
+     */
+    string_art(const string_art &other);
+
+    /**
+     * @brief Copy the generation state of another string art object, with different path parameters
+     * @details Same as string_art(const string_art&). The initial scores don't depend on the score modifier or depth,
+     *          so they stay valid for the copy.
+     * @param _score_modifier Score modifier of the copy
+     * @param _score_depth Score depth of the copy
+     */
+    string_art(const string_art &other, const float _score_modifier, const short _score_depth);
 
     ~string_art();
 
     /**
      * @brief Generate the path
-     * @details Should be called after construction to start generation
+     * @details Should be called after construction to start generation.
+     *          Each step is written to the instruction writer (see set_instruction_writer()) as soon as it's chosen.
+     *          After resuming from a checkpoint, the path starts with the checkpoint's steps.
+     * @throws std::domain_error If the resumed path is longer than path_steps
      * @param path_steps Number of steps in the generated path
      * @return A dynamically-allocated array of steps.
      */
     short *generate(const short path_steps);
 
+    /**
+     * @brief Generate the path, and stop early if a stop criterion is met (see set_stop_criteria())
+     * @details Same as generate(const short).
+     * @param path_steps Maximum number of steps in the generated path
+     * @param steps Set to the number of steps generated. Later entries of the returned array are unset.
+     */
+    short *generate(const short path_steps, short &steps);
+
+    /**
+     * @brief Generate several paths in parallel, and keep the best
+     * @details Each run works on its own copy of this object (see string_art(const string_art&)) and starts from a different pin:
+     *          the first from best_pin(), the others from the next-best pins by their best line score.
+     *          The run with the lowest residual_error() wins, and its state replaces this object's state.
+     *          After resuming from a checkpoint, the checkpoint's path is continued by generate() instead.
+     * @param path_steps Number of steps in each generated path
+     * @param runs Number of paths to generate (at most pin_count)
+     * @return A dynamically-allocated array of the winning run's steps. The steps are written to the instruction writer
+     *         (see set_instruction_writer()) once the winner is known.
+     */
+    short *generate_multi(const short path_steps, const short runs);
+
+    /**
+     * @brief Generate the start of the path on downsampled images, and the rest at full resolution
+     * @details Each stage builds a string_art from a downsampled copy of the input image, with the same pins (by
+     *          index), parameters, lookahead, threads and update mode. It continues the previous stage's path (see
+     *          carry_path()) up to its share of the steps. This object then carries the last stage's path, and generates
+     *          the remaining steps with generate(). <br>
+     *          A string covers more of a downsampled image, so each stage darkens by 1 - (1 - score_modifier) x scale
+     *          instead, which takes out the same darkness per string. <br>
+     *          The stages' images and lines are built here unless prepare_stages() built them first. Building them
+     *          costs about as much as the coarse steps save, so prepare them when timing a run or reusing them. <br>
+     *          After resuming from a checkpoint, the checkpoint's path is continued by generate() instead.
+     * @param path_steps Number of steps in the generated path
+     * @param schedule Stages, in order. Their scales and steps must increase.
+     * @return Same as generate(). Every step is written to the instruction writer, but the coarse steps only once the
+     *         last stage is done.
+     * @throws std::domain_error If a stage's scale isn't between 0 and 1, or the stages' steps don't increase
+     */
+    short *generate_coarse_to_fine(const short path_steps, const vector<resolution_stage> &schedule);
+
+    /**
+     * @brief Build the downsampled images and lines of coarse-to-fine stages ahead of generate_coarse_to_fine()
+     * @details Like make_lines() for the full-resolution lines. Stages that are already built are skipped, and copies
+     *          share the built stages (see string_art(const string_art&)).
+     * @param schedule Stages to build (see generate_coarse_to_fine())
+     * @throws std::domain_error If a stage's scale isn't between 0 and 1
+     */
+    void prepare_stages(const vector<resolution_stage> &schedule);
+
+    /**
+     * @brief Continue a path generated with the same pins at another resolution
+     * @details Draws the path's strings into the images, and rescores every line once (cheaper than updating the
+     *          scores after each string). The path's lines score 0. The next generate() continues the path, like a
+     *          checkpoint's path.
+     * @param path Path so far
+     * @param steps Number of steps in path
+     * @throws std::domain_error If the path has a pin or a step that this object has no line for
+     */
+    void carry_path(const short *path, const short steps);
+
+    /**
+     * @brief Darkness not yet covered by strings
+     * @details Mean of the squared darkness_image, in grey levels (so it's comparable between image types). Lower is better.
+     */
+    float residual_error() const;
+
+    /**
+     * @brief residual_error(), kept up to date after each step
+     * @details Updated from the pixels each string darkens, so a step costs O(line length) instead of a pass over the
+     *          image.
+     */
+    float tracked_error() const
+    {
+        return error_sum / darkness_image.size() / (pixel_traits<IMG_TYPE>::darkness_scale * pixel_traits<IMG_TYPE>::darkness_scale);
+    }
+
+    /**
+     * @brief Mean of the squared darkness_image after a box blur (see set_error_blur()), kept up to date after each step
+     * @details Counts darkness left next to a string less than darkness left far from any string, like the eye does at a
+     *          distance. Same units as residual_error(). Equal to tracked_error() if the blur is off.
+     */
+    float tracked_blurred_error() const;
+
+    /**
+     * @brief Track tracked_blurred_error() with a box blur
+     * @details Each step then costs O(line length x (2 radius + 1)^2).
+     * @param radius Radius of the box blur, in pixels (0 = off)
+     */
+    void set_error_blur(const short radius);
+
+    /**
+     * @brief Stop generate() early (see stop_criteria)
+     * @details The plateau is measured on tracked_blurred_error(). The runs of generate_multi() and the stages of
+     *          generate_coarse_to_fine() run to the end, and the criteria apply to the steps after them.
+     * @throws std::domain_error If a criterion is negative, or plateau_steps is below 1
+     */
+    void set_stop_criteria(const stop_criteria &criteria);
+
+    /** @brief Number of steps of the last generated path */
+    short generated_steps() const
+    {
+        return last_path.size();
+    }
+
+    /**
+     * @brief Write the last generated path as CSV (see instruction_writer)
+     * @param instruction_file Filename of the CSV file
+     * @return False if nothing was generated yet, or the file couldn't be written
+     */
     bool write_to_csv(const char *instruction_file);
 
+    /**
+     * @brief Stream the generated path to a file while it's generated
+     * @details The writer isn't owned, and must outlive generation. Copies don't write to it.
+     * @param _writer Writer to add every step to (nullptr = none)
+     */
+    void set_instruction_writer(instruction_writer *_writer);
+
+    /** @brief Image size, pins and parameters, for instruction files */
+    instruction_header instruction_info() const;
+
+    /**
+     * @brief Save the generation state to a file while generating
+     * @details Every interval steps, the state is copied and saved by a background thread (see checkpoint_writer), so
+     *          the step loop only waits for the copy. The end of generate() and generate_multi() saves a final
+     *          checkpoint and waits for it. generate_multi() only checkpoints the winning run, once it's done. <br>
+     *          Resume with string_art(std::shared_ptr<const tcimg>, std::shared_ptr<const line_set>, const std::string&, const bool, const bool).
+     * @param checkpoint_file File to save to (empty = no checkpoints)
+     * @param interval Steps between checkpoints
+     */
+    void set_checkpoint(const std::string &checkpoint_file, const short interval = 500);
+
     bool save_string_image(const char *image_file, bool append_debug_info = false);
 
     void debug_show_all_connections();
 
+    /**
+     * @brief Set the size of the lookahead search (only used when the score depth is above 1)
+     * @param _beam_width Number of partial paths kept at each lookahead step
+     * @param _beam_candidates Number of lines expanded from the end of each partial path
+     */
+    void set_lookahead(const short _beam_width, const short _beam_candidates);
+
+    /**
+     * @brief Defer re-ranking rescored lines until they're candidates for the next step
+     * @details Drawing a string only ever lowers the scores of the lines it crosses, so the score a line has in the score
+     *          trees is an upper bound of its current score. With lazy updates, update_scores() rescores the crossed lines
+     *          in one pass over the pixel index (no overlap lists, no sorting) and only flags them as stale in the trees.
+     *          A stale line is re-ranked when it reaches the top of its pin's tree (or the beam search's candidates),
+     *          and the search repeats until the top lines are up to date. <br>
+     *          Scores are computed with the same arithmetic as the eager updates, so the paths are identical.
+     *          Lazy updates run on one thread.
+     * @param on Use lazy updates. Turning them off re-ranks every stale line.
+     * @throws std::domain_error If turned on with a score method other than 0, or a score modifier above 1
+     */
+    void set_lazy_updates(const bool on);
+
+    /**
+     * @brief Set the number of threads used to score lines
+     * @details Defaults to omp_get_max_threads(), which follows OMP_NUM_THREADS.
+     */
+    void set_threads(const short _thread_count);
+
+    /**
+     * @brief Load and resize an input image
+     * @param image_file Filename of the input image
+     * @param resolution Resized width of the input image
+     */
+    static tcimg make_rgb_image(const char *image_file, short resolution);
+
+    /**
+     * @brief Place pins on an image, and build the lines between them
+     * @details Pins whose chord runs along a straight side of the frame get no line (see pin_layout::border_pairs()).
+     * @param rgb_image Image the lines are drawn on
+     * @param layout Shape of the frame the pins are placed on (see pin_layout)
+     * @param pin_count Number of pins to generate. Ignored by custom layouts.
+     * @param min_separation Minimum pin difference between string connections
+     * @param raster_encoding Storage format of the cached line pixels
+     * @param show_progress Print progress
+     */
+    static std::shared_ptr<const line_set> make_lines(const tcimg &rgb_image, const pin_layout &layout, const short pin_count, const short min_separation, const line_raster::encoding raster_encoding = line_raster::absolute, const bool show_progress = true);
+
 private:
-    #ifdef DEBUG
+    /** @brief Delegated to by the image file constructor, so the loaded image can be used to build the lines */
+    string_art(std::shared_ptr<const tcimg> _rgb_image, const pin_layout &_layout, const short _pin_count, short _min_separation, u_char _score_method, float _score_modifier, const short _score_depth, const float localsize_weight, const float neighbor_weight, const line_raster::encoding _raster_encoding, const bool _show_display);
+
+    #if STRING_ART_DISPLAY
         ascii_info ai;
-        display_manager<IMG_TYPE> dm;
+        /** @brief Debug display. Only the original object has one (copies leave it empty).*/
+        std::unique_ptr<display_manager<IMG_TYPE>> dm;
 
         const IMG_TYPE red[3]{255, 0, 0};
         const IMG_TYPE green[3]{0, 255, 0};
@@ -96,25 +394,36 @@ private:
         bool step_manual = false; //t
     #endif
 
-    /** @brief Re-sized image from the input filepath */
-    const tcimg rgb_image;
-    /** @brief Same image as rgb_image in Lab color space */
-    tcimg lab_image;
-    /** @brief Image darkness map. 0 = white, 10000 = black */
+    /** @brief Print progress while generating. Off for copies.*/
+    bool show_progress = true;
+
+    /** @brief Re-sized image from the input filepath (shared between copies) */
+    std::shared_ptr<const tcimg> rgb_image;
+    /** @brief Same image as rgb_image in Lab color space (shared between copies) */
+    std::shared_ptr<const tcimg> lab_image;
+    /** @brief Darkness of a black pixel in darkness_image and line_scores (see pixel_traits)*/
+    static constexpr float darkness_max = SCORE_RESOLUTION * pixel_traits<IMG_TYPE>::darkness_scale;
+    /** @brief Image darkness map. 0 = white, darkness_max = black */
     tcimg darkness_image;
 
-    CImgList<u_short> slices;
     /** @brief Visual representation of the chosen string path */
+    ccimg string_image;
+    /** @brief Pixels of string_image changed by the last step, and their previous values (see update_scores())*/
+    pixel_delta<coverage_type> string_delta;
 
-    tcimg string_image;
-    /** @brief Copy of string_image, one step behind.*/
-    tcimg old_string_image;
-
-    /** @brief A map of the size of dark regions*/
-    CImg<IMG_TYPE> region_size_map;
+    /** @brief A map of the size of dark regions (shared between copies). Only built when wg_localsize isn't 0.
+     * @details Only displayed and checkpointed: no score uses it yet.
+     */
+    std::shared_ptr<const tcimg> region_size_map;
+    /** @brief Pins, lines, line rasters and the pixel-to-line index (shared between copies)*/
+    std::shared_ptr<const line_set> lines;
+    /** @brief Downsampled image and lines of each coarse-to-fine stage, by scale (see prepare_stages(), shared between copies)*/
+    map<float, std::pair<std::shared_ptr<const tcimg>, std::shared_ptr<const line_set>>> stages;
     /** @brief Number of pins */
     const short pin_count;
-    /** @brief Coordinates of the generated pins
+    /** @brief Shape of the frame the pins are placed on (saved in checkpoints, with a custom layout's points)*/
+    const pin_layout layout;
+    /** @brief Coordinates of the generated pins (points into lines)
      * @details In image space (e.g. in a 256x556 image, (254,254) corresponds to the top right corner).
      */
     const scoord *pins;
@@ -122,44 +431,238 @@ private:
     const u_char score_method;
     /** @brief Darkening modifier when score_method == 0 (see constructor)*/
     const float score_modifier;
+    /** @brief Multiplies by score_modifier, rounded like the darkened pixels of darkness_image (see darken_pixel())*/
+    const image_editing::pixel_multiplier<IMG_TYPE> darkening;
     /** @brief Number of steps to look ahead when finding the next best pin */
     const short score_depth;
+    /** @brief Number of partial paths kept at each lookahead step (see beam_search())*/
+    short beam_width = 8;
+    /** @brief Number of lines expanded from the end of each partial path (see beam_search())*/
+    short beam_candidates = 8;
+    /** @brief Threads used by score_all_lines() and update_scores() (see set_threads())*/
+    short thread_count = omp_get_max_threads();
     /** @brief Total number of possible connections */
-    int line_count;
+    const int line_count;
     /** @brief Weight given to a pixel's local region size (prioritizing small dark regions)*/
     const float wg_localsize;
     /** @brief Weight given to the pixels to the left and right of each scored point*/
     const float wg_neighbor;
 
-    /** @brief The current score of each line
-     *  @details This doesn't have a calculated order, so each element is mapped to by line_scores_by_pin.
+    /** @brief Every allowed connection (points into lines)
+     * @details Each (x,y) pair corresponds to a pair of pins that may have a string drawn between them.
      */
-    IMG_TYPE *line_scores;
-    /** @brief A map of all line scores with pins as indices
-     * @details Each element is a pointer to an element of line_scores. <br>
-     * Each element is double-represented at [a][b] and [b][a], to avoid the need for swapping min/max values.
+    const scoord *line_pairs;
+    /** @brief Pixels covered by each line, in the same order as line_pairs
+     * @details Every per-line pixel walk reads from here instead of re-rasterizing.
      */
-    map<short, map<short, IMG_TYPE *>> line_scores_by_pin;
-    /** @brief Every allowed connection
-     * @details Each (x,y) pair corresponds to a pair of pins that may have a string drawn between them.
+    const line_raster &raster;
+    /** @brief Lines covering each pixel of raster
+     * @details Used by update_scores() to find the lines that share pixels with a new string.
+     */
+    const pixel_line_index &pixel_index;
+    /** @brief The current score of each line, in the same order as line_pairs */
+    vector<IMG_TYPE> line_scores;
+    /** @brief Weighted length of each line (only pixels in mask are counted), in the same order as line_pairs*/
+    vector<float> line_lengths;
+    /** @brief Darkness summed over the counted pixels of each line, in the same order as line_pairs
+     *  @details line_scores is this over line_lengths, rounded to IMG_TYPE. Updates start from the total rather than the
+     *           rounded score, so integer scores don't lose their fraction at every update.
      */
-    scoord *line_pairs;
-    /** @brief Map of weighted line lengths (only pixels in mask are counted)*/
-    map<short, map<short, float>> line_lengths;
+    vector<float> line_totals;
+    /** @brief Non-zero for lines removed by cull_line(), in the same order as line_pairs*/
+    vector<char> culled;
+    /** @brief Pixels shared with the most recently drawn line. Re-used between steps to avoid re-allocation.*/
+    line_overlaps overlaps;
+    /** @brief Re-rank lines only when they're candidates (see set_lazy_updates())*/
+    bool lazy_updates = false;
+    /** @brief Non-zero for lines whose score in score_tree is higher than line_scores (lazy updates only)*/
+    vector<char> stale;
+    /** @brief Last rescore_crossed() call that touched each line */
+    vector<int> rescore_stamps;
+    /** @brief Number of rescore_crossed() calls */
+    int rescore_count = 0;
+    /** @brief Lines touched by the last rescore_crossed() call */
+    vector<int> rescored_lines;
+    /** @brief Steps of the last generated path (see write_to_csv())*/
+    vector<short> last_path;
+    /** @brief Written to while generating (see set_instruction_writer()). Not copied.*/
+    instruction_writer *writer = nullptr;
+    /** @brief Saves checkpoints in the background (see set_checkpoint()). Not copied.*/
+    std::unique_ptr<checkpoint_writer<IMG_TYPE>> checkpointer;
+    /** @brief Steps between checkpoints */
+    short checkpoint_interval = 0;
+    /** @brief Path loaded from a checkpoint, continued by the next generate()*/
+    vector<short> resumed_path;
+    /** @brief Stops generate() early (see set_stop_criteria()). Not copied.*/
+    stop_criteria stop;
+    /** @brief Step that started the current plateau window of stop (see run_steps())*/
+    short plateau_start = 0;
+    /** @brief tracked_blurred_error() at plateau_start */
+    float plateau_error = 0;
+    /** @brief The next run_steps() continues the plateau window loaded from a checkpoint */
+    bool resumed_plateau = false;
+    /** @brief Pixels of darkness_image changed by the last step, and their previous values (see track_error())*/
+    pixel_delta<IMG_TYPE> darkness_delta;
+    /** @brief Sum of the squared darkness_image (see tracked_error())*/
+    double error_sum = 0;
+    /** @brief Radius of the box blur of tracked_blurred_error() (0 = off)*/
+    short error_blur = 0;
+    /** @brief darkness_image after the box blur (empty if it's off)*/
+    fcimg blurred_darkness;
+    /** @brief Sum of the squared blurred_darkness */
+    double blurred_error_sum = 0;
+    /** @brief Line scores ordered per pin, for O(1) lookup of the best line from any pin
+     * @details Kept in sync with line_scores by set_line_score() and cull_line().
+     */
+    pin_score_tree<IMG_TYPE> score_tree;
 
-    /** @brief Make the containers for lines and their scores.
-     * @param min_separation Minimum difference between pins in a line
+    /**
+     * @brief Index of the line between two pins
+     * @return Index into line_scores, line_pairs and line_lengths, or pin_pair_index::none if the pair has no line
+     * @note Culled lines keep their index. See has_line().
      */
-    void build_lines(short min_separation);
+    int line_index(const short pin_a, const short pin_b) const
+    {
+        return lines->line_index(pin_a, pin_b);
+    }
+
+    /** @brief Test whether two pins have a line that hasn't been culled */
+    bool has_line(const short pin_a, const short pin_b) const
+    {
+        const int l = line_index(pin_a, pin_b);
+        return (l != pin_pair_index::none) && !culled[l];
+    }
+
+    /** @brief Score of the best line from a pin, or 0 if it has none */
+    IMG_TYPE root_score(const short pin) const
+    {
+        return (score_tree.best(pin) == pin_score_tree<IMG_TYPE>::none) ? 0 : score_tree.best_score(pin);
+    }
 
     /**
-     * @brief Create a vector of all line combinations that overlap the given line
-     * @details Each coordinate in the vector corresponds to a pin-pair.
-     * @param pin_a Pin A of the overlapping line
-     * @param pin_b Pin B of the overlapping line
-     * @return vector<scoord>
+     * @brief Current score of the line between two pins
+     * @warning The pair must have a line (see line_index())
      */
-    vector<scoord> overlapping_lines(short pin_a, short pin_b);
+    const IMG_TYPE &score_of(const short pin_a, const short pin_b) const
+    {
+        return line_scores[line_index(pin_a, pin_b)];
+    }
+
+    /**
+     * @brief Set the score of a line in line_scores and score_tree
+     * @warning Not thread-safe: lines that share a pin share a tree.
+     */
+    void set_line_score(const int line_index, const IMG_TYPE score)
+    {
+        line_scores[line_index] = score;
+        score_tree.set_pair(line_pairs[line_index].x, line_pairs[line_index].y, score);
+    }
+
+    /**
+     * @brief Pixels of a line
+     * @param buffer Holds the decoded pixels if the raster isn't stored as absolute indices
+     * @return raster.size(line) pixel indices, in ascending order
+     */
+    const uint32_t *line_pixels(const int line, vector<uint32_t> &buffer) const
+    {
+        const uint32_t *pixels = raster.data(line);
+        if (pixels != nullptr)
+            return pixels;
+        raster.decode(line, buffer);
+        return buffer.data();
+    }
+
+    /**
+     * @brief Remove part of one pixel's darkness from a line's total score
+     * @details Shared by update_score() and rescore_crossed(), so eager and lazy updates round the same way. The pixel
+     *          is darkened with the rounding of image_editing::multiply_line(), so the total stays the sum of the line's
+     *          darkness.
+     */
+    float darken_pixel(float total_score, const IMG_TYPE darkness) const
+    {
+        if (darkness > 0.01f)
+        {
+            total_score -= darkness;
+            total_score += darkening(darkness);
+        }
+        return total_score;
+    }
+
+    /**
+     * @brief A line's updated score, as stored in line_scores
+     * @details With a score modifier of at most 1 a score can only fall, but dividing by the line length can round it up.
+     *          Clamping it keeps old scores valid upper bounds for lazy updates.
+     */
+    IMG_TYPE updated_score(const int line, const float new_score) const
+    {
+        const IMG_TYPE score = (IMG_TYPE)new_score;
+        return (score_modifier <= 1 && score > line_scores[line]) ? line_scores[line] : score;
+    }
+
+    /**
+     * @brief Rescore every line that shares pixels with a new string, and flag it as stale (lazy updates only)
+     * @details Must be called before the darkness under the string changes.
+     */
+    void rescore_crossed(const int drawn_line);
+
+    /**
+     * @brief Put a stale line's current score in the score trees
+     * @return False if the line wasn't stale
+     */
+    bool refresh_rank(const int line)
+    {
+        if (!stale[line])
+            return false;
+        stale[line] = 0;
+        score_tree.set_pair(line_pairs[line].x, line_pairs[line].y, line_scores[line]);
+        return true;
+    }
+
+    /** @brief Re-rank the best line from a pin until it's up to date (lazy updates only)*/
+    void refresh_best(const short pin);
+
+    /**
+     * @brief The best beam_candidates destinations from a pin, with up-to-date scores
+     * @param out Cleared, then filled with the destination pins, best first
+     */
+    void top_candidates(const short pin, vector<short> &out);
+
+    /** @brief Delegated to by the checkpoint constructor, so the loaded parameters can initialize the const members */
+    string_art(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, checkpoint<IMG_TYPE> &&saved, const bool _show_display, const bool _show_progress);
+
+    /** @brief Add the images to the debug display, and pause it until the user starts generation */
+    void attach_display();
+
+    /**
+     * @brief Steps of the path generation loop
+     * @param path Path to fill. path[0] to path[first_step - 1] must already be set.
+     * @param path_steps Number of steps in the path
+     * @param first_step First step to fill
+     * @return Number of steps in the path when it stopped: path_steps, or fewer if a stop criterion was met
+     */
+    short run_steps(short *path, const short path_steps, const short first_step = 1);
+
+    /** @brief Recalculate the tracked errors from the whole darkness_image */
+    void reset_error();
+
+    /** @brief Update the tracked errors from darkness_delta */
+    void track_error();
+
+    /**
+     * @brief Copy the generation state
+     * @param path Path so far
+     * @param steps Number of steps in path
+     */
+    std::unique_ptr<checkpoint<IMG_TYPE>> make_checkpoint(const short *path, const short steps) const;
+
+    /** @brief Save a checkpoint of a finished path and wait for it, if checkpoints are on */
+    void save_final_checkpoint(const short *path, const short steps);
+
+    /**
+     * @brief Replace this object's generation state with another's
+     * @param other Object to take the state from. Must share this object's line_set.
+     */
+    void adopt_state(string_art &other);
 
     /**
      * @brief Calculate initial scores for all possible connections
@@ -171,28 +674,42 @@ private:
     /**
      * @brief Update the scores of lines that overlap pin_a->pin_b
      * @details This updates the scores originally calculated by score_all_lines(),
-     *          except it's much faster because it only operates near the pixels that intersect with pin_a->pin_b
+     *          except it's much faster because it only visits lines that share pixels with pin_a->pin_b (found through pixel_index).
      * @param pin_a Pin A of the overlapping line
      * @param pin_b Pin B of the overlapping line
      */
     void update_scores(const short pin_a,const  short pin_b);
 
+    /**
+     * @brief Update the scores of the lines that share pixels with a line, then darken it
+     * @details The part of update_scores() after the string is drawn. string_delta must hold the string's changes to
+     *          string_image.
+     */
+    void darken_line(const int drawn_line);
+
+    /**
+     * @brief Darken a line covered by a string of another layer (see color_layers)
+     * @details Same as update_scores(), except that nothing is drawn into string_image, and the line isn't scored 0.
+     *          Its score is updated for its own darkened pixels like the scores of the lines it crosses, and put straight
+     *          into the score trees.
+     */
+    void cover_line(const int covered_line);
+
     /**
      * @brief Update the score of a line
-     * @details Re-calculates a line's score using its existing score, and changes to the changed (intersecting) region.
-     * @param scored_a Pin A of the line to score
-     * @param scored_b Pin B of the line to score
-     * @param overlap_a Pin A of the overlapping line
-     * @param overlap_b Pin B of the overlapping line
-     * @param old_string_image String image before the overlapping line is added
-     * @param new_string_image String image after the overlapping line is added
+     * @details Re-calculates a line's score using its existing score, and changes to the pixels it shares with the new string.
+     * @param scored_line_index Index of the line to score
+     * @param shared_pixels Pixels the line shares with the new string
+     * @param shared_count Number of shared pixels
+     * @param string_delta Pixels the new string changed in string_image, and their previous values.
+     *        string_image already has the new string. Not needed by line darkening.
      * @return IMG_TYPE Updated score
      */
-    IMG_TYPE update_score(const int scored_line_index, const short overlap_a, const short overlap_b, tcimg &old_string_image, tcimg &new_string_image);
+    IMG_TYPE update_score(const int scored_line_index, const uint32_t *shared_pixels, const size_t shared_count, [[maybe_unused]] const pixel_delta<coverage_type> &string_delta);
 
     /**
      * @brief Score the given line
-     * @details Behavior depends on score_method.
+     * @details Behavior depends on score_method. Line darkening uses line_kernels::masked_sum(). Safe to call for different lines in parallel.
      * @param pin_a Pin A of connection
      * @param pin_b Pin B of connection         * @return IMG_TYPE Score
      */
@@ -204,9 +721,10 @@ private:
      *          The area scored is the 3x3 square that contains all three coordinates, with line_coords[1] at the center.
      * @param string_image_ref #Image to score against
      * @param line_coords Three-pixel segment of a potential line
+     * @param undo If given, string_image_ref is scored as it was before this edit (see update_score())
      * @return IMG_TYPE Score
      */
-    IMG_TYPE score_square(const tcimg &string_image_ref, std::deque<scoord> &line_coords);
+    IMG_TYPE score_square(const ccimg &string_image_ref, std::deque<scoord> &line_coords, const pixel_delta<coverage_type> *undo = nullptr);
 
     /**
      * @brief Remove a line from the list
@@ -224,48 +742,63 @@ private:
 
     /**
      * @brief Find the highest-scoring path from from_pin
-     * @details Wrapper for best_score_for(short from_pin, IMG_TYPE& score, short depth). Performs a recursive sum of future steps, without re-calculating scores.
-     * @warning Performance is proportinal to \f$\textrm{pin_count}^\textrm{depth}\f$. Extremely slow after about depth = 3.
+     * @details With depth = 1 this reads the root of from_pin's score tree. Deeper searches use beam_search().
      * @param from_pin First pin in the connection
-     * @param score Reference to the returned line's score
-     * @param depth Depth of the recursive search
+     * @param score Reference to the returned path's score
+     * @param depth Number of steps to look ahead
      * @return short Best pin to move to
      */
     short best_pin_for(short from_pin, IMG_TYPE &score, short depth = 1);
 
     /**
-     * @brief Recursively search for best-scoring combination of steps
-     * @details Performs a recursive sum of future steps, without re-calculating scores. Beware: The number of operation is \f$\textrm{pin_count}^\textrm{depth}\f$, so it gets very big very quickly.
-     * @param from_pin First pin in the connection
-     * @param depth Depth of the recursive search
-     * @param to_pin Reference to the returned score's line
-     * @param visited A list of points in the current recursive path (used to avoid loops)
-     * @return IMG_TYPE Best score
+     * @brief First pin after from_pin (in index order) that has a line to from_pin
+     * @details Fallback for when no line from from_pin has a positive score.
      */
-    IMG_TYPE best_score_for(short from_pin, short depth, short &to_pin, vector<short> &visited);
+    short nearest_connected_pin(short from_pin) const;
 
-    std::string ASCII_line(const short from_pin, const short to_pin, const short resolution);
+    /**
+     * @brief Beam search for the best-scoring sequence of future steps
+     * @details At each of \c depth levels, the beam_candidates best lines from the end of each partial path are tried,
+     *          and the beam_width best paths are kept. A path never returns to a pin it has already visited. <br>
+     *          Each line's score is reduced by the darkening of the pixels it shares with the earlier lines of its path (see lookahead_score()).
+     *          The cost is about \f$\textrm{depth} \times \textrm{beam\_width} \times \textrm{beam\_candidates}\f$ score reads.
+     * @param from_pin First pin in the connection
+     * @param depth Number of steps to look ahead
+     * @param to_pin Reference to the first step of the best path
+     * @return IMG_TYPE Total score of the best path
+     */
+    IMG_TYPE beam_search(short from_pin, short depth, short &to_pin);
 
-    CImg<IMG_TYPE> make_region_size_map();
+    /**
+     * @brief Estimated score of a line, if the lines of path_lines were drawn first
+     * @param line Line to score
+     * @param path_lines Lines drawn earlier in the lookahead path
+     */
+    float lookahead_score(const int line, const vector<int> &path_lines);
 
-    CImgList<u_short> map_lines_to_slices();
+    /**
+     * @brief Drop in a line's (length-weighted) score after another line is drawn
+     * @details Tables are built from pixel_index on first use, and reset at the start of each beam_search().
+     * @param drawn_line Line drawn earlier in the lookahead path
+     * @param line Line whose score drops
+     */
+    float lookahead_loss(const int drawn_line, const int line);
 
-   // CImg<float> make_
+    /** @brief For each line drawn during the current lookahead, the (line, score loss) of every line it overlaps, sorted by line */
+    std::unordered_map<int, vector<pair<int, float>>> lookahead_losses;
+    /** @brief Working space for lookahead_loss() */
+    line_overlaps lookahead_overlaps;
 
-    static scoord *circular_pins(const tcimg &image, float radius, short pin_count);
+    std::string ASCII_line(const short from_pin, const short to_pin, const short resolution);
 
-    /**
-     * @brief Calculate the number of possible connections
-     * @param pin_count Number of pins
-     * @param pin_separation Minimum difference between pins in connection
-     * @return short Number of connections
-     */
-    static int calculate_line_count(int pin_count, int min_separation);
+    CImg<IMG_TYPE> make_region_size_map();
 
-    static tcimg make_rgb_image(const char *image_file, short resolution);
+   // CImg<float> make_
 
-    static tcimg make_darkness_image(const tcimg &rgb_image, const float radius);
+    /** @brief Darkness of an image inside the frame, from 0 to darkness_max. Prints its range if show_progress is set.*/
+    static tcimg make_darkness_image(const tcimg &rgb_image, const pin_layout &layout, const bool show_progress = true);
 
-    void weight_darkness_image();
+    /** @brief 1 inside the frame (and, for images with an alpha channel, where it's opaque), 0 elsewhere (see pin_layout::mask())*/
+    static tcimg make_mask(const tcimg &rgb_image, const pin_layout &layout);
 };
 #endif
@@ -0,0 +1,143 @@
+/**
+ * @file sweep_runner.hpp
+ * @brief Runs a list of string art jobs, sharing the preprocessing between them
+ */
+#ifndef SWEEP_RUNNER_H
+#define SWEEP_RUNNER_H
+#include <string_art.hpp>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <tuple>
+using std::vector;
+
+/**
+ * @brief Parameters of one generated image
+ * @details Defaults match the string_art constructor.
+ */
+struct sweep_job
+{
+    /** @brief Filename of the input image */
+    std::string image_file;
+    /** @brief Filename of the output image. Built from the parameters if empty (see output_name()).*/
+    std::string output_file;
+    short resolution = 1024;
+    short pin_count = 250;
+    float pin_radius = 0.95f;
+    /** @brief Shape of the frame: "circle", "ellipse", "rectangle" or a pin file (see pin_layout::parse()). pin_radius is its size.*/
+    std::string layout = "circle";
+    short min_separation = 1;
+    u_char score_method = 0;
+    float score_modifier = 0;
+    short score_depth = 1;
+    float localsize_weight = 0;
+    float neighbor_weight = 0;
+    /** @brief Number of steps in the generated path */
+    short steps = 8000;
+    /** @brief Paths generated per job (see string_art::generate_multi()). 1 = string_art::generate().*/
+    short runs = 1;
+    /** @brief Use lazy score updates (see string_art::set_lazy_updates()). Same paths, only faster.*/
+    bool lazy = false;
+    /** @brief Format of the instruction file streamed next to the output image: "csv", "binary", or empty for none
+     *  (see instruction_writer)*/
+    std::string instructions;
+    /** @brief Coarse-to-fine stages (see string_art::generate_coarse_to_fine()). Empty = every step at full resolution.*/
+    vector<resolution_stage> schedule;
+    /** @brief When to stop before the last step (see string_art::set_stop_criteria())*/
+    stop_criteria stop;
+    /** @brief Blur radius of the error the plateau is measured on (see string_art::set_error_blur())*/
+    short error_blur = 0;
+
+    /**
+     * @brief Output filename: the input filename without its extension, followed by the parameters
+     * @details Has every parameter a sweep can vary, except the instruction format. Parameters that are usually left at
+     *          their defaults (runs, lazy, stop criteria, error blur) are only added when they're set.
+     */
+    std::string output_name() const;
+};
+
+/**
+ * @brief Runs a list of sweep_jobs
+ * @details Each preprocessing stage is cached by the parameters it depends on:
+ *          - Resized image: image file, resolution
+ *          - Pins and lines: image size, pin count, pin radius, layout, min separation
+ *          - Darkness map, region map and initial line scores: all of the above, plus score method and weights
+ *          - Coarse-to-fine stages: the scored object, plus the stage scale
+ *
+ *          Jobs that only differ in score modifier, score depth, steps, runs, lazy or schedule start from a copy of the same
+ *          scored string_art. Independent jobs run concurrently, up to the thread budget.
+ * @tparam IMG_TYPE Image type of the string_art objects
+ */
+template <typename IMG_TYPE>
+class sweep_runner
+{
+public:
+    /**
+     * @brief Constructor
+     * @param _thread_budget Maximum number of jobs (or preprocessing stages) running at once
+     * @param _instrumentation_file JSON-lines file that run() appends its timings to (empty = none)
+     */
+    sweep_runner(const short _thread_budget, const std::string &_instrumentation_file = "instrumentation.jsonl");
+
+    /**
+     * @brief Read a job list from a file
+     * @details One job per line, as whitespace-separated key=value pairs. Lines starting with '#' are ignored. <br>
+     *          A value may be a comma-separated list, in which case the line is expanded into one job per combination. <br>
+     *          A line starting with "default" sets the values of every following job, unless the job overrides them. <br>
+     *          Keys: image, output, resolution, pins, radius, layout (circle, ellipse, rectangle or a pin file), separation, method, modifier, depth, wg_localsize,
+     *          wg_neighbor, steps, runs, lazy (0 or 1), instructions (csv, binary or none),
+     *          schedule (scale:until stages separated by '/', or none), plateau, plateau_steps, min_score, budget (seconds),
+     *          error_blur. <br>
+     *          Example: <br>
+     *          <tt>default resolution=1024 pins=250 separation=10 depth=2 steps=8000</tt> <br>
+     *          <tt>image=images/vg2_hr.png modifier=0.5,0.6,0.7,0.8,0.9</tt> <br>
+     *          <tt>image=images/vg2_hr.png schedule=none,0.25:0.5/0.5:0.75</tt>
+     * @param config_file Filename of the job list
+     * @throws std::invalid_argument If a line can't be parsed, or a job can't run (e.g. its image or pin file can't be
+     *         opened, or it asks for lazy updates with a score method other than 0)
+     */
+    static vector<sweep_job> read_jobs(const char *config_file);
+
+    /**
+     * @brief Run every job, and save its string image
+     * @details Appends one line of instrumentation for the preprocessing, and one per job (see instrumentation.hpp).
+     *          A job's line only has the time spent on its own thread. <br>
+     *          A job that throws is reported on std::cerr and skipped, and so are the jobs that share a failed
+     *          preprocessing stage with it. The other jobs still run.
+     * @param jobs Jobs to run
+     * @throws std::invalid_argument If two jobs have the same output file (e.g. they only differ in instruction format)
+     */
+    void run(const vector<sweep_job> &jobs);
+
+private:
+    typedef cimg_library::CImg<IMG_TYPE> tcimg;
+    typedef std::tuple<std::string, short> image_key;
+    typedef std::tuple<int, int, short, float, std::string, short> lines_key;
+    typedef std::tuple<std::string, short, short, float, std::string, short, u_char, float, float> scored_key;
+
+    const short thread_budget;
+    const std::string instrumentation_file;
+    /** @brief Resized images */
+    std::map<image_key, std::shared_ptr<const tcimg>> images;
+    /** @brief Pins and lines */
+    std::map<lines_key, std::shared_ptr<const line_set>> line_sets;
+    /** @brief Scored string_art objects, copied by each job */
+    std::map<scored_key, std::unique_ptr<string_art<IMG_TYPE>>> scored;
+
+    static image_key key_of_image(const sweep_job &job);
+    lines_key key_of_lines(const sweep_job &job) const;
+    static scored_key key_of_scored(const sweep_job &job);
+
+    /**
+     * @brief Add the missing entries of a cache
+     * @details The keys are inserted first, so the entries can be built in parallel.
+     * @param keys Key of each job
+     * @param failed Non-zero for the jobs to skip. Set for the jobs whose entry couldn't be built.
+     * @param build Builds an entry from the index of the first job that needs it
+     */
+    template <typename KEY, typename VALUE, typename BUILD>
+    void fill(std::map<KEY, VALUE> &cache, const vector<KEY> &keys, vector<char> &failed, const char *stage, BUILD build);
+};
+
+#endif
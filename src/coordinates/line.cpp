@@ -52,8 +52,8 @@ line<T> line<T>::operator&(const line<T>& other) const
         return line<T>(a, b, image, z, c);
     
     fcoord center((b2 * c1 - b1 * c2) / det, (a1 * c2 - a2 * c1) / det);
-    float angle = acos(dot<float>(b - a,other.b-other.a) / (length * other.length));
-    float overlap_width = 1.f / sin(angle);
+    // 1 / sin(angle), with sin(angle) = |cross product| / (product of lengths). The determinant is the cross product.
+    float overlap_width = length * other.length / std::abs(det);
     fcoord actual_start = center - d * overlap_width / 2;
     fcoord actual_end = center + d * overlap_width / 2;
     fcoord start_offset = actual_start - a;
@@ -0,0 +1,95 @@
+#include <line_raster.hpp>
+#include <algorithm>
+#include <iostream>
+
+line_raster::line_raster(const int _width, const int _height, const scoord *pins, const scoord *line_pairs, const int line_count, const short buffer, const encoding _format, const bool show_progress)
+    : w(_width),
+      h(_height),
+      format(_format)
+{
+    starts.reserve(line_count + 1);
+    pixel_counts.reserve(line_count);
+    vector<uint32_t> line_pixels;
+    for (int i = 0; i < line_count; i++)
+    {
+        line_pixels.clear();
+        if (line_pairs[i].x >= 0 && line_pairs[i].y >= 0)
+        {
+            walk(pins[line_pairs[i].x], pins[line_pairs[i].y], w, buffer, line_pixels);
+            std::sort(line_pixels.begin(), line_pixels.end());
+            line_pixels.erase(std::unique(line_pixels.begin(), line_pixels.end()), line_pixels.end());
+        }
+        pixel_counts.push_back(line_pixels.size());
+        pixel_total += line_pixels.size();
+        if (format == absolute)
+        {
+            pixels.insert(pixels.end(), line_pixels.begin(), line_pixels.end());
+            starts.push_back(pixels.size());
+            continue;
+        }
+        for (size_t p = 0; p < line_pixels.size(); p++)
+        {
+            const uint32_t diff = (p == 0) ? 0 : line_pixels[p] - line_pixels[p - 1];
+            if (p == 0 || diff >= delta_escape)
+            {
+                if (p != 0)
+                    deltas.push_back(delta_escape);
+                deltas.push_back(line_pixels[p] >> 16);
+                deltas.push_back(line_pixels[p] & 0xFFFF);
+            }
+            else
+            {
+                deltas.push_back(diff);
+            }
+        }
+        starts.push_back(deltas.size());
+    }
+    pixels.shrink_to_fit();
+    deltas.shrink_to_fit();
+    if (show_progress)
+        std::cout << "Line raster: " << line_count << " lines, " << pixel_total << " pixels, "
+                  << memory_usage() / (1024.f * 1024.f) << " MB (" << ((format == absolute) ? "absolute" : "delta") << ")\n";
+}
+
+void line_raster::decode(const int line_index, vector<uint32_t> &out) const
+{
+    out.clear();
+    out.reserve(size(line_index));
+    for_each(line_index, [&out](const uint32_t p)
+             { out.push_back(p); });
+}
+
+size_t line_raster::memory_usage() const
+{
+    return starts.capacity() * sizeof(size_t) +
+           pixel_counts.capacity() * sizeof(uint32_t) +
+           pixels.capacity() * sizeof(uint32_t) +
+           deltas.capacity() * sizeof(uint16_t);
+}
+
+void line_raster::walk(const scoord a, const scoord b, const int width, const short buffer, vector<uint32_t> &out)
+{
+    out.clear();
+    for_each_walked(a, b, width, buffer, [&out](const uint32_t p)
+                    { out.push_back(p); });
+}
+
+void line_raster::float_walk(const scoord a, const scoord b, const int width, const short buffer, vector<uint32_t> &out)
+{
+    typedef coord<float> fcoord;
+    out.clear();
+    // Same setup and stepping as coordinates::line<T>, so the cached pixels match the old per-call line walks.
+    const fcoord start = (a.x < b.x) ? a : b;
+    const fcoord end = (a.x < b.x) ? b : a;
+    const float length = coordinates::distance(start, end);
+    if (length == 0)
+        return;
+    const fcoord d = (end - start) / length;
+    const long steps = (long)length + 1 - buffer;
+    fcoord pos = start + d * buffer;
+    for (long i = buffer; i < steps; i++)
+    {
+        out.push_back((uint32_t)pos.y * width + (uint32_t)pos.x);
+        pos += d;
+    }
+}
@@ -0,0 +1,120 @@
+#include <pixel_line_index.hpp>
+#include <algorithm>
+#include <iterator>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+pixel_line_index::pixel_line_index(const line_raster &raster, const short _tile_shift, const bool show_progress)
+    : w(raster.width()),
+      tile_shift(_tile_shift)
+{
+    if (raster.total_pixels() > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("Too many line pixels for a pixel_line_index");
+    const size_t tile_size = (size_t)1 << tile_shift;
+    tiles_x = ((size_t)raster.width() + tile_size - 1) >> tile_shift;
+    const size_t tiles_y = ((size_t)raster.height() + tile_size - 1) >> tile_shift;
+    const size_t tile_count = tiles_x * tiles_y;
+    // Most recent line added to each tile. A line usually crosses a tile in several pixels, but is listed once.
+    vector<int> last_line((tile_shift == 0) ? 0 : tile_count, -1);
+
+    offsets.assign(tile_count + 1, 0);
+    for (int l = 0; l < raster.line_count(); l++)
+    {
+        raster.for_each(l, [&](const uint32_t p)
+        {
+            const size_t t = tile_of(p);
+            if (tile_shift != 0)
+            {
+                if (last_line[t] == l)
+                    return;
+                last_line[t] = l;
+            }
+            offsets[t + 1]++;
+        });
+    }
+    for (size_t t = 0; t < tile_count; t++)
+    {
+        offsets[t + 1] += offsets[t];
+    }
+
+    lines.resize(offsets.back());
+    vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    std::fill(last_line.begin(), last_line.end(), -1);
+    for (int l = 0; l < raster.line_count(); l++)
+    {
+        raster.for_each(l, [&](const uint32_t p)
+        {
+            const size_t t = tile_of(p);
+            if (tile_shift != 0)
+            {
+                if (last_line[t] == l)
+                    return;
+                last_line[t] = l;
+            }
+            lines[next[t]++] = l;
+        });
+    }
+    if (show_progress)
+        std::cout << "Pixel line index: " << tile_count << " tiles of " << tile_size << "x" << tile_size << ", "
+                  << lines.size() << " entries, " << memory_usage() / (1024.f * 1024.f) << " MB\n";
+}
+
+void pixel_line_index::overlaps(const int line_index, const line_raster &raster, line_overlaps &result) const
+{
+    result.clear();
+    if (tile_shift == 0)
+    {
+        // Every (line, pixel) entry in the index is an exact shared pixel.
+        raster.for_each(line_index, [&](const uint32_t p)
+        {
+            for (uint32_t i = offsets[p]; i < offsets[p + 1]; i++)
+            {
+                if (lines[i] != line_index)
+                    result.scratch.emplace_back(lines[i], p);
+            }
+        });
+        std::sort(result.scratch.begin(), result.scratch.end());
+        for (size_t i = 0; i < result.scratch.size(); i++)
+        {
+            if (i == 0 || result.scratch[i].first != result.scratch[i - 1].first)
+            {
+                if (i != 0)
+                    result.starts.push_back(result.pixels.size());
+                result.lines.push_back(result.scratch[i].first);
+            }
+            result.pixels.push_back(result.scratch[i].second);
+        }
+        if (!result.lines.empty())
+            result.starts.push_back(result.pixels.size());
+        return;
+    }
+
+    // Tiles only give candidates. Intersect each candidate's pixels with the queried line's to find what's really shared.
+    vector<int> candidates;
+    raster.for_each(line_index, [&](const uint32_t p)
+    {
+        const size_t t = tile_of(p);
+        candidates.insert(candidates.end(), lines.begin() + offsets[t], lines.begin() + offsets[t + 1]);
+    });
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    vector<uint32_t> line_pixels, candidate_pixels;
+    raster.decode(line_index, line_pixels);
+    for (const int c : candidates)
+    {
+        if (c == line_index)
+            continue;
+        raster.decode(c, candidate_pixels);
+        const size_t old_size = result.pixels.size();
+        std::set_intersection(line_pixels.begin(), line_pixels.end(),
+                              candidate_pixels.begin(), candidate_pixels.end(),
+                              std::back_inserter(result.pixels));
+        if (result.pixels.size() != old_size)
+        {
+            result.lines.push_back(c);
+            result.starts.push_back(result.pixels.size());
+        }
+    }
+}
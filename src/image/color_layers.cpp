@@ -0,0 +1,219 @@
+#include <color_layers.hpp>
+#include <iostream>
+#include <limits>
+#include <omp.h>
+
+template <typename IMG_TYPE>
+color_layers<IMG_TYPE>::color_layers(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, const vector<color> &_palette, const pin_layout &layout,
+                                     const u_char score_method, const float score_modifier, const short score_depth, const bool lazy)
+    : rgb_image(_rgb_image),
+      lines(_lines),
+      palette(_palette)
+{
+    if (palette.empty())
+        throw std::domain_error("Palette has no colors");
+    std::cout << "Splitting the image into " << palette.size() << " colors...\n";
+    targets = make_targets(*rgb_image, palette, layout);
+
+    // Pixels with less darkness than this don't make two layers interact
+    const IMG_TYPE threshold = string_art<IMG_TYPE>::darkness_max * 0.01f;
+    const short count = layer_count();
+    interacts.assign(count * count, 0);
+    for (short a = 0; a < count; a++)
+    {
+        for (short b = a + 1; b < count; b++)
+        {
+            const IMG_TYPE *target_a = targets[a].data(), *target_b = targets[b].data();
+            bool shared = false;
+            for (size_t p = 0; p < targets[a].size() && !shared; p++)
+                shared = target_a[p] > threshold && target_b[p] > threshold;
+            interacts[a * count + b] = interacts[b * count + a] = shared;
+        }
+    }
+
+    const short threads_per_layer = std::max(1, omp_get_max_threads() / count);
+    for (short c = 0; c < count; c++)
+    {
+        std::cout << "Building layer " << c << " (" << (int)palette[c][0] << ',' << (int)palette[c][1] << ',' << (int)palette[c][2] << ")...\n";
+        layers.emplace_back(new string_art<IMG_TYPE>(rgb_image, lines, targets[c], layout, score_method, score_modifier, score_depth, 0.f, 0.f, false, false));
+        layers.back()->set_lazy_updates(lazy);
+        layers.back()->thread_count = threads_per_layer;
+    }
+}
+
+template <typename IMG_TYPE>
+void color_layers<IMG_TYPE>::generate(const int path_steps, const short rounds)
+{
+    if (rounds < 1)
+        throw std::domain_error("Number of rounds is out of range (" + std::to_string(rounds) + ")");
+    const short count = layer_count();
+
+    // Steps of each layer, by the darkness it has to cover
+    vector<double> darkness(count, 0);
+    double total_darkness = 0;
+    for (short c = 0; c < count; c++)
+    {
+        cimg_for(targets[c], p, IMG_TYPE)
+        {
+            darkness[c] += *p;
+        }
+        total_darkness += darkness[c];
+    }
+    vector<short> layer_steps(count, 0);
+    for (short c = 0; c < count; c++)
+    {
+        const long steps = (total_darkness > 0) ? std::lround(path_steps * darkness[c] / total_darkness) : 0;
+        if (steps > std::numeric_limits<short>::max())
+            throw std::domain_error("Layer " + std::to_string(c) + " has too many steps (" + std::to_string(steps) + ")");
+        layer_steps[c] = (steps < 2) ? 0 : steps;
+    }
+
+    const bool any_interaction = std::find(interacts.begin(), interacts.end(), 1) != interacts.end();
+    const short round_count = any_interaction ? rounds : 1;
+    paths.assign(count, vector<short>());
+    round_ends.assign(count, vector<short>());
+    for (short c = 0; c < count; c++)
+        paths[c].assign(layer_steps[c], 0);
+    vector<short> done(count, 0);
+
+    std::cout << "Generating " << count << " layers in " << round_count << " rounds...\n";
+    for (short r = 0; r < round_count; r++)
+    {
+        const vector<short> round_start = done;
+        #pragma omp parallel for num_threads(count) schedule(dynamic)
+        for (short c = 0; c < count; c++)
+        {
+            const short end = (int)layer_steps[c] * (r + 1) / round_count;
+            if (end < 2 || end <= done[c])
+                continue;
+            short *path = paths[c].data();
+            short first_step = done[c];
+            if (first_step == 0)
+            {
+                path[0] = layers[c]->best_pin();
+                first_step = 1;
+            }
+            done[c] = layers[c]->run_steps(path, end, first_step);
+        }
+
+        // Each layer's darkness under the other layers' new strings
+        if (r + 1 < round_count)
+        {
+            #pragma omp parallel for num_threads(count) schedule(dynamic)
+            for (short c = 0; c < count; c++)
+            {
+                for (short other = 0; other < count; other++)
+                {
+                    if (!interacts[c * count + other])
+                        continue;
+                    for (short step = std::max<short>(1, round_start[other]); step < done[other]; step++)
+                        layers[c]->cover_line(lines->line_index(paths[other][step - 1], paths[other][step]));
+                }
+            }
+        }
+        for (short c = 0; c < count; c++)
+            round_ends[c].push_back(done[c]);
+    }
+
+    for (short c = 0; c < count; c++)
+    {
+        paths[c].resize(done[c]);
+        std::cout << "Layer " << c << ": " << done[c] << " steps, error " << layers[c]->tracked_error() << '\n';
+    }
+}
+
+template <typename IMG_TYPE>
+cimg_library::CImg<unsigned char> color_layers<IMG_TYPE>::render() const
+{
+    const int width = rgb_image->width(), height = rgb_image->height();
+    const size_t channel_size = (size_t)width * height;
+    cimg_library::CImg<unsigned char> image(width, height, 1, 3, 255);
+    unsigned char *data = image.data();
+    const short round_count = round_ends.empty() ? 0 : round_ends.front().size();
+    for (short r = 0; r < round_count; r++)
+    {
+        for (short c = 0; c < layer_count(); c++)
+        {
+            const short start = (r == 0) ? 1 : std::max<short>(1, round_ends[c][r - 1]);
+            const color &string_color = palette[c];
+            for (short step = start; step < round_ends[c][r]; step++)
+            {
+                lines->raster.for_each(lines->line_index(paths[c][step - 1], paths[c][step]), [data, channel_size, &string_color](const uint32_t p)
+                {
+                    data[p] = string_color[0];
+                    data[p + channel_size] = string_color[1];
+                    data[p + 2 * channel_size] = string_color[2];
+                });
+            }
+        }
+    }
+    return image;
+}
+
+template <typename IMG_TYPE>
+bool color_layers<IMG_TYPE>::save_image(const char *image_file) const
+{
+    render().save(image_file);
+    return true;
+}
+
+template <typename IMG_TYPE>
+bool color_layers<IMG_TYPE>::write_to_csv(const std::string &prefix) const
+{
+    for (short c = 0; c < layer_count(); c++)
+    {
+        try
+        {
+            instruction_writer csv(prefix + "_" + std::to_string(c) + ".csv", instruction_writer::csv, layers[c]->instruction_info());
+            csv.write(paths[c].data(), paths[c].size());
+            csv.flush();
+            if (!csv.good())
+                return false;
+        }
+        catch (const std::runtime_error &)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename IMG_TYPE>
+vector<cimg_library::CImg<IMG_TYPE>> color_layers<IMG_TYPE>::make_targets(const tcimg &rgb_image, const vector<color> &palette, const pin_layout &layout)
+{
+    const float darkness_max = string_art<IMG_TYPE>::darkness_max;
+    const cimg_library::CImg<float> rgb(rgb_image.get_shared_channels(0, 2));
+    const cimg_library::CImg<float> white(1, 1, 1, 3, 255.f);
+    vector<cimg_library::CImg<float>> maps;
+    for (const color &c : palette)
+    {
+        const float string_color[3] = {(float)c[0], (float)c[1], (float)c[2]};
+        const float white_distance = image_analysis<float>::color_difference(white, string_color)(0, 0);
+        cimg_library::CImg<float> map = image_analysis<float>::color_difference(rgb, string_color);
+        cimg_forXY(map, x, y)
+        {
+            // White strings cover nothing
+            map(x, y) = (white_distance > 0) ? std::max(0.f, 1.f - map(x, y) / white_distance) * darkness_max : 0;
+        }
+        maps.push_back(std::move(map));
+    }
+
+    const tcimg mask = string_art<IMG_TYPE>::make_mask(rgb_image, layout);
+    vector<tcimg> targets(palette.size(), tcimg(rgb_image.width(), rgb_image.height(), 1, 1, 0));
+    cimg_forXY(mask, x, y)
+    {
+        float total = 0;
+        for (const cimg_library::CImg<float> &map : maps)
+            total += map(x, y);
+        const float scale = (total > darkness_max) ? darkness_max / total : 1.f;
+        for (size_t c = 0; c < maps.size(); c++)
+            targets[c](x, y) = maps[c](x, y) * scale * mask(x, y);
+    }
+    return targets;
+}
+
+template class color_layers<short>;
+template class color_layers<int>;
+template class color_layers<float>;
+template class color_layers<u_char>;
+template class color_layers<u_short>;
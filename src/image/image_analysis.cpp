@@ -1,73 +1,133 @@
 #include <image_analysis.hpp>
+#include <omp.h>
 
-template <typename T>
-CImg<int> image_analysis<T>::sized_dark_regions(const CImg<T>& input_image,const T threshold, bool ignore_zeros)
+namespace
 {
-    CImg<int> regions = input_image.get_threshold(threshold).label(false, 0, true);        
-    map<int, int> region_sizes;
-    region_sizes[-1] = 0;
-    cimg_forXY(regions, x, y)
+    /** @brief Root of a pixel's region, halving the path on the way */
+    inline int find_root(int *parent, int p)
     {
-        if((input_image(x,y) > threshold )|| (ignore_zeros && input_image(x,y) == 0))
-        {
-            regions(x,y) = -1;
-        }
-        else
+        while (parent[p] != p)
         {
-            int cur_region = regions(x,y);
-            if(region_sizes.find(cur_region) != region_sizes.end())
-            {
-                ++region_sizes[cur_region];
-            }
-            else
-            {
-                region_sizes[cur_region] = 1;
-                std::cout << "adding region label " << cur_region << '\n';
-            }
+            parent[p] = parent[parent[p]];
+            p = parent[p];
         }
+        return p;
     }
-    cimg_forXY(regions, x, y)
+
+    /** @brief find_root() without path halving, so threads can share parent */
+    inline int find_root(const int *parent, int p)
     {
-        regions(x,y) = region_sizes[regions(x,y)];
+        while (parent[p] != p)
+            p = parent[p];
+        return p;
     }
-    return regions;
-};
 
-template <typename T>
-CImg<int> image_analysis<T>::sized_light_regions(const CImg<T>& input_image,const T threshold, bool ignore_zeros){
-    CImg<int> regions = CImg<int>(input_image.get_threshold(threshold)).label(false, 0, true);            
-    map<int, int> region_sizes;
-    region_sizes[-1] = 0;
-    cimg_forXY(regions, x, y)
+    /** @brief Merge the regions of two pixels. The lower root wins, so a pixel's parent never has a higher index.*/
+    inline void join(int *parent, const int a, const int b)
     {
-        int cur_region = regions(x,y);
-        if((input_image(x,y) < threshold ) || (ignore_zeros && (cur_region == 0)))
+        const int root_a = find_root(parent, a), root_b = find_root(parent, b);
+        if (root_a < root_b)
+            parent[root_b] = root_a;
+        else if (root_b < root_a)
+            parent[root_a] = root_b;
+    }
+
+    /**
+     * @brief Map every pixel to the size of its 4-connected region
+     * @details Union-find over horizontal strips, one per thread, with the threshold test fused into the first pass. The
+     *          strips are joined along their seams, then each pixel's root is found in parallel and the sizes are
+     *          counted in a flat array indexed by root. Uses the result image and one int per pixel, nothing else.
+     * @param in_region Whether a pixel value belongs to a region
+     * @param counted Whether a pixel value in a region adds to its size. Uncounted pixels still connect their region,
+     *                and map to 0.
+     * @param ignore_first Leave out the region of pixel (0,0), the first label of CImg::label()
+     * @return Size of each pixel's region, 0 outside of regions
+     */
+    template <typename T, typename IN_REGION, typename COUNTED>
+    CImg<int> sized_regions(const CImg<T> &image, IN_REGION in_region, COUNTED counted, const bool ignore_first)
+    {
+        const int width = image.width(), height = image.height();
+        const int pixel_count = width * height;
+        CImg<int> sizes(width, height, 1, 1, 0);
+        vector<int> parent(pixel_count);
+        const T *values = image.data();
+        int *links = parent.data();
+
+        const int strip_count = std::max(1, std::min(height, omp_get_max_threads()));
+        const int strip_rows = (height + strip_count - 1) / strip_count;
+        #pragma omp parallel for num_threads(strip_count)
+        for (int strip = 0; strip < strip_count; strip++)
         {
-            regions(x,y) = -1;
+            const int first_row = strip * strip_rows, end_row = std::min(height, first_row + strip_rows);
+            for (int y = first_row; y < end_row; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    const int p = y * width + x;
+                    if (!in_region(values[p]))
+                    {
+                        links[p] = -1;
+                        continue;
+                    }
+                    // A new pixel joins its left neighbor by taking its root
+                    links[p] = (x > 0 && links[p - 1] >= 0) ? find_root(links, p - 1) : p;
+                    if (y > first_row && links[p - width] >= 0)
+                        join(links, p - width, p);
+                }
+            }
         }
-        else if(region_sizes.find(cur_region) != region_sizes.end())
+        for (int y = strip_rows; y < height; y += strip_rows)
         {
-            ++region_sizes[cur_region];
+            for (int p = y * width; p < (y + 1) * width; p++)
+            {
+                if (links[p] >= 0 && links[p - width] >= 0)
+                    join(links, p - width, p);
+            }
         }
-        else
+
+        // Roots go in the result, then parent becomes the size of each root
+        int *roots = sizes.data();
+        #pragma omp parallel for
+        for (int p = 0; p < pixel_count; p++)
+            roots[p] = (links[p] < 0) ? -1 : find_root((const int *)links, p);
+        std::fill(parent.begin(), parent.end(), 0);
+        for (int p = 0; p < pixel_count; p++)
         {
-            region_sizes[cur_region] = 1;
+            if (roots[p] >= 0 && counted(values[p]))
+                links[roots[p]]++;
         }
+        if (ignore_first && roots[0] >= 0)
+            links[roots[0]] = 0;
+        #pragma omp parallel for
+        for (int p = 0; p < pixel_count; p++)
+            roots[p] = (roots[p] < 0 || !counted(values[p])) ? 0 : links[roots[p]];
+        return sizes;
     }
-    cimg_forXY(regions, x, y)
-    {   
+}
 
-        regions(x,y) = region_sizes[regions(x,y)];
-    }
-    return regions;
-};
+template <typename T>
+CImg<int> image_analysis<T>::sized_dark_regions(const CImg<T>& input_image,const T threshold, bool ignore_zeros)
+{
+    // Zeros connect dark regions like any dark pixel, they just don't add to their size
+    return sized_regions(input_image, [threshold](const T value)
+                         { return value <= threshold; }, [ignore_zeros](const T value)
+                         { return !(ignore_zeros && value == 0); }, false);
+}
+
+template <typename T>
+CImg<int> image_analysis<T>::sized_light_regions(const CImg<T>& input_image,const T threshold, bool ignore_zeros)
+{
+    return sized_regions(input_image, [threshold](const T value)
+                         { return value >= threshold; }, [](const T)
+                         { return true; }, ignore_zeros);
+}
 
 template <typename T>
 CImg<T> image_analysis<T>::color_difference(const CImg<T>& rgb, const T* color)
 {
     CImg<T> rgb_Lab = rgb.get_RGBtoLab();
     CImg<T> color_Lab = CImg<T>(color, 1, 1, 1, 3).RGBtoLab();
-    CImg<T> diff(rgb.width(), rgb.height(), 1, 1);
+    CImg<T> diff(rgb.width(), rgb.height(), 1, 1, 0);
     
     cimg_forC(rgb_Lab, c)
     {
@@ -116,4 +176,6 @@ float image_analysis<T>::line_color_difference3x3(const CImg<T>& image_a, const
 
 template class image_analysis<short>;
 template class image_analysis<float>;
-template class image_analysis<int>;
\ No newline at end of file
+template class image_analysis<int>;
+template class image_analysis<u_char>;
+template class image_analysis<u_short>;
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include <instrumentation.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
+namespace
+{
+    /** @brief Accumulators of the running threads, and the totals of threads that have exited */
+    struct registry
+    {
+        std::mutex mutex;
+        std::vector<instrumentation::accumulator *> threads;
+        instrumentation::accumulator retired;
+    };
+
+    /** @brief Constructed before the first thread registers, so it outlives every thread's accumulator */
+    registry &threads()
+    {
+        static registry r;
+        return r;
+    }
+
+    /** @brief Registers a thread's accumulator for its lifetime */
+    struct thread_accumulator
+    {
+        instrumentation::accumulator totals;
+
+        thread_accumulator()
+        {
+            registry &r = threads();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.threads.push_back(&totals);
+        }
+
+        ~thread_accumulator()
+        {
+            registry &r = threads();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.retired.merge(totals);
+            r.threads.erase(std::find(r.threads.begin(), r.threads.end(), &totals));
+        }
+    };
+
+    void write_escaped(std::ostream &out, const std::string &text)
+    {
+        out << '"';
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+}
+
+namespace instrumentation
+{
+    namespace detail
+    {
+        std::atomic<bool> enabled(true);
+
+        accumulator &local()
+        {
+            static thread_local thread_accumulator a;
+            return a.totals;
+        }
+    }
+
+    const char *name(const phase p)
+    {
+        static const char *names[phase_count] = {"load_image", "build_lines", "lab_image", "darkness_map", "region_map", "score_lines",
+                                                 "build_trees", "select", "update", "update_darkness", "checkpoint",
+                                                 "step"};
+        return names[p];
+    }
+
+    const char *name(const counter c)
+    {
+        static const char *names[counter_count] = {"chords_touched", "pixels_visited"};
+        return names[c];
+    }
+
+    void accumulator::merge(const accumulator &other)
+    {
+        for (int p = 0; p < phase_count; p++)
+        {
+            seconds[p] += other.seconds[p];
+            calls[p] += other.calls[p];
+        }
+        for (int c = 0; c < counter_count; c++)
+            counts[c] += other.counts[c];
+        step_seconds.insert(step_seconds.end(), other.step_seconds.begin(), other.step_seconds.end());
+    }
+
+    void accumulator::clear()
+    {
+        *this = accumulator();
+    }
+
+    double accumulator::step_percentile(const double p) const
+    {
+        if (step_seconds.empty())
+            return 0;
+        std::vector<float> sorted(step_seconds);
+        const size_t rank = std::min(sorted.size() - 1, (size_t)std::max(0.0, std::ceil(p / 100 * sorted.size()) - 1));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+
+    void accumulator::write_json_line(std::ostream &out, const std::string &label) const
+    {
+        const std::ios_base::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        const size_t steps = step_seconds.size();
+        out << std::defaultfloat << std::setprecision(6) << "{\"label\": ";
+        write_escaped(out, label);
+        out << ", \"steps\": " << steps
+            << ", \"step_p50_us\": " << step_percentile(50) * 1e6
+            << ", \"step_p99_us\": " << step_percentile(99) * 1e6
+            << ", \"step_max_us\": " << step_percentile(100) * 1e6;
+        for (int c = 0; c < counter_count; c++)
+        {
+            out << ", \"" << name((counter)c) << "\": " << counts[c]
+                << ", \"" << name((counter)c) << "_per_step\": " << (steps ? (double)counts[c] / steps : 0);
+        }
+        out << ", \"phases\": {";
+        for (int p = 0; p < phase_count; p++)
+        {
+            out << (p ? ", " : "") << '"' << name((phase)p) << "\": {\"seconds\": " << seconds[p] << ", \"calls\": " << calls[p] << '}';
+        }
+        out << "}}\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    void set_enabled(const bool on)
+    {
+        detail::enabled.store(on, std::memory_order_relaxed);
+    }
+
+    void add(const phase p, const double seconds)
+    {
+        accumulator &a = detail::local();
+        a.seconds[p] += seconds;
+        a.calls[p]++;
+        a.current.seconds[p] += seconds;
+    }
+
+    step_timer::step_timer() : on(enabled())
+    {
+        if (on)
+        {
+            detail::local().current = step_record();
+            start = clock::now();
+        }
+    }
+
+    step_timer::~step_timer()
+    {
+        if (!on)
+            return;
+        const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        add(step, seconds);
+        accumulator &a = detail::local();
+        a.step_seconds.push_back(seconds);
+        a.last = a.current;
+        a.current = step_record();
+    }
+
+    const step_record &last_step()
+    {
+        return detail::local().last;
+    }
+
+    accumulator snapshot()
+    {
+        registry &r = threads();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        accumulator total;
+        total.merge(r.retired);
+        for (const accumulator *a : r.threads)
+            total.merge(*a);
+        return total;
+    }
+
+    accumulator thread_snapshot()
+    {
+        accumulator total;
+        total.merge(detail::local());
+        return total;
+    }
+
+    void reset()
+    {
+        registry &r = threads();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.retired.clear();
+        for (accumulator *a : r.threads)
+            a->clear();
+    }
+
+    void reset_thread()
+    {
+        detail::local().clear();
+    }
+
+    bool append_json_line(const std::string &filename, const std::string &label)
+    {
+        std::ofstream file(filename, std::ios::app);
+        if (!file)
+            return false;
+        snapshot().write_json_line(file, label);
+        return true;
+    }
+}
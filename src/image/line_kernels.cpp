@@ -0,0 +1,112 @@
+#include <line_kernels.hpp>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LINE_KERNELS_AVX2 1
+#include <immintrin.h>
+#else
+#define LINE_KERNELS_AVX2 0
+#endif
+
+namespace
+{
+    template <typename T>
+    void masked_sum_scalar(const T *image, const uint32_t *pixels, const size_t count, float &sum, float &length)
+    {
+        sum = 0;
+        length = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            const float value = image[pixels[i]];
+            if (value > 0)
+            {
+                sum += value;
+                length++;
+            }
+        }
+    }
+
+#if LINE_KERNELS_AVX2
+    /** @brief Load 8 pixels of an image as floats */
+    __attribute__((target("avx2"))) inline __m256 gather(const float *image, const __m256i indices)
+    {
+        return _mm256_i32gather_ps(image, indices, 4);
+    }
+
+    __attribute__((target("avx2"))) inline __m256 gather(const int *image, const __m256i indices)
+    {
+        return _mm256_cvtepi32_ps(_mm256_i32gather_epi32(image, indices, 4));
+    }
+
+    template <typename T>
+    __attribute__((target("avx2"))) void masked_sum_avx2(const T *image, const uint32_t *pixels, const size_t count, float &sum, float &length)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.f);
+        __m256 sums = zero;
+        __m256 lengths = zero;
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256i indices = _mm256_loadu_si256((const __m256i *)(pixels + i));
+            const __m256 values = gather(image, indices);
+            const __m256 positive = _mm256_cmp_ps(values, zero, _CMP_GT_OQ);
+            sums = _mm256_add_ps(sums, _mm256_and_ps(positive, values));
+            lengths = _mm256_add_ps(lengths, _mm256_and_ps(positive, one));
+        }
+        alignas(32) float lane_sums[8], lane_lengths[8];
+        _mm256_store_ps(lane_sums, sums);
+        _mm256_store_ps(lane_lengths, lengths);
+        masked_sum_scalar(image, pixels + i, count - i, sum, length);
+        for (int l = 0; l < 8; l++)
+        {
+            sum += lane_sums[l];
+            length += lane_lengths[l];
+        }
+    }
+#endif
+}
+
+namespace line_kernels
+{
+    bool avx2_enabled()
+    {
+#if LINE_KERNELS_AVX2
+        static const bool enabled = __builtin_cpu_supports("avx2");
+        return enabled;
+#else
+        return false;
+#endif
+    }
+
+    template <typename T>
+    void masked_sum(const T *image, const uint32_t *pixels, const size_t count, float &sum, float &length)
+    {
+        masked_sum_scalar(image, pixels, count, sum, length);
+    }
+
+    // Declared in the header, so every caller sees that int and float have their own definition
+    template <>
+    void masked_sum<int>(const int *image, const uint32_t *pixels, const size_t count, float &sum, float &length)
+    {
+#if LINE_KERNELS_AVX2
+        if (avx2_enabled())
+            return masked_sum_avx2(image, pixels, count, sum, length);
+#endif
+        masked_sum_scalar(image, pixels, count, sum, length);
+    }
+
+    template <>
+    void masked_sum<float>(const float *image, const uint32_t *pixels, const size_t count, float &sum, float &length)
+    {
+#if LINE_KERNELS_AVX2
+        if (avx2_enabled())
+            return masked_sum_avx2(image, pixels, count, sum, length);
+#endif
+        masked_sum_scalar(image, pixels, count, sum, length);
+    }
+
+    template void masked_sum<short>(const short *, const uint32_t *, const size_t, float &, float &);
+    // 8 and 16-bit pixels can't be gathered as 32-bit lanes without reading past the end of the image
+    template void masked_sum<unsigned char>(const unsigned char *, const uint32_t *, const size_t, float &, float &);
+    template void masked_sum<unsigned short>(const unsigned short *, const uint32_t *, const size_t, float &, float &);
+}
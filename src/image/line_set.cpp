@@ -0,0 +1,161 @@
+#include <line_set.hpp>
+#include <algorithm>
+#include <iostream>
+#include <assert.h>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    /** @brief The separation, if calculate_line_count() holds for it */
+    short checked_separation(const int pin_count, const short min_separation)
+    {
+        // At 0, pins would be paired with themselves
+        if (min_separation < 1)
+            throw std::domain_error("Minimum pin separation must be at least 1 (got " + std::to_string(min_separation) + ")");
+        // Beyond half the pins, no pair is that far apart around the frame and the count goes negative
+        if (min_separation > pin_count / 2)
+            throw std::domain_error("Minimum pin separation must be at most half the pin count (got " + std::to_string(min_separation) +
+                                    " for " + std::to_string(pin_count) + " pins)");
+        return min_separation;
+    }
+
+    /** @brief Whether two pins are far enough apart around the frame (in pin order, whichever way is shorter) to get a line */
+    bool separated(const int a, const int b, const int pin_count, const short min_separation)
+    {
+        return std::min(std::abs(b - a), pin_count - std::abs(b - a)) >= min_separation;
+    }
+
+    /** @brief calculate_line_count(), less the separated border pairs */
+    int count_lines(const int pin_count, const short min_separation, const vector<coord<short>> &border_pairs)
+    {
+        int count = line_set::calculate_line_count(pin_count, min_separation);
+        for (const coord<short> &pair : border_pairs)
+            count -= separated(pair.x, pair.y, pin_count, min_separation);
+        return count;
+    }
+}
+
+line_set::line_set(const int _width, const int _height, const vector<scoord> &_pins, const short _min_separation, const vector<scoord> &_border_pairs, const line_raster::encoding raster_encoding, const short tile_shift, const bool show_progress)
+    : width(_width),
+      height(_height),
+      pin_count(_pins.size()),
+      min_separation(checked_separation(_pins.size(), _min_separation)),
+      pins(_pins),
+      line_count(count_lines(_pins.size(), min_separation, _border_pairs)),
+      line_pairs(line_count),
+      index(pin_count)
+{
+    build_lines(_border_pairs);
+    if (show_progress)
+        std::cout << "Rasterizing lines...\n";
+    raster = line_raster(width, height, pins.data(), line_pairs.data(), line_count, raster_buffer, raster_encoding, show_progress);
+    if (show_progress)
+        std::cout << "Indexing line pixels...\n";
+    pixel_index = pixel_line_index(raster, tile_shift, show_progress);
+}
+
+void line_set::build_lines(const vector<scoord> &border_pairs)
+{
+    vector<char> on_border(pin_count * pin_count, 0);
+    for (const scoord &pair : border_pairs)
+        on_border[pair.x * pin_count + pair.y] = 1;
+    int i = 0;
+    for (short a = 0; a < pin_count; a++)
+    {
+        for (short b = a + 1; b < pin_count; b++)
+        {
+            if (separated(a, b, pin_count, min_separation) && !on_border[a * pin_count + b])
+            {
+                index.set(a, b, i);
+                line_pairs[i].x = a;
+                line_pairs[i].y = b;
+                i++;
+            }
+        }
+    }
+    assert(i == line_count);
+    for (const scoord &pair : line_pairs)
+    {
+        line_ends.ax.push_back(pins[pair.x].x);
+        line_ends.ay.push_back(pins[pair.x].y);
+        line_ends.bx.push_back(pins[pair.y].x);
+        line_ends.by.push_back(pins[pair.y].y);
+    }
+}
+
+namespace
+{
+    /**
+     * @brief Twice the signed area of the triangle (a, b, c): positive if c is left of a->b, 0 if it's on the line
+     * @details Exact in 32 bits for coordinates from 0 to 32767.
+     */
+    inline int32_t orientation(const int32_t ax, const int32_t ay, const int32_t bx, const int32_t by, const int32_t cx, const int32_t cy)
+    {
+        return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+    }
+
+    /** @brief Both pairs of orientations are non-zero and have opposite signs */
+    inline bool opposite(const int32_t a, const int32_t b, const int32_t c, const int32_t d)
+    {
+        return (((a ^ b) & (c ^ d)) < 0) & (a != 0) & (b != 0) & (c != 0) & (d != 0);
+    }
+}
+
+bool line_set::lines_cross(const int line_a, const int line_b) const
+{
+    const int32_t px = line_ends.ax[line_a], py = line_ends.ay[line_a], qx = line_ends.bx[line_a], qy = line_ends.by[line_a];
+    const int32_t ax = line_ends.ax[line_b], ay = line_ends.ay[line_b], bx = line_ends.bx[line_b], by = line_ends.by[line_b];
+    return opposite(orientation(px, py, qx, qy, ax, ay), orientation(px, py, qx, qy, bx, by),
+                    orientation(ax, ay, bx, by, px, py), orientation(ax, ay, bx, by, qx, qy));
+}
+
+void line_set::crossing_lines(const short pin_a, const short pin_b, vector<int> &crossing) const
+{
+    crossing.clear();
+    const int32_t px = pins[pin_a].x, py = pins[pin_a].y, qx = pins[pin_b].x, qy = pins[pin_b].y;
+    const int32_t *ax = line_ends.ax.data(), *ay = line_ends.ay.data(), *bx = line_ends.bx.data(), *by = line_ends.by.data();
+    // Tested a block at a time into hits, then gathered
+    constexpr int block = 256;
+    unsigned char hits[block];
+    for (int start = 0; start < line_count; start += block)
+    {
+        const int end = std::min(line_count, start + block);
+        for (int i = start; i < end; i++)
+        {
+            hits[i - start] = opposite(orientation(px, py, qx, qy, ax[i], ay[i]), orientation(px, py, qx, qy, bx[i], by[i]),
+                                       orientation(ax[i], ay[i], bx[i], by[i], px, py), orientation(ax[i], ay[i], bx[i], by[i], qx, qy));
+        }
+        for (int i = start; i < end; i++)
+        {
+            if (hits[i - start])
+                crossing.push_back(i);
+        }
+    }
+}
+
+size_t line_set::memory_usage() const
+{
+    return pins.capacity() * sizeof(scoord) +
+           line_pairs.capacity() * sizeof(scoord) +
+           4 * line_ends.ax.capacity() * sizeof(int32_t) +
+           index.memory_usage() +
+           raster.memory_usage() +
+           pixel_index.memory_usage();
+}
+
+/**
+ * @details  If you map the possible connections on a 2D grid, they can be re-organized into a rectangle and a triangle.
+ * This sums the areas of those two shapes. <br>
+ * \f{eqnarray*}
+ *   & \textrm{Rectangle area:} & (c-2s+1) \times s \\
+ *   & \textrm{Triangle area:}  & \frac{ (c-2s) \times(c-2s+1)}{2} \\
+ *   & \textrm{Total area:}     & \frac{c^2-2cs + c}{2}
+ * \f}
+ * Only holds for 1 <= min_separation <= pin_count / 2.
+ */
+int line_set::calculate_line_count(int pin_count, int min_separation)
+{
+    return (pin_count * pin_count - 2 * pin_count * min_separation + pin_count) / 2;
+}
@@ -0,0 +1,275 @@
+#include <pin_layout.hpp>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+pin_layout::pin_layout(const float _size)
+    : type(circle), size(_size)
+{
+}
+
+pin_layout::pin_layout(const shape _type, const float _size)
+    : type(_type), size(_size)
+{
+}
+
+pin_layout::pin_layout(const vector<coord<float>> &_points, const float _size, const std::string &_source)
+    : type(custom), size(_size), points(_points), source(_source)
+{
+}
+
+vector<coord<short>> pin_layout::place(const int width, const int height, const short pin_count) const
+{
+    vector<scoord> pins;
+    const scoord center(width / 2, height / 2);
+    switch (type)
+    {
+    case circle:
+    case ellipse:
+    {
+        const float radius_x = size * ((type == circle) ? std::min(width, height) : width) / 2;
+        const float radius_y = size * ((type == circle) ? std::min(width, height) : height) / 2;
+        for (int i = 0; i < pin_count; i++)
+        {
+            const float angle = (2.f * 3.14159f * i) / pin_count;
+            pins.emplace_back(center.x + std::cos(angle) * radius_x, center.y + std::sin(angle) * radius_y);
+        }
+        break;
+    }
+    case rectangle:
+    {
+        const float half_width = size * width / 2, half_height = size * height / 2;
+        const float perimeter = 4 * (half_width + half_height);
+        for (int i = 0; i < pin_count; i++)
+        {
+            // Distance along the edges: top, right, bottom, then left
+            float d = perimeter * i / pin_count;
+            float x, y;
+            if (d < 2 * half_width)
+            {
+                x = center.x - half_width + d;
+                y = center.y - half_height;
+            }
+            else if ((d -= 2 * half_width) < 2 * half_height)
+            {
+                x = center.x + half_width;
+                y = center.y - half_height + d;
+            }
+            else if ((d -= 2 * half_height) < 2 * half_width)
+            {
+                x = center.x + half_width - d;
+                y = center.y + half_height;
+            }
+            else
+            {
+                d -= 2 * half_width;
+                x = center.x - half_width;
+                y = center.y + half_height - d;
+            }
+            pins.emplace_back(std::lround(x), std::lround(y));
+        }
+        break;
+    }
+    case custom:
+    {
+        if (points.size() < 3)
+            throw std::runtime_error("Pin layout " + source + " has " + std::to_string(points.size()) + " pins (expected at least 3)");
+        float min_x = points[0].x, max_x = min_x, min_y = points[0].y, max_y = min_y;
+        for (const coord<float> &p : points)
+        {
+            min_x = std::min(min_x, p.x);
+            max_x = std::max(max_x, p.x);
+            min_y = std::min(min_y, p.y);
+            max_y = std::max(max_y, p.y);
+        }
+        const float scale_x = (max_x > min_x) ? (width - 1) / (max_x - min_x) : INFINITY;
+        const float scale_y = (max_y > min_y) ? (height - 1) / (max_y - min_y) : INFINITY;
+        const float scale = size * std::min(scale_x, scale_y);
+        for (const coord<float> &p : points)
+        {
+            pins.emplace_back(std::lround((width - 1) / 2.f + (p.x - (min_x + max_x) / 2) * scale),
+                              std::lround((height - 1) / 2.f + (p.y - (min_y + max_y) / 2) * scale));
+        }
+        break;
+    }
+    }
+    for (scoord &pin : pins)
+    {
+        pin.x = std::max<short>(0, std::min<short>(width - 1, pin.x));
+        pin.y = std::max<short>(0, std::min<short>(height - 1, pin.y));
+    }
+    return pins;
+}
+
+vector<coord<short>> pin_layout::border_pairs(const vector<scoord> &pins) const
+{
+    vector<scoord> pairs;
+    const int pin_count = pins.size();
+    if (type == rectangle)
+    {
+        short min_x = SHRT_MAX, max_x = SHRT_MIN, min_y = SHRT_MAX, max_y = SHRT_MIN;
+        for (const scoord &pin : pins)
+        {
+            min_x = std::min(min_x, pin.x);
+            max_x = std::max(max_x, pin.x);
+            min_y = std::min(min_y, pin.y);
+            max_y = std::max(max_y, pin.y);
+        }
+        // One bit per edge: top, right, bottom, left
+        vector<uint8_t> edges(pin_count);
+        for (int i = 0; i < pin_count; i++)
+            edges[i] = (pins[i].y == min_y) | (pins[i].x == max_x) << 1 | (pins[i].y == max_y) << 2 | (pins[i].x == min_x) << 3;
+        for (short a = 0; a < pin_count; a++)
+        {
+            for (short b = a + 1; b < pin_count; b++)
+            {
+                if (edges[a] & edges[b])
+                    pairs.emplace_back(a, b);
+            }
+        }
+    }
+    else if (type == custom)
+    {
+        // From each pin, onwards while every pin in between stays on the chord. A pin off the chord stays in between.
+        for (int a = 0; a < pin_count; a++)
+        {
+            for (int steps = 1; steps < pin_count; steps++)
+            {
+                const int b = (a + steps) % pin_count;
+                const float dx = pins[b].x - pins[a].x, dy = pins[b].y - pins[a].y;
+                const float sqr_length = dx * dx + dy * dy;
+                bool on_chord = sqr_length > 0;
+                for (int between = 1; on_chord && between < steps; between++)
+                {
+                    const scoord &p = pins[(a + between) % pin_count];
+                    const float px = p.x - pins[a].x, py = p.y - pins[a].y;
+                    const float along = px * dx + py * dy;
+                    on_chord = std::abs(px * dy - py * dx) <= std::sqrt(sqr_length) && along >= 0 && along <= sqr_length;
+                }
+                if (!on_chord)
+                    break;
+                pairs.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        }
+        std::sort(pairs.begin(), pairs.end(), [](const scoord &p, const scoord &q)
+                  { return p.x < q.x || (p.x == q.x && p.y < q.y); });
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    }
+    return pairs;
+}
+
+cimg_library::CImg<unsigned char> pin_layout::mask(const int width, const int height) const
+{
+    cimg_library::CImg<unsigned char> inside(width, height, 1, 1, 0);
+    const scoord center(width / 2, height / 2);
+    switch (type)
+    {
+    case circle:
+    {
+        const float sqr_radius = std::pow(size * std::min(width, height) / 2, 2);
+        cimg_forXY(inside, x, y)
+        {
+            inside(x, y) = std::pow(x - center.x, 2) + std::pow(y - center.y, 2) <= sqr_radius;
+        }
+        break;
+    }
+    case ellipse:
+    {
+        const float radius_x = size * width / 2, radius_y = size * height / 2;
+        cimg_forXY(inside, x, y)
+        {
+            inside(x, y) = std::pow((x - center.x) / radius_x, 2) + std::pow((y - center.y) / radius_y, 2) <= 1;
+        }
+        break;
+    }
+    case rectangle:
+    {
+        const float half_width = size * width / 2, half_height = size * height / 2;
+        cimg_forXY(inside, x, y)
+        {
+            inside(x, y) = std::abs(x - center.x) <= half_width && std::abs(y - center.y) <= half_height;
+        }
+        break;
+    }
+    case custom:
+    {
+        // Even-odd fill of the polygon through the pins, one row at a time
+        const vector<scoord> pins = place(width, height, points.size());
+        vector<float> crossings;
+        for (int y = 0; y < height; y++)
+        {
+            crossings.clear();
+            for (size_t i = 0; i < pins.size(); i++)
+            {
+                const scoord &a = pins[i], &b = pins[(i + 1) % pins.size()];
+                if ((a.y <= y) != (b.y <= y))
+                    crossings.push_back(a.x + (float)(y - a.y) * (b.x - a.x) / (b.y - a.y));
+            }
+            std::sort(crossings.begin(), crossings.end());
+            for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+            {
+                const int from = std::max(0, (int)std::ceil(crossings[i]));
+                const int to = std::min(width - 1, (int)std::floor(crossings[i + 1]));
+                for (int x = from; x <= to; x++)
+                    inside(x, y) = 1;
+            }
+        }
+        // The pins themselves are on the frame
+        for (const scoord &pin : pins)
+            inside(pin.x, pin.y) = 1;
+        break;
+    }
+    }
+    return inside;
+}
+
+std::string pin_layout::name() const
+{
+    switch (type)
+    {
+    case circle:
+        return "circle";
+    case ellipse:
+        return "ellipse";
+    case rectangle:
+        return "rectangle";
+    default:
+        return source;
+    }
+}
+
+pin_layout pin_layout::load(const std::string &pin_file, const float size)
+{
+    std::ifstream in(pin_file);
+    if (!in)
+        throw std::runtime_error("Could not open pin file " + pin_file);
+    vector<coord<float>> points;
+    std::string text;
+    for (int line_number = 1; std::getline(in, text); line_number++)
+    {
+        if (text.find_first_not_of(" \t\r") == std::string::npos || text[text.find_first_not_of(" \t\r")] == '#')
+            continue;
+        std::istringstream fields(text);
+        coord<float> point;
+        if (!(fields >> point.x >> point.y))
+            throw std::runtime_error("Pin file " + pin_file + " line " + std::to_string(line_number) + " isn't \"x y\"");
+        points.push_back(point);
+    }
+    if (points.size() < 3)
+        throw std::runtime_error("Pin file " + pin_file + " has " + std::to_string(points.size()) + " pins (expected at least 3)");
+    return pin_layout(points, size, pin_file);
+}
+
+pin_layout pin_layout::parse(const std::string &name, const float size)
+{
+    if (name == "circle")
+        return pin_layout(circle, size);
+    if (name == "ellipse")
+        return pin_layout(ellipse, size);
+    if (name == "rectangle")
+        return pin_layout(rectangle, size);
+    return load(name, size);
+}
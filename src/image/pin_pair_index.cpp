@@ -0,0 +1,17 @@
+#include <pin_pair_index.hpp>
+#include <stdexcept>
+#include <string>
+
+pin_pair_index::pin_pair_index(const short _pin_count)
+    : pins(_pin_count),
+      slots((_pin_count > 1) ? ((size_t)_pin_count * (_pin_count - 1)) / 2 : 0, none)
+{
+}
+
+void pin_pair_index::set(const short pin_a, const short pin_b, const int line_index)
+{
+    if (pin_a == pin_b || pin_a < 0 || pin_b < 0 || pin_a >= pins || pin_b >= pins)
+        throw std::out_of_range("Invalid pin pair (" + std::to_string(pin_a) + "," + std::to_string(pin_b) + ")");
+    slots[slot(pin_a, pin_b)] = line_index;
+}
+
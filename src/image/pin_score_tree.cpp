@@ -0,0 +1,90 @@
+#include <pin_score_tree.hpp>
+#include <queue>
+#include <utility>
+
+template <typename T>
+pin_score_tree<T>::pin_score_tree(const short _pin_count)
+    : pins(_pin_count)
+{
+    leaf_count = 1;
+    while (leaf_count < (size_t)pins)
+        leaf_count *= 2;
+    scores.assign((size_t)pins * leaf_count, 0);
+    winners.assign((size_t)pins * 2 * leaf_count, none);
+}
+
+template <typename T>
+void pin_score_tree<T>::set(const short from_pin, const short to_pin, const T score)
+{
+    scores[(size_t)from_pin * leaf_count + to_pin] = score;
+    const size_t leaf = leaf_count + to_pin;
+    winners[node(from_pin, leaf)] = to_pin;
+    replay(from_pin, leaf);
+}
+
+template <typename T>
+void pin_score_tree<T>::remove(const short from_pin, const short to_pin)
+{
+    scores[(size_t)from_pin * leaf_count + to_pin] = 0;
+    const size_t leaf = leaf_count + to_pin;
+    winners[node(from_pin, leaf)] = none;
+    replay(from_pin, leaf);
+}
+
+template <typename T>
+void pin_score_tree<T>::replay(const short from_pin, size_t n)
+{
+    short *tree = &winners[node(from_pin, 0)];
+    const T *leaf_scores = &scores[(size_t)from_pin * leaf_count];
+    for (n /= 2; n > 0; n /= 2)
+    {
+        const short left = tree[2 * n];
+        const short right = tree[2 * n + 1];
+        short winner;
+        if (left == none)
+            winner = right;
+        else if (right == none)
+            winner = left;
+        else
+            winner = (leaf_scores[right] > leaf_scores[left]) ? right : left;
+        tree[n] = winner;
+    }
+}
+
+template <typename T>
+void pin_score_tree<T>::top(const short from_pin, const short k, vector<short> &out) const
+{
+    out.clear();
+    const short *tree = &winners[node(from_pin, 0)];
+    const T *leaf_scores = &scores[(size_t)from_pin * leaf_count];
+    // Orders nodes by their winner's score, then by the lower pin (matching the tie-break in replay())
+    auto worse = [tree, leaf_scores](const size_t a, const size_t b)
+    {
+        if (leaf_scores[tree[a]] != leaf_scores[tree[b]])
+            return leaf_scores[tree[a]] < leaf_scores[tree[b]];
+        return tree[a] > tree[b];
+    };
+    std::priority_queue<size_t, vector<size_t>, decltype(worse)> frontier(worse);
+    if (tree[1] != none)
+        frontier.push(1);
+    while (!frontier.empty() && (short)out.size() < k)
+    {
+        const size_t n = frontier.top();
+        frontier.pop();
+        if (n >= leaf_count)
+        {
+            out.push_back(tree[n]);
+            continue;
+        }
+        if (tree[2 * n] != none)
+            frontier.push(2 * n);
+        if (tree[2 * n + 1] != none)
+            frontier.push(2 * n + 1);
+    }
+}
+
+template class pin_score_tree<short>;
+template class pin_score_tree<int>;
+template class pin_score_tree<float>;
+template class pin_score_tree<unsigned char>;
+template class pin_score_tree<unsigned short>;
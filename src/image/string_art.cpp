@@ -1,148 +1,803 @@
 #include <string_art.hpp>
 
 template <class IMG_TYPE>
-string_art<IMG_TYPE>::string_art(const char *_image_file, const short _resolution, const short _pin_count, float _pin_radius, short _min_separation, u_char _score_method, float _score_modifier, const short _score_depth, const float localsize_weight, const float neighbor_weight)
+string_art<IMG_TYPE>::string_art(const char *_image_file, const short _resolution, const short _pin_count, const pin_layout &_layout, short _min_separation, u_char _score_method, float _score_modifier, const short _score_depth, const float localsize_weight, const float neighbor_weight, const line_raster::encoding _raster_encoding, const bool _show_display)
+    : string_art(std::make_shared<const tcimg>(make_rgb_image(_image_file, _resolution)), _layout, _pin_count, _min_separation,
+                 _score_method, _score_modifier, _score_depth, localsize_weight, neighbor_weight, _raster_encoding, _show_display)
+{
+}
+
+template <class IMG_TYPE>
+string_art<IMG_TYPE>::string_art(std::shared_ptr<const tcimg> _rgb_image, const pin_layout &_layout, const short _pin_count, short _min_separation, u_char _score_method, float _score_modifier, const short _score_depth, const float localsize_weight, const float neighbor_weight, const line_raster::encoding _raster_encoding, const bool _show_display)
+    : string_art(_rgb_image, make_lines(*_rgb_image, _layout, _pin_count, _min_separation, _raster_encoding),
+                 _layout, _score_method, _score_modifier, _score_depth, localsize_weight, neighbor_weight, _show_display)
+{
+}
+
+template <class IMG_TYPE>
+string_art<IMG_TYPE>::string_art(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, const pin_layout &_layout, u_char _score_method, float _score_modifier, const short _score_depth, const float localsize_weight, const float neighbor_weight, const bool _show_display, const bool _show_progress)
+    : string_art(_rgb_image, _lines,
+                 instrumentation::timed(instrumentation::darkness_map, [&]()
+                                        { return make_darkness_image(*_rgb_image, _layout, _show_progress); }),
+                 _layout, _score_method, _score_modifier, _score_depth, localsize_weight, neighbor_weight, _show_display, _show_progress)
+{
+}
+
+template <class IMG_TYPE>
+string_art<IMG_TYPE>::string_art(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, tcimg _darkness_image, const pin_layout &_layout, u_char _score_method, float _score_modifier, const short _score_depth, const float localsize_weight, const float neighbor_weight, const bool _show_display, const bool _show_progress)
     : 
-    #ifdef DEBUG
-      dm(display_manager<IMG_TYPE>(1024,1024,"Debug Info")),
+    #if STRING_ART_DISPLAY
+      dm(_show_display ? new display_manager<IMG_TYPE>(1024,1024,"Debug Info") : nullptr),
     #endif
-      rgb_image(make_rgb_image(_image_file, _resolution)),
-      lab_image(rgb_image.get_shared_channels(0, 2).get_RGBtoLab()),
-      darkness_image(make_darkness_image(rgb_image, _pin_radius)),
-      pin_count(_pin_count),
-      pins(circular_pins(rgb_image, _pin_radius, _pin_count)),
+      show_progress(_show_progress),
+      rgb_image(_rgb_image),
+      lab_image(instrumentation::timed(instrumentation::lab_image, [&]()
+                                       { return std::make_shared<const tcimg>(rgb_image->get_shared_channels(0, 2).get_RGBtoLab()); })),
+      darkness_image(std::move(_darkness_image)),
+      lines(_lines),
+      pin_count(lines->pin_count),
+      layout(_layout),
+      pins(lines->pins.data()),
       score_method(_score_method),
       score_modifier(_score_modifier),
+      darkening(score_modifier),
       score_depth(_score_depth),
-      line_count(calculate_line_count(_pin_count, _min_separation)),
+      line_count(lines->line_count),
       wg_localsize(localsize_weight),
-      wg_neighbor(neighbor_weight)
+      wg_neighbor(neighbor_weight),
+      line_pairs(lines->line_pairs.data()),
+      raster(lines->raster),
+      pixel_index(lines->pixel_index),
+      line_scores(line_count, 0),
+      line_lengths(line_count, 0),
+      line_totals(line_count, 0),
+      culled(line_count, 0)
 {
-    build_lines(_min_separation);
-    std::cout << "Mapping lines to slices...\n";
-    slices = map_lines_to_slices();
-    //slices.display();
-    std::cout << "Building region size map...\n";
-    region_size_map = make_region_size_map();
+    (void)_show_display;
+    if (darkness_image.width() != rgb_image->width() || darkness_image.height() != rgb_image->height())
+        throw std::domain_error("Darkness image is " + std::to_string(darkness_image.width()) + "x" + std::to_string(darkness_image.height()) +
+                                " (expected " + std::to_string(rgb_image->width()) + "x" + std::to_string(rgb_image->height()) + ")");
+    if (show_progress)
+        std::cout << "OpenMP " << _OPENMP << ": " << thread_count << " threads (" << omp_get_num_procs() << " processors)\n";
+    // Only the local size weight uses the region map
+    if (wg_localsize != 0)
+    {
+        if (show_progress)
+            std::cout << "Building region size map...\n";
+        instrumentation::scoped_timer timer(instrumentation::region_map);
+        region_size_map = std::make_shared<const tcimg>(make_region_size_map());
+    }
 
-    string_image = tcimg(rgb_image.width(), rgb_image.height(), 1, 1, 0);
-    std::cout << "Scoring all lines...\n";
+    string_image = ccimg(rgb_image->width(), rgb_image->height(), 1, 1, 0);
+    reset_error();
+    if (show_progress)
+        std::cout << "Scoring all lines...\n";
     score_all_lines();
-    dm.add_image(&string_image, 1);
-    dm.add_image(&region_size_map, 2);
-    dm.add_image(&darkness_image, 0);
-    dm.set_pause(true);
-    dm.update();
+    attach_display();
     return;
 }
 
 template <class IMG_TYPE>
-string_art<IMG_TYPE>::~string_art()
+string_art<IMG_TYPE>::string_art(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, const std::string &checkpoint_file, const bool _show_display, const bool _show_progress)
+    : string_art(_rgb_image, _lines, checkpoint<IMG_TYPE>::load(checkpoint_file), _show_display, _show_progress)
+{
+}
+
+template <class IMG_TYPE>
+string_art<IMG_TYPE>::string_art(std::shared_ptr<const tcimg> _rgb_image, std::shared_ptr<const line_set> _lines, checkpoint<IMG_TYPE> &&saved, const bool _show_display, const bool _show_progress)
+    :
+    #if STRING_ART_DISPLAY
+      dm(_show_display ? new display_manager<IMG_TYPE>(1024,1024,"Debug Info") : nullptr),
+    #endif
+      show_progress(_show_progress),
+      rgb_image(_rgb_image),
+      lab_image(instrumentation::timed(instrumentation::lab_image, [&]()
+                                       { return std::make_shared<const tcimg>(rgb_image->get_shared_channels(0, 2).get_RGBtoLab()); })),
+      darkness_image(std::move(saved.darkness_image)),
+      string_image(std::move(saved.string_image)),
+      region_size_map(saved.region_size_map),
+      lines(_lines),
+      pin_count(lines->pin_count),
+      layout(saved.layout),
+      pins(lines->pins.data()),
+      score_method(saved.score_method),
+      score_modifier(saved.score_modifier),
+      darkening(score_modifier),
+      score_depth(saved.score_depth),
+      line_count(lines->line_count),
+      wg_localsize(saved.wg_localsize),
+      wg_neighbor(saved.wg_neighbor),
+      line_pairs(lines->line_pairs.data()),
+      raster(lines->raster),
+      pixel_index(lines->pixel_index),
+      line_scores(std::move(saved.line_scores)),
+      line_lengths(std::move(saved.line_lengths)),
+      line_totals(std::move(saved.line_totals)),
+      culled(std::move(saved.culled)),
+      resumed_path(std::move(saved.path))
+{
+    (void)_show_display;
+    auto same_pins = [this](const vector<scoord> &other)
+    {
+        return other.size() == lines->pins.size() && std::equal(other.begin(), other.end(), lines->pins.begin(), [](const scoord &a, const scoord &b)
+                                                                { return a.x == b.x && a.y == b.y; });
+    };
+    if (!same_pins(saved.pins) || (int)line_scores.size() != line_count || (int)line_lengths.size() != line_count ||
+        (int)line_totals.size() != line_count || (int)culled.size() != line_count)
+        throw std::runtime_error("Checkpoint was made with different lines");
+    // The layout places the pins again at other resolutions (see generate_coarse_to_fine())
+    if (!same_pins(layout.place(rgb_image->width(), rgb_image->height(), pin_count)))
+        throw std::runtime_error("Checkpoint's pin layout (" + layout.name() + ") doesn't place the pins of the lines");
+    if (darkness_image.width() != rgb_image->width() || darkness_image.height() != rgb_image->height() ||
+        string_image.width() != rgb_image->width() || string_image.height() != rgb_image->height())
+        throw std::runtime_error("Checkpoint was made with a different image size");
+    for (const short pin : resumed_path)
+    {
+        if (pin < 0 || pin >= pin_count)
+            throw std::runtime_error("Checkpoint path has an invalid pin (" + std::to_string(pin) + ")");
+    }
+    if (show_progress)
+        std::cout << "Resuming from step " << resumed_path.size() << "...\n";
+    // The settings the path was generated with, so it continues the same way unless they're set again
+    set_lookahead(saved.beam_width, saved.beam_candidates);
+    stop_criteria saved_stop;
+    saved_stop.plateau_ratio = saved.plateau_ratio;
+    saved_stop.plateau_steps = saved.plateau_steps;
+    saved_stop.min_score = saved.min_score;
+    saved_stop.time_budget = saved.time_budget;
+    set_stop_criteria(saved_stop);
+    plateau_start = saved.plateau_start;
+    plateau_error = saved.plateau_error;
+    resumed_plateau = true;
+    set_error_blur(saved.error_blur);
+
+    instrumentation::scoped_timer tree_timer(instrumentation::build_trees);
+    score_tree = pin_score_tree<IMG_TYPE>(pin_count);
+    for (int i = 0; i < line_count; i++)
+    {
+        set_line_score(i, line_scores[i]);
+        if (culled[i])
+            score_tree.remove_pair(line_pairs[i].x, line_pairs[i].y);
+    }
+    set_lazy_updates(saved.lazy_updates);
+    attach_display();
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::attach_display()
+{
+#if STRING_ART_DISPLAY
+    if (dm)
+    {
+        // The compact types' coverage plane has another pixel type than the display
+        if constexpr (std::is_same<coverage_type, IMG_TYPE>::value)
+            dm->add_image(&string_image, 1);
+        if (region_size_map)
+            dm->add_image(region_size_map.get(), 2);
+        dm->add_image(&darkness_image, 0);
+        dm->set_pause(true);
+        dm->update();
+    }
+#endif //STRING_ART_DISPLAY
+}
+
+template <class IMG_TYPE>
+string_art<IMG_TYPE>::string_art(const string_art &other)
+    : string_art(other, other.score_modifier, other.score_depth)
+{
+}
+
+template <class IMG_TYPE>
+string_art<IMG_TYPE>::string_art(const string_art &other, const float _score_modifier, const short _score_depth)
+    : show_progress(false),
+      rgb_image(other.rgb_image),
+      lab_image(other.lab_image),
+      darkness_image(other.darkness_image),
+      string_image(other.string_image),
+      region_size_map(other.region_size_map),
+      lines(other.lines),
+      stages(other.stages),
+      pin_count(other.pin_count),
+      layout(other.layout),
+      pins(other.pins),
+      score_method(other.score_method),
+      score_modifier(_score_modifier),
+      darkening(score_modifier),
+      score_depth(_score_depth),
+      beam_width(other.beam_width),
+      beam_candidates(other.beam_candidates),
+      thread_count(other.thread_count),
+      line_count(other.line_count),
+      wg_localsize(other.wg_localsize),
+      wg_neighbor(other.wg_neighbor),
+      line_pairs(other.line_pairs),
+      raster(other.raster),
+      pixel_index(other.pixel_index),
+      line_scores(other.line_scores),
+      line_lengths(other.line_lengths),
+      line_totals(other.line_totals),
+      culled(other.culled),
+      lazy_updates(other.lazy_updates),
+      stale(other.stale),
+      rescore_stamps(other.rescore_stamps),
+      rescore_count(other.rescore_count),
+      error_sum(other.error_sum),
+      error_blur(other.error_blur),
+      blurred_darkness(other.blurred_darkness),
+      blurred_error_sum(other.blurred_error_sum),
+      score_tree(other.score_tree)
 {
-    delete[] pins;
-    delete[] line_scores;
-    delete[] line_pairs;
+}
 
+template <class IMG_TYPE>
+string_art<IMG_TYPE>::~string_art()
+{
 }
 
 template <class IMG_TYPE>
 short *string_art<IMG_TYPE>::generate(const short path_steps)
+{
+    short steps;
+    return generate(path_steps, steps);
+}
+
+template <class IMG_TYPE>
+short *string_art<IMG_TYPE>::generate(const short path_steps, short &steps)
 {
     if (path_steps < 2)
         throw std::domain_error("Number of steps is out of range (" + std::to_string(path_steps) + ")");
-#if defined(DEBUG)
-    //cd_image = CImg<IMG_TYPE>(cd_size, cd_size, 1, 3, 255);
-        std::deque<float> last_10_sps;
-        float runtime_seconds = 0.f;
-        float getscore_time = 0.f;
-        float update_time = 0.f;
-    bool gen_done = false;
-    short step = 0;
-    std::cout << "Calculating path...\n";
-#endif //DEBUG
+    if ((short)resumed_path.size() > path_steps)
+        throw std::domain_error("Resumed path is longer than the number of steps (" + std::to_string(resumed_path.size()) + " > " + std::to_string(path_steps) + ")");
     short *path = new short[path_steps];
-    IMG_TYPE score = 0;
+    short first_step = 1;
+    if (resumed_path.empty())
+    {
+        path[0] = best_pin();
+    }
+    else
+    {
+        std::copy(resumed_path.begin(), resumed_path.end(), path);
+        first_step = resumed_path.size();
+        resumed_path.clear();
+    }
+    if (writer)
+        writer->write(path, first_step);
+    steps = run_steps(path, path_steps, first_step);
+    last_path.assign(path, path + steps);
+    if (writer)
+        writer->flush();
+    save_final_checkpoint(path, steps);
+    return path;
+}
+
+template <class IMG_TYPE>
+short *string_art<IMG_TYPE>::generate_multi(const short path_steps, const short runs)
+{
+    if (path_steps < 2)
+        throw std::domain_error("Number of steps is out of range (" + std::to_string(path_steps) + ")");
+    if (runs < 1)
+        throw std::domain_error("Number of runs is out of range (" + std::to_string(runs) + ")");
+    // A resumed path is the winning run's, so it's continued on its own
+    if (!resumed_path.empty())
+        return generate(path_steps);
+    const short run_count = min(runs, pin_count);
 
-    path[0] = best_pin();
-    //Split into two threads for processing and display
-    #pragma omp parallel num_threads(2), shared(ai, gen_done, string_image)
+    // The first run starts where generate() would. The others start from the next-best pins.
+    vector<short> starts{best_pin()};
+    vector<short> by_score(pin_count);
+    std::iota(by_score.begin(), by_score.end(), 0);
+    std::stable_sort(by_score.begin(), by_score.end(), [this](const short a, const short b)
+                     { return root_score(a) > root_score(b); });
+    for (const short p : by_score)
     {
-    if(omp_get_thread_num() == 0) //Processing
+        if ((short)starts.size() >= run_count)
+            break;
+        if (p != starts.front())
+            starts.push_back(p);
+    }
+
+    if (show_progress)
+        std::cout << "Calculating " << run_count << " paths...\n";
+    string_art *best_run = nullptr;
+    short *best_path = nullptr;
+    float best_error = INFINITY;
+    short best_r = -1;
+    #pragma omp parallel for num_threads(run_count) schedule(dynamic)
+    for (short r = 0; r < run_count; r++)
     {
-        for (step = 1; step < path_steps; step++)
+        string_art *run = new string_art(*this);
+        short *path = new short[path_steps];
+        path[0] = starts[r];
+        run->run_steps(path, path_steps);
+        const float error = run->residual_error();
+        #pragma omp critical
         {
-    #if defined(DEBUG)
-            auto start = high_resolution_clock::now();
-            auto start_getscore = high_resolution_clock::now();
-    #endif //DEBUG && DEBUG_TIMING
+            if (show_progress)
+                std::cout << "Run " << r << ": start pin " << starts[r] << ", error " << error << '\n';
+            // Ties go to the lower run, so the result doesn't depend on which thread finishes first
+            if (best_r == -1 || error < best_error || (error == best_error && r < best_r))
+            {
+                std::swap(best_run, run);
+                std::swap(best_path, path);
+                best_error = error;
+                best_r = r;
+            }
+            delete run;
+            delete[] path;
+        }
+    }
+    if (show_progress)
+        std::cout << "Best path starts at pin " << best_path[0] << " (error " << best_error << ")\n";
+    adopt_state(*best_run);
+    delete best_run;
+    last_path.assign(best_path, best_path + path_steps);
+    if (writer)
+    {
+        writer->write(best_path, path_steps);
+        writer->flush();
+    }
+    save_final_checkpoint(best_path, path_steps);
+    return best_path;
+}
 
-            path[step] = best_pin_for(path[step - 1], score, score_depth);
+template <class IMG_TYPE>
+short *string_art<IMG_TYPE>::generate_coarse_to_fine(const short path_steps, const vector<resolution_stage> &schedule)
+{
+    if (path_steps < 2)
+        throw std::domain_error("Number of steps is out of range (" + std::to_string(path_steps) + ")");
+    if (!resumed_path.empty())
+        return generate(path_steps);
+    vector<short> path;
+    float last_scale = 0;
+    short last_steps = 0;
+    for (const resolution_stage &stage : schedule)
+    {
+        const short stage_steps = std::lround(stage.until * path_steps);
+        if (stage.scale <= last_scale || stage.scale >= 1)
+            throw std::domain_error("Stage scale is out of range (" + std::to_string(stage.scale) + ")");
+        if (stage_steps < 2 || stage_steps <= last_steps || stage_steps >= path_steps)
+            throw std::domain_error("Stage steps are out of range (" + std::to_string(stage_steps) + ")");
+        last_scale = stage.scale;
+        last_steps = stage_steps;
+    }
+    prepare_stages(schedule);
+    for (const resolution_stage &stage : schedule)
+    {
+        const short stage_steps = std::lround(stage.until * path_steps);
+        const auto stage_start = steady_clock::now();
+        const auto &stage_inputs = stages.at(stage.scale);
+        string_art stage_sa(stage_inputs.first, stage_inputs.second, layout, score_method, 1 - (1 - score_modifier) * stage.scale,
+                            score_depth, wg_localsize, wg_neighbor, false, false);
+        stage_sa.set_lazy_updates(lazy_updates);
+        stage_sa.thread_count = thread_count;
+        stage_sa.set_lookahead(beam_width, beam_candidates);
+        if (!path.empty())
+            stage_sa.carry_path(path.data(), path.size());
+        short *stage_path = stage_sa.generate(stage_steps);
+        path.assign(stage_path, stage_path + stage_steps);
+        delete[] stage_path;
+        if (show_progress)
+        {
+            const float seconds = duration_cast<microseconds>(steady_clock::now() - stage_start).count() / 1000000.f;
+            std::cout << "Stage " << stage_inputs.first->width() << 'x' << stage_inputs.first->height() << ": " << stage_steps << " steps in " << seconds << "s (error " << stage_sa.residual_error() << ")\n";
+        }
+    }
+    if (!path.empty())
+        carry_path(path.data(), path.size());
+    return generate(path_steps);
+}
 
-    #if defined(DEBUG)
-            auto stop_getscore = high_resolution_clock::now();
-            getscore_time = duration_cast<microseconds>(stop_getscore - start_getscore).count() / 1000000.f;
-            auto start_update = high_resolution_clock::now();
-    #endif //DEBUG && DEBUG_TIMINGs
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::prepare_stages(const vector<resolution_stage> &schedule)
+{
+    for (const resolution_stage &stage : schedule)
+    {
+        if (stage.scale <= 0 || stage.scale >= 1)
+            throw std::domain_error("Stage scale is out of range (" + std::to_string(stage.scale) + ")");
+        if (stages.count(stage.scale))
+            continue;
+        const int width = std::max(1L, std::lround(stage.scale * rgb_image->width()));
+        const int height = std::max(1L, std::lround(stage.scale * rgb_image->height()));
+        // Interpolation 2 (moving average) keeps thin dark features when downsampling
+        auto stage_rgb = std::make_shared<const tcimg>(rgb_image->get_resize(width, height, 1, -100, 2));
+        auto stage_lines = make_lines(*stage_rgb, layout, pin_count, lines->min_separation, raster.get_format(), show_progress);
+        stages.emplace(stage.scale, std::make_pair(stage_rgb, stage_lines));
+    }
+}
 
-            update_scores(path[step], path[step - 1]);
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::carry_path(const short *path, const short steps)
+{
+    for (short step = 0; step < steps; step++)
+    {
+        if (path[step] < 0 || path[step] >= pin_count)
+            throw std::domain_error("Carried path has an invalid pin (" + std::to_string(path[step]) + ")");
+        if (step > 0 && line_index(path[step], path[step - 1]) == pin_pair_index::none)
+            throw std::domain_error("Carried path has no line from pin " + std::to_string(path[step - 1]) + " to " + std::to_string(path[step]));
+    }
+    if (show_progress)
+        std::cout << "Carrying " << steps << " steps...\n";
+    for (short step = 1; step < steps; step++)
+    {
+        const int drawn_line = line_index(path[step], path[step - 1]);
+        image_editing::draw_line<coverage_type>(string_image, raster, drawn_line, SCORE_RESOLUTION);
+        // Same darkening as update_scores()
+        if (score_method != 1)
+        {
+            instrumentation::scoped_timer timer(instrumentation::update_darkness);
+            image_editing::multiply_line(darkness_image, raster, drawn_line, score_modifier);
+        }
+    }
+    reset_error();
+    score_all_lines();
+    if (lazy_updates)
+        stale.assign(line_count, 0);
+    for (short step = 1; step < steps; step++)
+        set_line_score(line_index(path[step], path[step - 1]), 0);
+    resumed_path.assign(path, path + steps);
+}
 
-    #if defined(DEBUG)
-            auto stop_update = high_resolution_clock::now();
-            update_time = duration_cast<microseconds>(stop_update - start_update).count() / 1000000.f;
-    #endif //DEBUG && DEBUG_TIMING
+template <class IMG_TYPE>
+float string_art<IMG_TYPE>::residual_error() const
+{
+    double total = 0;
+    cimg_for(darkness_image, p, IMG_TYPE)
+    {
+        total += (double)*p * *p;
+    }
+    const double scale = pixel_traits<IMG_TYPE>::darkness_scale;
+    return total / darkness_image.size() / (scale * scale);
+}
 
-    #if defined(DEBUG)
-            ai.set_flt("Score", score, 2);
-            auto stop = high_resolution_clock::now();
-            float step_time = duration_cast<microseconds>(stop - start).count() / 1000000.f;
-            runtime_seconds += step_time;
+template <class IMG_TYPE>
+float string_art<IMG_TYPE>::tracked_blurred_error() const
+{
+    if (error_blur == 0)
+        return tracked_error();
+    const double scale = pixel_traits<IMG_TYPE>::darkness_scale;
+    return blurred_error_sum / blurred_darkness.size() / (scale * scale);
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::set_error_blur(const short radius)
+{
+    if (radius < 0)
+        throw std::domain_error("Error blur radius is out of range (" + std::to_string(radius) + ")");
+    error_blur = radius;
+    reset_error();
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::set_stop_criteria(const stop_criteria &criteria)
+{
+    if (criteria.plateau_ratio < 0 || criteria.min_score < 0 || criteria.time_budget < 0)
+        throw std::domain_error("Stop criteria can't be negative");
+    if (criteria.plateau_steps < 1)
+        throw std::domain_error("Plateau steps are out of range (" + std::to_string(criteria.plateau_steps) + ")");
+    stop = criteria;
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::reset_error()
+{
+    error_sum = 0;
+    cimg_for(darkness_image, p, IMG_TYPE)
+    {
+        error_sum += (double)*p * *p;
+    }
+    blurred_darkness.assign();
+    blurred_error_sum = 0;
+    if (error_blur == 0)
+        return;
+    // Pixels outside the image count as 0, the same as in track_error()
+    const int width = darkness_image.width(), height = darkness_image.height();
+    const float weight = 1.f / ((2 * error_blur + 1) * (2 * error_blur + 1));
+    blurred_darkness.assign(width, height, 1, 1, 0);
+    cimg_forXY(blurred_darkness, x, y)
+    {
+        double total = 0;
+        for (int wy = std::max(0, y - error_blur); wy <= std::min(height - 1, y + error_blur); wy++)
+        {
+            for (int wx = std::max(0, x - error_blur); wx <= std::min(width - 1, x + error_blur); wx++)
+                total += darkness_image(wx, wy);
+        }
+        blurred_darkness(x, y) = total * weight;
+        blurred_error_sum += (double)blurred_darkness(x, y) * blurred_darkness(x, y);
+    }
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::track_error()
+{
+    const IMG_TYPE *darkness = darkness_image.data();
+    const int width = darkness_image.width(), height = darkness_image.height();
+    const float weight = (error_blur == 0) ? 0 : 1.f / ((2 * error_blur + 1) * (2 * error_blur + 1));
+    for (size_t i = 0; i < darkness_delta.size(); i++)
+    {
+        const uint32_t p = darkness_delta.pixels[i];
+        const double before = darkness_delta.previous[i], after = darkness[p];
+        error_sum += after * after - before * before;
+        if (error_blur == 0)
+            continue;
+        // Spread the change over the blur window of the pixel
+        const float change = (after - before) * weight;
+        const int x = p % width, y = p / width;
+        for (int wy = std::max(0, y - error_blur); wy <= std::min(height - 1, y + error_blur); wy++)
+        {
+            float *row = blurred_darkness.data(0, wy);
+            for (int wx = std::max(0, x - error_blur); wx <= std::min(width - 1, x + error_blur); wx++)
+            {
+                const double old_value = row[wx];
+                row[wx] += change;
+                blurred_error_sum += (double)row[wx] * row[wx] - old_value * old_value;
+            }
+        }
+    }
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::adopt_state(string_art &other)
+{
+    assert(other.lines == lines);
+    // Swapping keeps the images' buffers in place, so the display's pointers to them stay valid.
+    darkness_image.swap(other.darkness_image);
+    string_image.swap(other.string_image);
+    line_scores.swap(other.line_scores);
+    line_lengths.swap(other.line_lengths);
+    line_totals.swap(other.line_totals);
+    culled.swap(other.culled);
+    stale.swap(other.stale);
+    std::swap(error_sum, other.error_sum);
+    blurred_darkness.swap(other.blurred_darkness);
+    std::swap(blurred_error_sum, other.blurred_error_sum);
+    std::swap(score_tree, other.score_tree);
+}
+
+template <class IMG_TYPE>
+short string_art<IMG_TYPE>::run_steps(short *path, const short path_steps, const short first_step)
+{
+#if STRING_ART_DISPLAY
+    std::deque<float> last_10_sps;
+    auto last_print = steady_clock::now();
+#endif
+    if (show_progress)
+        std::cout << "Calculating path...\n";
+    bool gen_done = false;
+    IMG_TYPE score = 0;
+    const auto path_start = steady_clock::now();
+    short steps_done = path_steps;
+    const char *stop_reason = nullptr;
+    // A checkpoint's path continues its plateau window
+    if (!resumed_plateau)
+    {
+        plateau_start = first_step;
+        plateau_error = tracked_blurred_error();
+    }
+    resumed_plateau = false;
+
+    auto process = [&]()
+    {
+        for (short step = first_step; step < path_steps; step++)
+        {
+            {
+                instrumentation::step_timer step_timer;
+                {
+                    instrumentation::scoped_timer timer(instrumentation::select);
+                    path[step] = best_pin_for(path[step - 1], score, score_depth);
+                }
+                if (stop.min_score > 0 && score < stop.min_score * pixel_traits<IMG_TYPE>::darkness_scale)
+                {
+                    steps_done = step;
+                    stop_reason = "best score below the threshold";
+                    break;
+                }
+                instrumentation::scoped_timer timer(instrumentation::update);
+                update_scores(path[step], path[step - 1]);
+            }
+            if (stop.plateau_ratio > 0 && step + 1 - plateau_start >= stop.plateau_steps)
+            {
+                const float error = tracked_blurred_error();
+                if (plateau_error - error < stop.plateau_ratio * plateau_error)
+                {
+                    steps_done = step + 1;
+                    stop_reason = "error plateau";
+                }
+                plateau_error = error;
+                plateau_start = step + 1;
+            }
+            if (stop.time_budget > 0 && !stop_reason && duration_cast<microseconds>(steady_clock::now() - path_start).count() / 1000000.f >= stop.time_budget)
+            {
+                steps_done = step + 1;
+                stop_reason = "time budget";
+            }
+            if (writer)
+                writer->write(path[step]);
+            if (checkpointer && step % checkpoint_interval == 0)
+            {
+                instrumentation::scoped_timer timer(instrumentation::checkpoint);
+                checkpointer->submit(make_checkpoint(path, step + 1));
+            }
+            if (stop_reason)
+                break;
+
+    #if STRING_ART_DISPLAY
+            // The readout is built from the instrumentation's last step, at most 10 times a second
+            if (!show_progress || !instrumentation::enabled())
+                continue;
+            const instrumentation::step_record &last = instrumentation::last_step();
+            const double step_time = last.seconds[instrumentation::step];
             last_10_sps.push_front(1.0f / step_time);
-            if (step > 10)
+            if (last_10_sps.size() > 10)
                 last_10_sps.pop_back();
+            if (steady_clock::now() - last_print < milliseconds(100) && step + 1 < path_steps)
+                continue;
+            last_print = steady_clock::now();
+            const float runtime_seconds = duration_cast<microseconds>(last_print - path_start).count() / 1000000.f;
             float last_10_avg = std::accumulate(last_10_sps.begin(), last_10_sps.end(), 0.0f) / last_10_sps.size();
-            int total_seconds_to = (path_steps - step) / (step/runtime_seconds);
+            const short steps_run = step - first_step + 1;
+            int total_seconds_to = (path_steps - step) / (steps_run/runtime_seconds);
             int hours_to = total_seconds_to / 3600;
             int minutes_to = (total_seconds_to - hours_to * 3600) / 60;
             int seconds_to = total_seconds_to - hours_to * 3600 - minutes_to * 60;
-            ai.set_flt("Cur Steps Per Second", last_10_sps.back(), 2);
-            ai.set_percent("\% Updating", update_time / step_time, 1, true);
-            ai.set_percent("\% Getting Score", getscore_time / step_time, 1, true);
-            ai.set_percent("\% Other", 1.f - (getscore_time + update_time) / step_time, 1, true);
-            ai.set_flt("Avg Steps Per Second", (step / runtime_seconds), 2);
+            ai.set_flt("Score", score, 2);
+            ai.set_flt("Error", tracked_blurred_error(), 2);
+            ai.set_flt("Cur Steps Per Second", last_10_sps.front(), 2);
+            ai.set_percent("\% Updating", last.seconds[instrumentation::update] / step_time, 1, true);
+            ai.set_percent("\% Getting Score", last.seconds[instrumentation::select] / step_time, 1, true);
+            ai.set_percent("\% Other", 1.f - (last.seconds[instrumentation::select] + last.seconds[instrumentation::update]) / step_time, 1, true);
+            ai.set_int("Chords Touched", last.counts[instrumentation::chords_touched]);
+            ai.set_int("Pixels Visited", last.counts[instrumentation::pixels_visited]);
+            ai.set_flt("Avg Steps Per Second", (steps_run / runtime_seconds), 2);
             ai.set_flt("Local Avg Steps Per Second", last_10_avg, 2);
             ai.set_str("Est. time to completion", (std::to_string(hours_to) + ":" + std::to_string(minutes_to) + ":" + std::to_string(seconds_to)).c_str());
             ai.set_progress("Progress", step + 1, path_steps);
             std::cout << ai.to_string();
-    #endif //DEBUG
+    #endif //STRING_ART_DISPLAY
         }
         gen_done = true;
-    }
-    else //Display
+    };
+
+#if STRING_ART_DISPLAY
+    if (dm)
     {
-        while(!gen_done)
+        //Split into two threads for processing and display
+        #pragma omp parallel num_threads(2), shared(ai, gen_done, string_image)
+        {
+        if(omp_get_thread_num() == 0) //Processing
         {
-            if(!dm.is_paused())
+            process();
+        }
+        else //Display
+        {
+            while(!gen_done)
             {
-                dm.update(ai.to_string(false).c_str(),true);
-                float wait_time = 1.f/30 - dm.spf();
-                if(wait_time > 0)
+                if(!dm->is_paused())
                 {
-                    dm.wait(wait_time);
+                    dm->update(ai.to_string(false).c_str(),true);
+                    float wait_time = 1.f/30 - dm->spf();
+                    if(wait_time > 0)
+                    {
+                        dm->wait(wait_time);
+                    }
+                }
+                else
+                {
+                    dm->update_input();
+                    dm->wait(1.f/30);
                 }
-            }
-            else
-            {
-                dm.update_input();
-                dm.wait(1.f/30);
             }
         }
+        } //#PRAGMA
     }
-    } //#PRAGMA
-#ifdef DEBUG
-    std::cout << ai.end_string();
+    else
+#endif //STRING_ART_DISPLAY
+    {
+        process();
+    }
+#if STRING_ART_DISPLAY
+    if (show_progress)
+        std::cout << ai.end_string();
     ai.clear();
-#endif //DEBUG
-    return path;
+#endif //STRING_ART_DISPLAY
+    if (show_progress)
+    {
+        const float seconds = duration_cast<microseconds>(steady_clock::now() - path_start).count() / 1000000.f;
+        std::cout << "Calculated " << steps_done - first_step << " steps in " << seconds << "s (" << (steps_done - first_step) / seconds << " steps per second)\n";
+        if (stop_reason)
+            std::cout << "Stopped at step " << steps_done << ": " << stop_reason << " (error " << tracked_blurred_error() << ")\n";
+    }
+    return steps_done;
+}
+
+template <class IMG_TYPE>
+bool string_art<IMG_TYPE>::write_to_csv(const char *instruction_file)
+{
+    if (last_path.empty())
+        return false;
+    try
+    {
+        instruction_writer csv(instruction_file, instruction_writer::csv, instruction_info());
+        csv.write(last_path.data(), last_path.size());
+        csv.flush();
+        return csv.good();
+    }
+    catch (const std::runtime_error &)
+    {
+        return false;
+    }
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::set_instruction_writer(instruction_writer *_writer)
+{
+    writer = _writer;
+}
+
+template <class IMG_TYPE>
+instruction_header string_art<IMG_TYPE>::instruction_info() const
+{
+    instruction_header header;
+    header.width = rgb_image->width();
+    header.height = rgb_image->height();
+    header.pin_radius = layout.size;
+    header.score_method = score_method;
+    header.score_modifier = score_modifier;
+    header.score_depth = score_depth;
+    header.pins = lines->pins;
+    return header;
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::set_checkpoint(const std::string &checkpoint_file, const short interval)
+{
+    if (interval < 1)
+        throw std::domain_error("Checkpoint interval is out of range (" + std::to_string(interval) + ")");
+    checkpointer.reset(checkpoint_file.empty() ? nullptr : new checkpoint_writer<IMG_TYPE>(checkpoint_file));
+    checkpoint_interval = interval;
+}
+
+template <class IMG_TYPE>
+std::unique_ptr<checkpoint<IMG_TYPE>> string_art<IMG_TYPE>::make_checkpoint(const short *path, const short steps) const
+{
+    std::unique_ptr<checkpoint<IMG_TYPE>> saved(new checkpoint<IMG_TYPE>());
+    saved->layout = layout;
+    saved->score_method = score_method;
+    saved->score_modifier = score_modifier;
+    saved->score_depth = score_depth;
+    saved->wg_localsize = wg_localsize;
+    saved->wg_neighbor = wg_neighbor;
+    saved->beam_width = beam_width;
+    saved->beam_candidates = beam_candidates;
+    saved->lazy_updates = lazy_updates;
+    saved->error_blur = error_blur;
+    saved->plateau_ratio = stop.plateau_ratio;
+    saved->plateau_steps = stop.plateau_steps;
+    saved->min_score = stop.min_score;
+    saved->time_budget = stop.time_budget;
+    saved->plateau_start = plateau_start;
+    saved->plateau_error = plateau_error;
+    saved->pins = lines->pins;
+    saved->path.assign(path, path + steps);
+    saved->darkness_image = darkness_image;
+    saved->string_image = string_image;
+    saved->region_size_map = region_size_map;
+    // Lazy updates keep line_scores up to date (only the trees are stale), so the trees are rebuilt from them on resume
+    saved->line_scores = line_scores;
+    saved->line_lengths = line_lengths;
+    saved->line_totals = line_totals;
+    saved->culled = culled;
+    return saved;
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::save_final_checkpoint(const short *path, const short steps)
+{
+    if (!checkpointer)
+        return;
+    checkpointer->submit(make_checkpoint(path, steps));
+    checkpointer->wait();
+    if (checkpointer->failed() > 0)
+        std::cerr << "Failed to save " << checkpointer->failed() << " checkpoints to " << checkpointer->filename << '\n';
 }
 
 template <class IMG_TYPE>
@@ -151,7 +806,7 @@ bool string_art<IMG_TYPE>::save_string_image(const char *image_file, const bool
     tcimg save_img = (255 - string_image.get_normalize(0, 255));
     if (append_debug_info)
     {
-        tcimg dark_img = (SCORE_RESOLUTION - darkness_image) / ((float)SCORE_RESOLUTION/255.f);
+        tcimg dark_img = (darkness_max - darkness_image) / (darkness_max / 255.f);
         save_img.append(dark_img).save(image_file);
     }
     else
@@ -186,13 +841,14 @@ void string_art<IMG_TYPE>::debug_show_all_connections()
             }
         }
         
-        for(auto b : line_scores_by_pin[pin_a])
+        for(short pin_b = 0; pin_b < pin_count; pin_b++)
         {
-            scoord local_pin_b = pins[b.first]*cd_scale_mult;
-            IMG_TYPE score_gray = (255 * *b.second) / SCORE_RESOLUTION;
+            if(!has_line(pin_a, pin_b)) continue;
+            scoord local_pin_b = pins[pin_b]*cd_scale_mult;
+            IMG_TYPE score_gray = (255 * score_of(pin_a, pin_b)) / darkness_max;
             const IMG_TYPE score_color[3]{score_gray, score_gray, score_gray};
             std::stringstream score_text;
-            score_text << std::fixed << std::setprecision(1) << 255 * (*b.second / SCORE_RESOLUTION);
+            score_text << std::fixed << std::setprecision(1) << 255 * (score_of(pin_a, pin_b) / darkness_max);
             draw_line_RGB(cd_image, local_pin_a, local_pin_b,score_color);
             cd_image.draw_text(local_pin_b.x, local_pin_b.y, score_text.str().c_str(), text_color, bg_color, 1, 8);
         }
@@ -227,17 +883,15 @@ short string_art<IMG_TYPE>::best_pin()
     short best_pin_a = -1;
     short best_pin_b = -1;
     IMG_TYPE avg_a = 0, avg_b = 0;
-    for (int i = 0; i < line_count; i++)
+    for (short p = 0; p < pin_count; p++)
     {
-        if (line_pairs[i].x >= 0)
+        refresh_best(p);
+        const short to_pin = score_tree.best(p);
+        if (to_pin != pin_score_tree<IMG_TYPE>::none && score_tree.best_score(p) > best_score)
         {
-            IMG_TYPE cur_score = *line_scores_by_pin[line_pairs[i].x][line_pairs[i].y];
-            if (cur_score > best_score)
-            {
-                best_score = cur_score;
-                best_pin_a = line_pairs[i].x;
-                best_pin_b = line_pairs[i].y;
-            }
+            best_score = score_tree.best_score(p);
+            best_pin_a = p;
+            best_pin_b = to_pin;
         }
     }
     assert(best_pin_a != -1);
@@ -250,32 +904,144 @@ short string_art<IMG_TYPE>::best_pin()
 template <class IMG_TYPE>
 short string_art<IMG_TYPE>::best_pin_for(short from_pin, IMG_TYPE &score, short depth)
 {
-
     short to_pin = 0;
-    vector<short> visited{from_pin};
-    score = best_score_for(from_pin, depth, to_pin, visited);
+    if (depth > 1)
+    {
+        score = beam_search(from_pin, depth, to_pin);
+        return to_pin;
+    }
+    // Without lookahead, the best line is the root of from_pin's tree.
+    refresh_best(from_pin);
+    to_pin = score_tree.best(from_pin);
+    if (to_pin != pin_score_tree<IMG_TYPE>::none && score_tree.best_score(from_pin) > 0)
+    {
+        score = score_tree.best_score(from_pin);
+        return to_pin;
+    }
+    score = 0;
+    return nearest_connected_pin(from_pin);
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::set_lookahead(const short _beam_width, const short _beam_candidates)
+{
+    if (_beam_width < 1 || _beam_candidates < 1)
+        throw std::domain_error("Beam width and candidate count must be at least 1");
+    beam_width = _beam_width;
+    beam_candidates = _beam_candidates;
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::set_lazy_updates(const bool on)
+{
+    if (on == lazy_updates)
+        return;
+    if (on)
+    {
+        if (score_method != 0)
+            throw std::domain_error("Lazy updates need score method 0 (score method is " + std::to_string(score_method) + ")");
+        if (score_modifier > 1)
+            throw std::domain_error("Lazy updates need a score modifier of at most 1 (score modifier is " + std::to_string(score_modifier) + ")");
+        stale.assign(line_count, 0);
+        rescore_stamps.assign(line_count, -1);
+        rescore_count = 0;
+    }
+    else
+    {
+        for (int l = 0; l < line_count; l++)
+            refresh_rank(l);
+        stale.clear();
+        rescore_stamps.clear();
+    }
+    lazy_updates = on;
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::refresh_best(const short pin)
+{
+    if (!lazy_updates)
+        return;
+    // Stale scores are upper bounds, so an up-to-date root is the true best line
+    for (short to_pin = score_tree.best(pin); to_pin != pin_score_tree<IMG_TYPE>::none; to_pin = score_tree.best(pin))
+    {
+        if (!refresh_rank(line_index(pin, to_pin)))
+            break;
+    }
+}
 
-    return to_pin;
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::top_candidates(const short pin, vector<short> &out)
+{
+    score_tree.top(pin, beam_candidates, out);
+    if (!lazy_updates)
+        return;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (const short to_pin : out)
+            changed = refresh_rank(line_index(pin, to_pin)) || changed;
+        if (changed)
+            score_tree.top(pin, beam_candidates, out);
+    }
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::set_threads(const short _thread_count)
+{
+    if (_thread_count < 1)
+        throw std::domain_error("Thread count is out of range (" + std::to_string(_thread_count) + ")");
+    thread_count = _thread_count;
+    if (show_progress)
+        std::cout << "Using " << thread_count << " threads\n";
 }
 
 template <class IMG_TYPE>
 void string_art<IMG_TYPE>::score_all_lines()
 {
     vector<int> to_cull;
+    if (show_progress)
+        std::cout << "Initial scoring kernel: " << (line_kernels::avx2_enabled() ? "AVX2" : "scalar") << '\n';
+    int lines_scored = 0;
+    auto last_print = steady_clock::now();
+    instrumentation::scoped_timer scoring_timer(instrumentation::score_lines);
+    // Lines are independent here. The trees are shared, so they're filled afterwards.
+    #pragma omp parallel for num_threads(thread_count) schedule(dynamic, 64)
     for (int i = 0; i < line_count; i++)
     {
-        *line_scores_by_pin[line_pairs[i].x][line_pairs[i].y] = initial_score(line_pairs[i].x, line_pairs[i].y);
-        ai.set_int("Line", i);
-        ai.set_flt("Score", *line_scores_by_pin[line_pairs[i].x][line_pairs[i].y], 1);
-        ai.set_progress("Progress", i, line_count);
-        if (*line_scores_by_pin[line_pairs[i].x][line_pairs[i].y] < SCORE_RESOLUTION * 0.01f)
+        line_scores[i] = initial_score(line_pairs[i].x, line_pairs[i].y);
+        int done;
+        #pragma omp atomic capture
+        done = ++lines_scored;
+        // Only the first thread prints, at most 10 times a second
+        if (show_progress && omp_get_thread_num() == 0 && steady_clock::now() - last_print > milliseconds(100))
         {
-            to_cull.push_back(i);
+            last_print = steady_clock::now();
+    #if STRING_ART_DISPLAY
+            ai.set_int("Line", done);
+            ai.set_progress("Progress", done, line_count);
+            std::cout << ai.to_string();
+    #else
+            std::cout << "Scored " << done << "/" << line_count << " lines\n";
+    #endif
         }
-        std::cout << ai.to_string();
     }
-    std::cout << ai.end_string();
+#if STRING_ART_DISPLAY
+    if (show_progress)
+        std::cout << ai.end_string();
     ai.clear();
+#endif
+
+    instrumentation::scoped_timer tree_timer(instrumentation::build_trees);
+    score_tree = pin_score_tree<IMG_TYPE>(pin_count);
+    for (int i = 0; i < line_count; i++)
+    {
+        set_line_score(i, line_scores[i]);
+        if (line_scores[i] < darkness_max * 0.01f)
+        {
+            to_cull.push_back(i);
+        }
+    }
     /*
     for (int c : to_cull)
     {
@@ -293,102 +1059,168 @@ void string_art<IMG_TYPE>::update_scores(const short pin_a,const short pin_b)
         cd_image.fill(0);
     #endif
     */
-    old_string_image.assign(string_image);
-    image_editing::draw_line<IMG_TYPE>(string_image, pins[pin_a], pins[pin_b], SCORE_RESOLUTION, 3);
-    const short min_pin = min(pin_a, pin_b);
-    const short max_pin = max(pin_a, pin_b);
-    #pragma omp parallel for num_threads(16) schedule(static)
-    for (int i = 0; i < line_count; i++)
+    const int drawn_line = line_index(pin_a, pin_b);
+    image_editing::draw_line<coverage_type>(string_image, raster, drawn_line, SCORE_RESOLUTION, string_delta);
+    darken_line(drawn_line);
+    set_line_score(drawn_line, 0);
+    if (lazy_updates)
+        stale[drawn_line] = 0;
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::cover_line(const int covered_line)
+{
+    // Nothing is drawn into string_image
+    string_delta.clear();
+    // darken_line() skips the line itself, which update_scores() scores 0. It's rescored before its pixels change.
+    if (!culled[covered_line])
     {
-        if (line_pairs[i].y >= 0)
+        static thread_local vector<uint32_t> decoded;
+        update_score(covered_line, line_pixels(covered_line, decoded), raster.size(covered_line), string_delta);
+        set_line_score(covered_line, line_scores[covered_line]);
+        if (lazy_updates)
+            stale[covered_line] = 0;
+    }
+    darken_line(covered_line);
+}
+
+template <class IMG_TYPE>
+void string_art<IMG_TYPE>::darken_line(const int drawn_line)
+{
+    if (lazy_updates)
+    {
+        rescore_crossed(drawn_line);
+    }
+    else
+    {
+        pixel_index.overlaps(drawn_line, raster, overlaps);
+        const int overlap_count = overlaps.size();
+        #pragma omp parallel for num_threads(thread_count) schedule(static)
+        for (int i = 0; i < overlap_count; i++)
         {
-            if ((line_pairs[i].x < min_pin && line_pairs[i].y > min_pin && line_pairs[i].y < max_pin) ||
-                (line_pairs[i].x > min_pin && line_pairs[i].x < max_pin && line_pairs[i].y > max_pin))
+            if (!culled[overlaps.lines[i]])
             {
-                update_score(i, pin_a, pin_b, old_string_image, string_image);
+                update_score(overlaps.lines[i], overlaps.pixels_of(i), overlaps.pixel_count(i), string_delta);
             }
         }
+        // Lines that share a pin share a tree, so the trees are updated after the parallel section.
+        uint64_t chords_touched = 0, pixels_visited = raster.size(drawn_line);
+        for (int i = 0; i < overlap_count; i++)
+        {
+            const int l = overlaps.lines[i];
+            if (!culled[l])
+            {
+                score_tree.set_pair(line_pairs[l].x, line_pairs[l].y, line_scores[l]);
+                chords_touched++;
+                pixels_visited += overlaps.pixel_count(i);
+            }
+        }
+        instrumentation::count(instrumentation::chords_touched, chords_touched);
+        instrumentation::count(instrumentation::pixels_visited, pixels_visited);
     }
     switch(score_method)
     {
         case 0:
         case 2:
         default:
-            image_editing::multiply_line(darkness_image, pins[pin_a], pins[pin_b], score_modifier, 3, false);
+        {
+            instrumentation::scoped_timer timer(instrumentation::update_darkness);
+            image_editing::multiply_line(darkness_image, raster, drawn_line, score_modifier, darkness_delta);
+            track_error();
             break;
+        }
         case 1:
             break;
     }
-
-    *line_scores_by_pin[pin_a][pin_b] = 0;
-
 }
 
 template <class IMG_TYPE>
-IMG_TYPE string_art<IMG_TYPE>::update_score(const int scored_line_index, const short overlap_a, const short overlap_b, tcimg &old_string_image, tcimg &new_string_image)
+void string_art<IMG_TYPE>::rescore_crossed(const int drawn_line)
 {
+    rescored_lines.clear();
+    rescore_count++;
+    const IMG_TYPE *darkness = darkness_image.data();
+    uint64_t pixels_visited = raster.size(drawn_line);
+    if (pixel_index.get_tile_shift() == 0)
+    {
+        // Pixels are visited in ascending order, so every line's shared pixels are too: the order update_score() reads them in.
+        raster.for_each(drawn_line, [&](const uint32_t p)
+        {
+            const IMG_TYPE pixel_darkness = darkness[p];
+            const int *covering = pixel_index.lines_of(p);
+            const uint32_t covering_count = pixel_index.lines_at(p);
+            pixels_visited += covering_count;
+            for (uint32_t i = 0; i < covering_count; i++)
+            {
+                const int l = covering[i];
+                if (l == drawn_line || culled[l])
+                    continue;
+                if (rescore_stamps[l] != rescore_count)
+                {
+                    rescore_stamps[l] = rescore_count;
+                    rescored_lines.push_back(l);
+                }
+                line_totals[l] = darken_pixel(line_totals[l], pixel_darkness);
+            }
+        });
+    }
+    else
+    {
+        // Tiles only index candidate lines, so the shared pixels come from the overlap lists
+        pixel_index.overlaps(drawn_line, raster, overlaps);
+        for (size_t i = 0; i < overlaps.size(); i++)
+        {
+            const int l = overlaps.lines[i];
+            if (culled[l])
+                continue;
+            rescored_lines.push_back(l);
+            const uint32_t *shared = overlaps.pixels_of(i);
+            for (size_t j = 0; j < overlaps.pixel_count(i); j++)
+                line_totals[l] = darken_pixel(line_totals[l], darkness[shared[j]]);
+            pixels_visited += overlaps.pixel_count(i);
+        }
+    }
+    for (const int l : rescored_lines)
+    {
+        if (line_lengths[l] == 0)
+            continue;
+        line_scores[l] = updated_score(l, line_totals[l] / line_lengths[l]);
+        stale[l] = 1;
+    }
+    instrumentation::count(instrumentation::chords_touched, rescored_lines.size());
+    instrumentation::count(instrumentation::pixels_visited, pixels_visited);
+}
 
-    short scored_a = line_pairs[scored_line_index].x;
-    short scored_b = line_pairs[scored_line_index].y;
-    //CImg<u_char> overlap_debug(darkness_image.width(), darkness_image.height(), 1, 1, 0);
-   // image_editing::draw_line<u_char>(overlap_debug, pins[scored_a], pins[scored_b], 100);
-    CImg<u_short>& slice = slices[scored_line_index / (line_count / slices.size())];
-    float line_length = line_lengths[scored_a][scored_b];
+template <class IMG_TYPE>
+IMG_TYPE string_art<IMG_TYPE>::update_score(const int scored_line_index, const uint32_t *shared_pixels, const size_t shared_count, [[maybe_unused]] const pixel_delta<coverage_type> &string_delta)
+{
+    float line_length = line_lengths[scored_line_index];
     float new_score = 0;
-    if(line_length == 0) return *line_scores_by_pin[scored_a][scored_b];
+    if(line_length == 0) return line_scores[scored_line_index];
 
     switch (score_method)
     {
     case 0:
     default:
     {
-        line<IMG_TYPE> intersection =  line<IMG_TYPE>(pins[overlap_a], pins[overlap_b], &darkness_image) & line<IMG_TYPE>(pins[scored_a], pins[scored_b]);
-        //If the center of the intersecting point is outside of the mask, it has no influence on the score.
-        if(*(intersection.begin() + intersection.size()/2) == 0)
-            return *line_scores_by_pin[scored_a][scored_b];
-        new_score = ((float)*line_scores_by_pin[scored_a][scored_b]) * line_length;
-        
-        //image_editing::draw_line<u_char>(overlap_debug, pins[overlap_a], pins[overlap_b], 150);
-
-        for(auto p = intersection.begin(); p < intersection.end(); p++)
+        const IMG_TYPE *darkness = darkness_image.data();
+        new_score = line_totals[scored_line_index];
+        for(size_t i = 0; i < shared_count; i++)
         {
-            if(slice(p.get_pos().x,p.get_pos().y))
-            {
-                //overlap_debug(p.get_pos().x,p.get_pos().y) = 255;
-                float cur_score = *p;
-                //float left_score = *(p.left());
-                //float right_score = *(p.right());
-                if (cur_score > 0.01f)
-                {
-                    new_score -= cur_score;
-                    new_score += cur_score * score_modifier;                    
-                }
-                /*/
-                if ((wg_neighbor != 0) && (left_score > 0.01f))
-                {
-                    new_score -= left_score * wg_neighbor;
-                    new_score  += left_score * score_modifier * wg_neighbor;
-                }
-                if ((wg_neighbor != 0) && (right_score > 0.01f))
-                {
-                    new_score += right_score * wg_neighbor;
-                    total_add += right_score * score_modifier * wg_neighbor;
-                }*/
-            }
+            new_score = darken_pixel(new_score, darkness[shared_pixels[i]]);
         }
+        line_totals[scored_line_index] = new_score;
         new_score /= line_length;
-        //overlap_debug.display();
-        //slice.display();
         break;
     }
     /*
     case 1:
     {
         line_intersection_iterator<IMG_TYPE> lii(darkness_image, pins[scored_a], pins[scored_b], pins[overlap_a], pins[overlap_b], 3);
-        if(darkness_image(lii.get_center().x, lii.get_center().y) == 0) return *line_scores_by_pin[scored_a][scored_b];
+        if(darkness_image(lii.get_center().x, lii.get_center().y) == 0) return line_scores[scored_line_index];
 
         std::deque<scoord> line_coords(3);
-        new_score = ((float)*line_scores_by_pin[scored_a][scored_b]) * line_length;
+        new_score = ((float)line_scores[scored_line_index]) * line_length;
         // Assign the first three pixels in the line
         line_coords[0] = lii.cur_coord();
         lii.step();
@@ -398,10 +1230,10 @@ IMG_TYPE string_art<IMG_TYPE>::update_score(const int scored_line_index, const s
         // Iterate through the rest of the line
         do
         {
-            float cur_score =  score_square(new_string_image, line_coords);
+            float cur_score =  score_square(string_image, line_coords);
             if(cur_score != 0)
             {
-                new_score -= score_square(old_string_image, line_coords);
+                new_score -= score_square(string_image, line_coords, &string_delta);
                 new_score += cur_score;
             }
             line_coords.pop_front();
@@ -413,9 +1245,9 @@ IMG_TYPE string_art<IMG_TYPE>::update_score(const int scored_line_index, const s
     case 2: // Root mean square error
     { 
         line_intersection_iterator<IMG_TYPE> lii(darkness_image, pins[scored_a], pins[scored_b], pins[overlap_a], pins[overlap_b], 3);
-        if(darkness_image(lii.get_center().x, lii.get_center().y) == 0) return *line_scores_by_pin[scored_a][scored_b];
+        if(darkness_image(lii.get_center().x, lii.get_center().y) == 0) return line_scores[scored_line_index];
 
-        new_score = pow(*line_scores_by_pin[scored_a][scored_b], 2) * line_length;
+        new_score = pow(line_scores[scored_line_index], 2) * line_length;
         do
         {
             if(lii.is_within_itersection())
@@ -449,110 +1281,26 @@ IMG_TYPE string_art<IMG_TYPE>::update_score(const int scored_line_index, const s
     }
     */
     } //switch(score_method)
-    *line_scores_by_pin[scored_a][scored_b] = (IMG_TYPE)new_score;
-    return new_score;
-}
-
-template <class IMG_TYPE>
-void string_art<IMG_TYPE>::build_lines(short min_separation)
-{
-    line_scores = new IMG_TYPE[line_count];
-    line_pairs = new scoord[line_count];
-    int i = 0;
-    for(short p_origin = 0; p_origin < pin_count; p_origin += 2)
-    {
-        int local_lines_drawn = 0;
-        for(int offset = 0; offset < pin_count; offset++)
-        {
-            short p_a = (p_origin - (offset/2) + pin_count) % pin_count;
-            short p_b = (p_origin + (offset/2) + (offset%2)) % pin_count;
-            short o = min(min(abs(p_b - p_a), abs((pin_count-p_b)+p_a)), abs((pin_count-p_a)+p_b));
-            if(o >= min_separation)
-            {
-                line_scores[i] = 0;
-                line_scores_by_pin[p_a][p_b] = &(line_scores[i]);
-                line_scores_by_pin[p_b][p_a] = line_scores_by_pin[p_a][p_b];
-                line_pairs[i].x = p_a;
-                line_pairs[i].y = p_b;
-                i++;
-            }
-        }
-    }
-    /*
-    for (short a = 0; a < pin_count; a++)
-    {
-        int b_start = (a + min_separation);
-        int b_end = min(pin_count, (short)((pin_count + a - min_separation) + 1));
-        for (short b = b_start; b < b_end; b++)
-        {
-            line_scores[i] = 0;
-            line_scores_by_pin[a][b] = &(line_scores[i]);
-            line_scores_by_pin[b][a] = line_scores_by_pin[a][b];
-
-            line_pairs[i].x = a;
-            line_pairs[i].y = b;
-            i++;
-        }
-    }
-    */
-}
-
-template <class IMG_TYPE>
-vector<coord<short>> string_art<IMG_TYPE>::overlapping_lines(short pin_a, short pin_b)
-{
-    vector<scoord> lines;
-    short min_pin = min(pin_a, pin_b);
-    short max_pin = max(pin_a, pin_b);
-    for (int i = 0; i < line_count; i++)
-    {
-        if (line_pairs[i].x >= 0)
-        {
-            if ((line_pairs[i].x < min_pin && line_pairs[i].y > min_pin && line_pairs[i].y < max_pin) ||
-                (line_pairs[i].x > min_pin && line_pairs[i].x < max_pin && line_pairs[i].y > max_pin))
-            {
-                lines.push_back(line_pairs[i]);
-            }
-        }
-    }
-    return lines;
+    line_scores[scored_line_index] = updated_score(scored_line_index, new_score);
+    return line_scores[scored_line_index];
 }
 
 template <class IMG_TYPE>
 IMG_TYPE string_art<IMG_TYPE>::initial_score(const short pin_a, const short pin_b)
 {
     float score = 0;
-    line<IMG_TYPE> a_b(pins[pin_a],pins[pin_b], &darkness_image);
+    const int scored_line = line_index(pin_a, pin_b);
+    const IMG_TYPE *darkness = darkness_image.data();
     float masked_length = 0;
     switch (score_method)
     {
     case 0: //Line darkening
     default:
     {
-        for(auto p = a_b.begin() + 3; p < a_b.end() - 3; p++)
-        {
-            float cur_score = *p;
-            //float left_score = *(p.left());
-            //float right_score = *(p.right());
-            float total_add = 0;
-            if (cur_score > 0)
-            {
-                score += cur_score;
-                masked_length++;
-            }
-            /*
-            if (left_score > 0)
-            {
-                total_add += left_score * wg_neighbor;
-                masked_length += wg_neighbor;
-            }
-            if (right_score > 0)
-            {
-                total_add += right_score * wg_neighbor;
-                masked_length += wg_neighbor;
-            }
-            */
-            score += total_add;
-        }
+        static thread_local vector<uint32_t> decoded;
+        const uint32_t *pixels = line_pixels(scored_line, decoded);
+        line_kernels::masked_sum(darkness, pixels, raster.size(scored_line), score, masked_length);
+        line_totals[scored_line] = score;
         if(masked_length > 0) score /= masked_length;
         break;
     }
@@ -598,13 +1346,12 @@ IMG_TYPE string_art<IMG_TYPE>::initial_score(const short pin_a, const short pin_
     }
     */
     }
-    line_lengths[pin_a][pin_b] = masked_length;
-    line_lengths[pin_b][pin_a] = masked_length;
+    line_lengths[scored_line] = masked_length;
     return score;
 }
 
 template <class IMG_TYPE>
-IMG_TYPE string_art<IMG_TYPE>::score_square(const tcimg &string_image_ref, std::deque<scoord> &line_coords)
+IMG_TYPE string_art<IMG_TYPE>::score_square(const ccimg &string_image_ref, std::deque<scoord> &line_coords, const pixel_delta<coverage_type> *undo)
 {
     scoord bot_left, top_right, cur_coord;
     float img_sum = 0;
@@ -627,9 +1374,12 @@ IMG_TYPE string_art<IMG_TYPE>::score_square(const tcimg &string_image_ref, std::
                 ++square_area;
                 img_sum += cur_val;
                 // Add to the string score if the point is on the string map, or if it's in the given list of coords.
-                if (string_image_ref(cur_coord.x, cur_coord.y) > 0)
+                coverage_type string_val = string_image_ref(cur_coord.x, cur_coord.y);
+                if (undo != nullptr)
+                    string_val = undo->before(cur_coord.y * string_image_ref.width() + cur_coord.x, string_val);
+                if (string_val > 0)
                 {
-                    line_sum += SCORE_RESOLUTION;
+                    line_sum += darkness_max;
                     /*
                     #if defined(DEBUG) && defined(DEBUG_SCORING)
                     if(show_pixel_scoring)
@@ -641,7 +1391,7 @@ IMG_TYPE string_art<IMG_TYPE>::score_square(const tcimg &string_image_ref, std::
                 }
                 else if (std::find(line_coords.begin(), line_coords.end(), cur_coord) != line_coords.end())
                 {
-                    new_line_sum += SCORE_RESOLUTION;
+                    new_line_sum += darkness_max;
                     /*
                     #if defined(DEBUG) && defined(DEBUG_SCORING)
                     if(show_pixel_scoring)
@@ -665,7 +1415,7 @@ IMG_TYPE string_art<IMG_TYPE>::score_square(const tcimg &string_image_ref, std::
     float existing_diff = image_score - existing_score;
     float potential_diff = image_score - potential_score;
     // Percent similarity of potential (100% = same, 0% = white to black)
-    float potential_p_similarity = (1.f - (potential_diff / SCORE_RESOLUTION));
+    float potential_p_similarity = (1.f - (potential_diff / darkness_max));
     // Potential reduction in image difference (negative if potential is worse)
     float score = (existing_diff > 0) ? existing_diff - abs(potential_diff) : potential_diff - existing_diff;
     score *= potential_p_similarity;
@@ -717,134 +1467,134 @@ IMG_TYPE string_art<IMG_TYPE>::score_square(const tcimg &string_image_ref, std::
 template <class IMG_TYPE>
 void string_art<IMG_TYPE>::cull_line(const int line_index)
 {
-    line_scores_by_pin[line_pairs[line_index].x].erase(line_pairs[line_index].y);
-    line_scores_by_pin[line_pairs[line_index].y].erase(line_pairs[line_index].x);
-    line_lengths[line_pairs[line_index].x].erase(line_pairs[line_index].y);
-    line_lengths[line_pairs[line_index].y].erase(line_pairs[line_index].x);
-    line_pairs[line_index].x = -1;
-    line_pairs[line_index].y = -1;
+    culled[line_index] = 1;
+    score_tree.remove_pair(line_pairs[line_index].x, line_pairs[line_index].y);
+    line_lengths[line_index] = 0;
 }
 
 template <class IMG_TYPE>
-IMG_TYPE string_art<IMG_TYPE>::best_score_for(short from_pin, short depth, short &to_pin, vector<short> &visited)
+IMG_TYPE string_art<IMG_TYPE>::beam_search(short from_pin, short depth, short &to_pin)
 {
-    if (depth == 0)
-        return 0;
-    short best_pin = -1;
-    IMG_TYPE best_score = 0;
-
-    for (auto b : line_scores_by_pin[from_pin])
+    struct beam_path
     {
-        short cur_pin = b.first;
-        IMG_TYPE cur_score = *b.second;
-        for (short v : visited)
-        {
-            if (to_pin == v)
-                continue;
-        }
-        if (cur_score != 0)
+        vector<short> pins;
+        vector<int> lines;
+        float score;
+    };
+    lookahead_losses.clear();
+    vector<beam_path> beam{{{from_pin}, {}, 0.f}};
+    vector<beam_path> next;
+    vector<short> candidates;
+    for (short level = 0; level < depth; level++)
+    {
+        next.clear();
+        for (const beam_path &path : beam)
         {
-            visited.push_back(to_pin);
-            cur_score += best_score_for(to_pin, depth - 1, to_pin, visited);
-            visited.pop_back();
-            if (cur_score > best_score)
+            top_candidates(path.pins.back(), candidates);
+            for (const short cur_pin : candidates)
             {
-                best_pin = cur_pin;
-                best_score = cur_score;
+                if (std::find(path.pins.begin(), path.pins.end(), cur_pin) != path.pins.end())
+                    continue;
+                const int cur_line = line_index(path.pins.back(), cur_pin);
+                const float cur_score = lookahead_score(cur_line, path.lines);
+                if (cur_score <= 0)
+                    continue;
+                next.push_back(path);
+                next.back().pins.push_back(cur_pin);
+                next.back().lines.push_back(cur_line);
+                next.back().score += cur_score;
             }
         }
+        if (next.empty())
+            break;
+        std::stable_sort(next.begin(), next.end(), [](const beam_path &a, const beam_path &b)
+                         { return a.score > b.score; });
+        if ((short)next.size() > beam_width)
+            next.resize(beam_width);
+        beam.swap(next);
     }
     // If no suitable neighbor was found, return the nearest neighbor
-    if (best_pin == -1)
+    if (beam.front().pins.size() < 2)
     {
-        for(short i = from_pin + 1; i != from_pin; i = (i+1) % pin_count)
-        {
-            auto b = line_scores_by_pin[from_pin].find(i);
-            if(b != line_scores_by_pin[from_pin].end())
-            {
-                best_pin = i;
-                break;
-            }
-        }
-        assert(best_pin != -1);
+        to_pin = nearest_connected_pin(from_pin);
+        return 0;
+    }
+    to_pin = beam.front().pins[1];
+    return beam.front().score;
+}
 
+template <class IMG_TYPE>
+float string_art<IMG_TYPE>::lookahead_score(const int line, const vector<int> &path_lines)
+{
+    float score = line_scores[line];
+    if (path_lines.empty() || line_lengths[line] == 0)
+        return score;
+    float loss = 0;
+    for (const int drawn_line : path_lines)
+    {
+        loss += lookahead_loss(drawn_line, line);
     }
-    to_pin = best_pin;
-    return best_score;
+    return score - loss / line_lengths[line];
 }
 
-template <typename IMG_TYPE>
-CImgList<u_short> string_art<IMG_TYPE>::map_lines_to_slices()
+template <class IMG_TYPE>
+float string_art<IMG_TYPE>::lookahead_loss(const int drawn_line, const int line)
 {
-    CImgList<u_short> slices;
-    int lines_drawn = 0;
-    map<short,map<short,bool>> pairs_made;
-    for(short p_origin = 0; p_origin < pin_count; p_origin += 2)
+    auto table = lookahead_losses.find(drawn_line);
+    if (table == lookahead_losses.end())
     {
-        CImg<u_short> slice(darkness_image.width(), darkness_image.height(), 1, 1, 0);
-        int local_lines_drawn = 0;
-        for(int offset = 0; offset < pin_count; offset++)
+        // Same darkening as update_score(), summed per overlapping line.
+        vector<pair<int, float>> losses;
+        const IMG_TYPE *darkness = darkness_image.data();
+        pixel_index.overlaps(drawn_line, raster, lookahead_overlaps);
+        losses.reserve(lookahead_overlaps.size());
+        for (size_t i = 0; i < lookahead_overlaps.size(); i++)
         {
-            short p_a = (p_origin - (offset/2) + pin_count) % pin_count;
-            short p_b = (p_origin + (offset/2) + (offset%2)) % pin_count;
-            auto sub_a = line_scores_by_pin[p_a];
-            auto sub_b = sub_a.find(p_b);
-            if(sub_b != sub_a.end())
+            float loss = 0;
+            const uint32_t *shared = lookahead_overlaps.pixels_of(i);
+            for (size_t p = 0; p < lookahead_overlaps.pixel_count(i); p++)
             {
-                u_short pair_index = lines_drawn;
-                image_editing::draw_line<u_short>(slice, pins[p_a], pins[p_b], pair_index, 3);
-                pairs_made[p_a][p_b] = true;
-                pairs_made[p_b][p_a] = true;
-                lines_drawn++;
+                float cur_score = darkness[shared[p]];
+                if (cur_score > 0.01f)
+                    loss += cur_score * (1.f - score_modifier);
             }
+            losses.emplace_back(lookahead_overlaps.lines[i], loss);
         }
-        slices.push_back(slice);
+        table = lookahead_losses.emplace(drawn_line, std::move(losses)).first;
     }
-    assert(lines_drawn == line_count);
-    for(int i=0; i < line_count; i++)
-    {
-        assert(pairs_made.find(line_pairs[i].x) != pairs_made.end());
-        assert(pairs_made[line_pairs[i].x].find(line_pairs[i].y) != pairs_made[line_pairs[i].x].end());
-    }
-    return slices;
-    //A line pair's index (p) corresponds to its slice index (s) by: floor(p / (line_count/slice_count))
+    auto entry = std::lower_bound(table->second.begin(), table->second.end(), pair<int, float>(line, -INFINITY));
+    if (entry == table->second.end() || entry->first != line)
+        return 0;
+    return entry->second;
 }
 
-template <typename IMG_TYPE>
-coord<short> *string_art<IMG_TYPE>::circular_pins(const tcimg &image, float radius, short pin_count)
+template <class IMG_TYPE>
+short string_art<IMG_TYPE>::nearest_connected_pin(short from_pin) const
 {
-    scoord *pins = new scoord[pin_count];
-    scoord center(image.width() / 2, image.height() / 2);
-    for (int i = 0; i < pin_count; i++)
+    for (short i = (from_pin + 1) % pin_count; i != from_pin; i = (i + 1) % pin_count)
     {
-        float angle = (2.f * 3.14159f * i) / pin_count;
-        pins[i].x = center.x + std::cos(angle) * radius * image.width() / 2;
-        pins[i].y = center.y + std::sin(angle) * radius * image.height() / 2;
+        if (has_line(from_pin, i))
+        {
+            return i;
+        }
     }
-    return pins;
+    assert(false && "Pin has no remaining lines");
+    return -1;
 }
 
-
-/**
- * @details  If you map the possible connections on a 2D grid, they can be re-organized into a rectangle and a triangle.
- * This sums the areas of those two shapes. <br>
- * \f{eqnarray*}
- *   & \textrm{Rectangle area:} & (c-2s+1) \times s \\
- *   & \textrm{Triangle area:}  & \frac{ (c-2s) \times(c-2s+1)}{2} \\
- *   & \textrm{Total area:}     & \frac{c^2-2cs + c}{2}
- * \f}
- */
 template <typename IMG_TYPE>
-int string_art<IMG_TYPE>::calculate_line_count(int pin_count, int min_separation)
+std::shared_ptr<const line_set> string_art<IMG_TYPE>::make_lines(const tcimg &rgb_image, const pin_layout &layout, const short pin_count, const short min_separation, const line_raster::encoding raster_encoding, const bool show_progress)
 {
-    return (pin_count * pin_count - 2 * pin_count * min_separation + pin_count) / 2;
+    instrumentation::scoped_timer timer(instrumentation::build_lines);
+    const vector<scoord> pins = layout.place(rgb_image.width(), rgb_image.height(), pin_count);
+    return std::make_shared<const line_set>(rgb_image.width(), rgb_image.height(), pins, min_separation, layout.border_pairs(pins),
+                                            raster_encoding, PIXEL_INDEX_TILE_SHIFT, show_progress);
 }
 
-
 template <typename IMG_TYPE>
 CImg<IMG_TYPE> string_art<IMG_TYPE>::make_region_size_map()
 {
-    CImg<IMG_TYPE> image = image_analysis<IMG_TYPE>::sized_light_regions(darkness_image.get_blur_median(3), (IMG_TYPE)(0.1f*SCORE_RESOLUTION), true);
+    CImg<IMG_TYPE> image = image_analysis<IMG_TYPE>::sized_light_regions(darkness_image.get_blur_median(3), (IMG_TYPE)(0.1f*darkness_max), true);
     
     cimg_forXY(image, x, y)
     {
@@ -858,6 +1608,7 @@ CImg<IMG_TYPE> string_art<IMG_TYPE>::make_region_size_map()
 template <typename IMG_TYPE>
 cimg_library::CImg<IMG_TYPE> string_art<IMG_TYPE>::make_rgb_image(const char *image_file, short resolution)
 {
+    instrumentation::scoped_timer timer(instrumentation::load_image);
     tcimg rgb_image(image_file);
     rgb_image.resize(resolution, resolution * rgb_image.width() / rgb_image.height(), 1, rgb_image.spectrum());
 
@@ -865,29 +1616,12 @@ cimg_library::CImg<IMG_TYPE> string_art<IMG_TYPE>::make_rgb_image(const char *im
 }
 
 template <typename IMG_TYPE>
-cimg_library::CImg<IMG_TYPE> string_art<IMG_TYPE>::make_darkness_image(const tcimg &rgb_image, const float radius)
+cimg_library::CImg<IMG_TYPE> string_art<IMG_TYPE>::make_darkness_image(const tcimg &rgb_image, const pin_layout &layout, const bool show_progress)
 {
     tcimg b_w = 255 - (0.299 * rgb_image.get_shared_channel(0) +
                        0.587 * rgb_image.get_shared_channel(1) +
                        0.114 * rgb_image.get_shared_channel(2));
-    tcimg mask;
-    if(rgb_image.spectrum() == 4)
-    {
-        mask = rgb_image.get_channel(3).threshold(1.f);
-    }
-    else
-    {
-        mask = tcimg(rgb_image.width(), rgb_image.height(), 1, 1, 1.f);
-    }
-    float sqr_img_rad = pow(radius*rgb_image.width()/2, 2);
-    scoord center(rgb_image.width()/2, rgb_image.height()/2);
-    cimg_forXY(mask, x, y)
-    {
-        if(pow(x - center.x,2) + pow(y - center.y,2) > sqr_img_rad)
-        {
-            mask(x,y) = 0;
-        }
-    }
+    const tcimg mask = make_mask(rgb_image, layout);
     b_w.mul(mask);
     CImg<float> hist = b_w.get_histogram(256);
     int cut_threshold = 255;
@@ -900,17 +1634,31 @@ cimg_library::CImg<IMG_TYPE> string_art<IMG_TYPE>::make_darkness_image(const tci
     b_w.cut(0,cut_threshold);
     b_w.equalize(255, 1, cut_threshold);
     b_w.normalize(0,255);
-    std::cout << "End min/max: " << b_w.min() << ',' << b_w.max() << '\n';
+    if (pixel_traits<IMG_TYPE>::darkness_scale != 1)
+        b_w *= pixel_traits<IMG_TYPE>::darkness_scale;
+    if (show_progress)
+        std::cout << "End min/max: " << b_w.min() << ',' << b_w.max() << '\n';
     return b_w;
 }
 
 template <typename IMG_TYPE>
-void string_art<IMG_TYPE>::weight_darkness_image()
+cimg_library::CImg<IMG_TYPE> string_art<IMG_TYPE>::make_mask(const tcimg &rgb_image, const pin_layout &layout)
 {
-    darkness_image.mul(1 + region_size_map * wg_localsize);
-
+    tcimg mask;
+    if(rgb_image.spectrum() == 4)
+    {
+        mask = rgb_image.get_channel(3).threshold(1.f);
+    }
+    else
+    {
+        mask = tcimg(rgb_image.width(), rgb_image.height(), 1, 1, 1.f);
+    }
+    mask.mul(layout.mask(rgb_image.width(), rgb_image.height()));
+    return mask;
 }
 
 template class string_art<short>;
 template class string_art<int>;
-template class string_art<float>;
\ No newline at end of file
+template class string_art<float>;
+template class string_art<u_char>;
+template class string_art<u_short>;
\ No newline at end of file
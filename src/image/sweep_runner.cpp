@@ -0,0 +1,439 @@
+#include <sweep_runner.hpp>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <omp.h>
+
+std::string sweep_job::output_name() const
+{
+    std::stringstream filename;
+    filename << std::fixed << std::setprecision(2) << image_file.substr(0, image_file.find_last_of('.')) <<
+            "_mod=" << score_modifier <<
+            "_s=" << steps <<
+            "_r=" << resolution <<
+            "_meth=" << (int)score_method <<
+            "_d=" << score_depth <<
+            "_wgsz=" << localsize_weight <<
+            "_wgng=" << neighbor_weight <<
+            "_p=" << pin_count <<
+            "_sep=" << min_separation <<
+            "_rad=" << pin_radius;
+    if (layout != "circle")
+    {
+        const std::string layout_name = layout.substr(layout.find_last_of('/') + 1);
+        filename << "_layout=" << layout_name.substr(0, layout_name.find_last_of('.'));
+    }
+    if (!schedule.empty())
+    {
+        filename << "_c2f";
+        for (const resolution_stage &stage : schedule)
+            filename << '=' << stage.scale << 'x' << stage.until;
+    }
+    // Parameters that are usually left at their defaults
+    filename << std::defaultfloat;
+    if (runs != 1)
+        filename << "_runs=" << runs;
+    if (lazy)
+        filename << "_lazy";
+    if (stop.plateau_ratio > 0)
+        filename << "_plat=" << stop.plateau_ratio << 'x' << stop.plateau_steps;
+    if (stop.min_score > 0)
+        filename << "_minsc=" << stop.min_score;
+    if (stop.time_budget > 0)
+        filename << "_budget=" << stop.time_budget;
+    if (error_blur != 0)
+        filename << "_blur=" << error_blur;
+    filename << ".png";
+    return filename.str();
+}
+
+namespace
+{
+    /** @brief Split a string on a delimiter, skipping empty parts */
+    vector<std::string> split(const std::string &text, const char delimiter)
+    {
+        vector<std::string> parts;
+        std::stringstream stream(text);
+        std::string part;
+        while (std::getline(stream, part, delimiter))
+        {
+            if (!part.empty())
+                parts.push_back(part);
+        }
+        return parts;
+    }
+
+    /** @brief Set one job parameter from its config value */
+    void set_value(sweep_job &job, const std::string &key, const std::string &value)
+    {
+        if (key == "image")
+            job.image_file = value;
+        else if (key == "output")
+            job.output_file = value;
+        else if (key == "resolution")
+            job.resolution = std::stoi(value);
+        else if (key == "pins")
+            job.pin_count = std::stoi(value);
+        else if (key == "radius")
+            job.pin_radius = std::stof(value);
+        else if (key == "layout")
+            job.layout = value;
+        else if (key == "separation")
+            job.min_separation = std::stoi(value);
+        else if (key == "method")
+            job.score_method = std::stoi(value);
+        else if (key == "modifier")
+            job.score_modifier = std::stof(value);
+        else if (key == "depth")
+            job.score_depth = std::stoi(value);
+        else if (key == "wg_localsize")
+            job.localsize_weight = std::stof(value);
+        else if (key == "wg_neighbor")
+            job.neighbor_weight = std::stof(value);
+        else if (key == "steps")
+            job.steps = std::stoi(value);
+        else if (key == "runs")
+            job.runs = std::stoi(value);
+        else if (key == "lazy")
+            job.lazy = std::stoi(value) != 0;
+        else if (key == "instructions")
+        {
+            if (value != "csv" && value != "binary" && value != "none")
+                throw std::invalid_argument("Unknown instruction format \"" + value + "\"");
+            job.instructions = (value == "none") ? "" : value;
+        }
+        else if (key == "plateau")
+            job.stop.plateau_ratio = std::stof(value);
+        else if (key == "plateau_steps")
+            job.stop.plateau_steps = std::stoi(value);
+        else if (key == "min_score")
+            job.stop.min_score = std::stof(value);
+        else if (key == "budget")
+            job.stop.time_budget = std::stof(value);
+        else if (key == "error_blur")
+            job.error_blur = std::stoi(value);
+        else if (key == "schedule")
+        {
+            job.schedule.clear();
+            if (value == "none")
+                return;
+            for (const std::string &stage : split(value, '/'))
+            {
+                const size_t colon = stage.find(':');
+                if (colon == std::string::npos)
+                    throw std::invalid_argument("Expected scale:until, got \"" + stage + "\"");
+                job.schedule.push_back({std::stof(stage.substr(0, colon)), std::stof(stage.substr(colon + 1))});
+            }
+        }
+        else
+            throw std::invalid_argument("Unknown sweep parameter \"" + key + "\"");
+    }
+
+    /**
+     * @brief Why a job can't run, or an empty string if it can
+     * @details Checked while reading, so a bad job stops the sweep before anything runs, instead of failing in the middle.
+     */
+    std::string job_problem(const sweep_job &job)
+    {
+        if (job.image_file.empty())
+            return "job has no image";
+        if (!std::ifstream(job.image_file))
+            return "could not open image " + job.image_file;
+        try
+        {
+            pin_layout::parse(job.layout, job.pin_radius);
+        }
+        catch (const std::exception &e)
+        {
+            return e.what();
+        }
+        if (job.min_separation < 1)
+            return "separation must be at least 1";
+        if (job.min_separation > job.pin_count / 2)
+            return "separation must be at most half the pin count";
+        if (job.steps < 1 || job.runs < 1)
+            return "steps and runs must be at least 1";
+        if (job.lazy && job.score_method != 0)
+            return "lazy updates need score method 0";
+        if (job.lazy && job.score_modifier > 1)
+            return "lazy updates need a score modifier of at most 1";
+        return "";
+    }
+}
+
+template <typename IMG_TYPE>
+sweep_runner<IMG_TYPE>::sweep_runner(const short _thread_budget, const std::string &_instrumentation_file)
+    : thread_budget(_thread_budget), instrumentation_file(_instrumentation_file)
+{
+    if (thread_budget < 1)
+        throw std::domain_error("Thread budget is out of range (" + std::to_string(thread_budget) + ")");
+}
+
+template <typename IMG_TYPE>
+vector<sweep_job> sweep_runner<IMG_TYPE>::read_jobs(const char *config_file)
+{
+    std::ifstream file(config_file);
+    if (!file)
+        throw std::runtime_error(std::string("Could not open sweep config ") + config_file);
+    vector<sweep_job> jobs;
+    sweep_job defaults;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line))
+    {
+        line_number++;
+        std::stringstream line_stream(line.substr(0, line.find('#')));
+        vector<std::string> tokens;
+        for (std::string token; line_stream >> token;)
+            tokens.push_back(token);
+        if (tokens.empty())
+            continue;
+        const bool is_default = (tokens.front() == "default");
+        if (is_default)
+            tokens.erase(tokens.begin());
+
+        // Expand comma-separated values into every combination
+        vector<sweep_job> expanded{defaults};
+        for (const std::string &token : tokens)
+        {
+            const size_t equals = token.find('=');
+            if (equals == std::string::npos)
+                throw std::invalid_argument(std::string(config_file) + ":" + std::to_string(line_number) + ": expected key=value, got \"" + token + "\"");
+            const std::string key = token.substr(0, equals);
+            const vector<std::string> values = split(token.substr(equals + 1), ',');
+            vector<sweep_job> next;
+            for (const sweep_job &job : expanded)
+            {
+                for (const std::string &value : values)
+                {
+                    next.push_back(job);
+                    set_value(next.back(), key, value);
+                }
+            }
+            expanded.swap(next);
+        }
+
+        if (is_default)
+        {
+            if (expanded.size() != 1)
+                throw std::invalid_argument(std::string(config_file) + ":" + std::to_string(line_number) + ": defaults can't have lists");
+            defaults = expanded.front();
+            continue;
+        }
+        for (const sweep_job &job : expanded)
+        {
+            const std::string problem = job_problem(job);
+            if (!problem.empty())
+                throw std::invalid_argument(std::string(config_file) + ":" + std::to_string(line_number) + ": " + problem);
+        }
+        jobs.insert(jobs.end(), expanded.begin(), expanded.end());
+    }
+    return jobs;
+}
+
+template <typename IMG_TYPE>
+void sweep_runner<IMG_TYPE>::run(const vector<sweep_job> &jobs)
+{
+    const int job_count = jobs.size();
+    // Jobs run concurrently, so two of them writing the same files would race
+    vector<std::string> outputs(job_count);
+    std::map<std::string, int> output_jobs;
+    for (int j = 0; j < job_count; j++)
+    {
+        outputs[j] = jobs[j].output_file.empty() ? jobs[j].output_name() : jobs[j].output_file;
+        const auto entry = output_jobs.emplace(outputs[j], j);
+        if (!entry.second)
+            throw std::invalid_argument("Jobs " + std::to_string(entry.first->second + 1) + " and " + std::to_string(j + 1) + " both write " + outputs[j]);
+    }
+    vector<image_key> image_keys(job_count);
+    vector<lines_key> lines_keys(job_count);
+    vector<scored_key> scored_keys(job_count);
+    instrumentation::reset();
+
+    // Jobs whose preprocessing failed. They're skipped by the later stages.
+    vector<char> failed(job_count, 0);
+    for (int j = 0; j < job_count; j++)
+        image_keys[j] = key_of_image(jobs[j]);
+    fill(images, image_keys, failed, "Loading images", [&](const int j)
+    {
+        return std::make_shared<const tcimg>(string_art<IMG_TYPE>::make_rgb_image(jobs[j].image_file.c_str(), jobs[j].resolution));
+    });
+
+    for (int j = 0; j < job_count; j++)
+    {
+        if (!failed[j])
+            lines_keys[j] = key_of_lines(jobs[j]);
+    }
+    fill(line_sets, lines_keys, failed, "Building lines", [&](const int j)
+    {
+        return string_art<IMG_TYPE>::make_lines(*images.at(image_keys[j]), pin_layout::parse(jobs[j].layout, jobs[j].pin_radius), jobs[j].pin_count, jobs[j].min_separation,
+                                                  line_raster::absolute, false);
+    });
+
+    for (int j = 0; j < job_count; j++)
+        scored_keys[j] = key_of_scored(jobs[j]);
+    fill(scored, scored_keys, failed, "Scoring lines", [&](const int j)
+    {
+        const sweep_job &job = jobs[j];
+        return std::unique_ptr<string_art<IMG_TYPE>>(new string_art<IMG_TYPE>(
+            images.at(image_keys[j]), line_sets.at(lines_keys[j]), pin_layout::parse(job.layout, job.pin_radius),
+            job.score_method, job.score_modifier, job.score_depth, job.localsize_weight, job.neighbor_weight, false, false));
+    });
+
+    // Jobs copy the scored object, so they share the stages it builds (see string_art::prepare_stages())
+    if (std::any_of(jobs.begin(), jobs.end(), [](const sweep_job &job) { return !job.schedule.empty(); }))
+        std::cout << "Building coarse-to-fine stages...\n";
+    for (int j = 0; j < job_count; j++)
+    {
+        if (failed[j] || jobs[j].schedule.empty())
+            continue;
+        try
+        {
+            scored.at(scored_keys[j])->prepare_stages(jobs[j].schedule);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Building coarse-to-fine stages failed for job " << j + 1 << ": " << e.what() << '\n';
+            failed[j] = 1;
+        }
+    }
+
+    if (!instrumentation_file.empty())
+        instrumentation::append_json_line(instrumentation_file, "preprocessing");
+    instrumentation::reset();
+
+    std::cout << "Running " << job_count << " jobs on " << thread_budget << " threads...\n";
+    std::ofstream timings;
+    if (!instrumentation_file.empty())
+        timings.open(instrumentation_file, std::ios::app);
+    int jobs_done = 0, jobs_failed = 0;
+    #pragma omp parallel for num_threads(thread_budget) schedule(dynamic)
+    for (int j = 0; j < job_count; j++)
+    {
+        const sweep_job &job = jobs[j];
+        const std::string &output = outputs[j];
+        if (failed[j])
+        {
+            #pragma omp critical
+            {
+                jobs_done++;
+                jobs_failed++;
+                std::cout << "Job " << jobs_done << "/" << job_count << " skipped: " << output << " (preprocessing failed)\n";
+            }
+            continue;
+        }
+        // An exception can't leave the parallel loop, so a failing job is reported and the others carry on
+        try
+        {
+            instrumentation::reset_thread();
+            string_art<IMG_TYPE> sa(*scored.at(scored_keys[j]), job.score_modifier, job.score_depth);
+            sa.set_lazy_updates(job.lazy);
+            sa.set_error_blur(job.error_blur);
+            sa.set_stop_criteria(job.stop);
+            // Streamed next to the output image: <output without extension>.csv or .sain
+            std::unique_ptr<instruction_writer> writer;
+            if (!job.instructions.empty())
+            {
+                const bool csv = (job.instructions == "csv");
+                writer.reset(new instruction_writer(output.substr(0, output.find_last_of('.')) + (csv ? ".csv" : ".sain"),
+                                                    csv ? instruction_writer::csv : instruction_writer::binary, sa.instruction_info()));
+                sa.set_instruction_writer(writer.get());
+            }
+            short *instructions = !job.schedule.empty() ? sa.generate_coarse_to_fine(job.steps, job.schedule)
+                                  : (job.runs > 1)      ? sa.generate_multi(job.steps, job.runs)
+                                                        : sa.generate(job.steps);
+            sa.save_string_image(output.c_str(), true);
+            delete[] instructions;
+            const instrumentation::accumulator job_timings = instrumentation::thread_snapshot();
+            #pragma omp critical
+            {
+                if (timings)
+                    job_timings.write_json_line(timings, output);
+                jobs_done++;
+                std::cout << "Job " << jobs_done << "/" << job_count << " done: " << output << " (" << sa.generated_steps() << " steps)\n";
+            }
+        }
+        catch (const std::exception &e)
+        {
+            #pragma omp critical
+            {
+                jobs_done++;
+                jobs_failed++;
+                std::cerr << "Job " << jobs_done << "/" << job_count << " failed: " << output << " (" << e.what() << ")\n";
+            }
+        }
+    }
+    if (jobs_failed > 0)
+        std::cerr << jobs_failed << " of " << job_count << " jobs failed\n";
+}
+
+template <typename IMG_TYPE>
+template <typename KEY, typename VALUE, typename BUILD>
+void sweep_runner<IMG_TYPE>::fill(std::map<KEY, VALUE> &cache, const vector<KEY> &keys, vector<char> &failed, const char *stage, BUILD build)
+{
+    // New entries, and the first job that needs each of them
+    vector<std::pair<typename std::map<KEY, VALUE>::iterator, int>> missing;
+    for (size_t j = 0; j < keys.size(); j++)
+    {
+        if (failed[j])
+            continue;
+        auto entry = cache.emplace(keys[j], VALUE());
+        if (entry.second)
+            missing.emplace_back(entry.first, j);
+    }
+    std::cout << stage << " (" << missing.size() << " new, " << cache.size() - missing.size() << " cached)...\n";
+    const int missing_count = missing.size();
+    vector<char> built(missing_count, 0);
+    #pragma omp parallel for num_threads(thread_budget) schedule(dynamic)
+    for (int i = 0; i < missing_count; i++)
+    {
+        // An exception can't leave the parallel loop, so the entry is left out and its jobs are skipped
+        try
+        {
+            missing[i].first->second = build(missing[i].second);
+            built[i] = 1;
+        }
+        catch (const std::exception &e)
+        {
+            #pragma omp critical
+            std::cerr << stage << " failed for job " << missing[i].second + 1 << ": " << e.what() << '\n';
+        }
+    }
+    for (int i = 0; i < missing_count; i++)
+    {
+        if (!built[i])
+            cache.erase(missing[i].first);
+    }
+    for (size_t j = 0; j < keys.size(); j++)
+    {
+        if (!failed[j] && cache.find(keys[j]) == cache.end())
+            failed[j] = 1;
+    }
+}
+
+template <typename IMG_TYPE>
+typename sweep_runner<IMG_TYPE>::image_key sweep_runner<IMG_TYPE>::key_of_image(const sweep_job &job)
+{
+    return image_key(job.image_file, job.resolution);
+}
+
+template <typename IMG_TYPE>
+typename sweep_runner<IMG_TYPE>::lines_key sweep_runner<IMG_TYPE>::key_of_lines(const sweep_job &job) const
+{
+    const tcimg &image = *images.at(key_of_image(job));
+    return lines_key(image.width(), image.height(), job.pin_count, job.pin_radius, job.layout, job.min_separation);
+}
+
+template <typename IMG_TYPE>
+typename sweep_runner<IMG_TYPE>::scored_key sweep_runner<IMG_TYPE>::key_of_scored(const sweep_job &job)
+{
+    return scored_key(job.image_file, job.resolution, job.pin_count, job.pin_radius, job.layout, job.min_separation,
+                      job.score_method, job.localsize_weight, job.neighbor_weight);
+}
+
+template class sweep_runner<short>;
+template class sweep_runner<int>;
+template class sweep_runner<float>;
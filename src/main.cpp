@@ -2,6 +2,8 @@
 #define cimg_use_png 1
 #define cimg_use_openmp 1
 #include <string_art.hpp>
+#include <sweep_runner.hpp>
+#include <color_layers.hpp>
 //#include "image_analysis.hpp"
 #include "image_editing.hpp"
 #include "coord.hpp"
@@ -22,6 +24,8 @@ using std::ifstream;
 #define PIN_COUNTS {250}
 #define STEPS {8000}
 #define MIN_SEPARATIONS {10}
+// Frame the pins are placed on (see pin_layout.hpp), e.g. pin_layout(pin_layout::rectangle, 1.f) or pin_layout::load("frame.txt")
+#define PIN_LAYOUT pin_layout(pin_layout::circle, 0.95f)
 #define MODIFIERS {0.5f, 0.6f, 0.7f, 0.8f, 0.9f}
 #define CULL_THRESH (short)100
 #define DEPTHS {2}
@@ -30,9 +34,64 @@ using std::ifstream;
 #define ACC_WEIGHTS {0.f}//, 0.5f, 1.f}
 #define SZ_WEIGHTS {0.f}//, 0.5f, 1.f}
 #define NEIGHBOR_WEIGHTS {0.f}
+// Paths generated in parallel per image (see string_art::generate_multi). 1 = single path.
+#define RUNS 1
+// Re-rank lines only when they're candidates (see string_art::set_lazy_updates()). Same paths, only faster.
+#define LAZY_UPDATES true
+// Per-phase timings of every image are appended here (see instrumentation.hpp)
+#define INSTRUMENTATION_FILE "instrumentation.jsonl"
+// Each path is streamed next to its image while it's generated (see instruction_writer.hpp)
+#define INSTRUCTION_FORMAT instruction_writer::binary
+// Steps between checkpoints. An image with a checkpoint next to it resumes from it (see string_art::set_checkpoint()).
+#define CHECKPOINT_STEPS 500
+// Coarse-to-fine stages as {scale, until} (see string_art::generate_coarse_to_fine()). {} = every step at full resolution.
+// e.g. {{0.25f, 0.5f}, {0.5f, 0.75f}}: half the steps at 1/4 size, a quarter at 1/2 size, the rest at full size.
+// Off because each image builds its stages' lines once, which costs about as much as the coarse steps save.
+#define COARSE_TO_FINE {}
+// Stop once the error falls by less than 0.2% over 500 steps (see string_art::set_stop_criteria()). STEPS is the maximum.
+#define STOP_PLATEAU_RATIO 0.002f
+#define STOP_PLATEAU_STEPS 500
+// String colors of --color (see color_layers.hpp): black, cyan, magenta, yellow
+#define PALETTE {{0, 0, 0}, {0, 255, 255}, {255, 0, 255}, {255, 255, 0}}
+// Steps of all --color layers together, and the rounds interacting layers are generated in
+#define COLOR_STEPS 12000
+#define COLOR_ROUNDS 8
+#define COLOR_MODIFIER 0.8f
 typedef float IMG_TYPE;
-int main(int, char**) 
+int main(int argc, char** argv) 
 {
+    // Stringwind_Subtractive --color: one path per PALETTE color, for each image and size
+    if(argc > 1 && std::string(argv[1]) == "--color")
+    {
+        for(int size : SIZES)
+        for(int pin_count : PIN_COUNTS)
+        for(int separation : MIN_SEPARATIONS)
+        for(const char* path : IMAGE_PATHS)
+        {
+            std::stringstream filename;
+            filename << path << "_color_s=" << COLOR_STEPS << "_r=" << size;
+            std::cout << "Calculating image " << filename.str() << ".png\n";
+            instrumentation::reset();
+            auto rgb = std::make_shared<const cimg_library::CImg<IMG_TYPE>>(string_art<IMG_TYPE>::make_rgb_image((std::string(path) + ".png").c_str(), size));
+            auto lines = string_art<IMG_TYPE>::make_lines(*rgb, PIN_LAYOUT, pin_count, separation);
+            color_layers<IMG_TYPE> layers(rgb, lines, PALETTE, PIN_LAYOUT, 0, COLOR_MODIFIER, 1, LAZY_UPDATES);
+            layers.generate(COLOR_STEPS, COLOR_ROUNDS);
+            layers.save_image((filename.str() + ".png").c_str());
+            layers.write_to_csv(filename.str());
+            instrumentation::append_json_line(INSTRUMENTATION_FILE, filename.str() + ".png");
+        }
+        return 0;
+    }
+    // Stringwind_Subtractive --headless: run the sweep below without the debug display
+    const bool headless = (argc > 1 && std::string(argv[1]) == "--headless");
+    // Stringwind_Subtractive <sweep config> [thread budget]: run the config's jobs without the display
+    if(argc > 1 && !headless)
+    {
+        const short thread_budget = (argc > 2) ? std::stoi(argv[2]) : omp_get_max_threads();
+        sweep_runner<IMG_TYPE> runner(thread_budget, INSTRUMENTATION_FILE);
+        runner.run(sweep_runner<IMG_TYPE>::read_jobs(argv[1]));
+        return 0;
+    }
 
     short* instructions;
     
@@ -55,13 +114,41 @@ int main(int, char**)
                 "_meth=" << method << 
                 "_d=" << depth <<
                 "_wgsz=" << wg_sz <<
-                "_wgng=" << wg_ng <<
-                ".png";
+                "_wgng=" << wg_ng;
+        const std::string instruction_file = filename.str() + (INSTRUCTION_FORMAT == instruction_writer::csv ? ".csv" : ".sain");
+        const std::string checkpoint_file = filename.str() + ".checkpoint";
+        filename << ".png";
         std::cout << "Calculating image " << filename.str() << '\n';
-        string_art<IMG_TYPE> sa((std::string(path) + ".png").c_str(), size, pin_count, 0.95f, separation, method, modifier, depth, wg_sz, wg_ng);
-        instructions = sa.generate(steps);
+        instrumentation::reset();
+        std::unique_ptr<string_art<IMG_TYPE>> sa;
+        if (std::ifstream(checkpoint_file))
+        {
+            auto rgb = std::make_shared<const cimg_library::CImg<IMG_TYPE>>(string_art<IMG_TYPE>::make_rgb_image((std::string(path) + ".png").c_str(), size));
+            auto lines = string_art<IMG_TYPE>::make_lines(*rgb, PIN_LAYOUT, pin_count, separation);
+            sa.reset(new string_art<IMG_TYPE>(rgb, lines, checkpoint_file, !headless));
+        }
+        else
+        {
+            sa.reset(new string_art<IMG_TYPE>((std::string(path) + ".png").c_str(), size, pin_count, PIN_LAYOUT, separation, method, modifier, depth, wg_sz, wg_ng, line_raster::absolute, !headless));
+        }
+        sa->set_lazy_updates(LAZY_UPDATES && method == 0 && modifier <= 1);
+        sa->set_checkpoint(checkpoint_file, CHECKPOINT_STEPS);
+        stop_criteria stop;
+        stop.plateau_ratio = STOP_PLATEAU_RATIO;
+        stop.plateau_steps = STOP_PLATEAU_STEPS;
+        sa->set_stop_criteria(stop);
+        instruction_writer writer(instruction_file, INSTRUCTION_FORMAT, sa->instruction_info());
+        sa->set_instruction_writer(&writer);
+        const vector<resolution_stage> schedule COARSE_TO_FINE;
+        instructions = !schedule.empty() ? sa->generate_coarse_to_fine(steps, schedule)
+                       : (RUNS > 1)      ? sa->generate_multi(steps, RUNS)
+                                         : sa->generate(steps);
 
-        sa.save_string_image(filename.str().c_str(),true);
+        sa->save_string_image(filename.str().c_str(),true);
         delete[] instructions;
+        // Finished, so the next run starts over
+        sa->set_checkpoint("");
+        std::remove(checkpoint_file.c_str());
+        instrumentation::append_json_line(INSTRUMENTATION_FILE, filename.str());
     }
 }
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include <checkpoint.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+    const char magic[4] = {'S', 'A', 'C', 'K'};
+
+    /** @brief Identifies IMG_TYPE in the file, so a checkpoint isn't read back as another type */
+    template <typename T>
+    uint8_t type_tag()
+    {
+        return (std::is_floating_point<T>::value ? 0x80 : 0) | (std::is_signed<T>::value ? 0x40 : 0) | sizeof(T);
+    }
+
+    template <typename T>
+    void put(std::ofstream &out, const T &value)
+    {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void put(std::ofstream &out, const vector<T> &values)
+    {
+        put<uint64_t>(out, values.size());
+        out.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+    void put(std::ofstream &out, const std::string &text)
+    {
+        put<uint64_t>(out, text.size());
+        out.write(text.data(), text.size());
+    }
+
+    void put(std::ofstream &out, const pin_layout &layout)
+    {
+        put<uint8_t>(out, layout.type);
+        put(out, layout.size);
+        put(out, layout.points);
+        put(out, layout.name());
+    }
+
+    template <typename T>
+    void put(std::ofstream &out, const cimg_library::CImg<T> &image)
+    {
+        put<int32_t>(out, image.width());
+        put<int32_t>(out, image.height());
+        put<int32_t>(out, image.depth());
+        put<int32_t>(out, image.spectrum());
+        out.write(reinterpret_cast<const char *>(image.data()), image.size() * sizeof(T));
+    }
+
+    /** @brief Reads the values written by put(), and throws once past the end */
+    struct reader
+    {
+        std::ifstream &in;
+        const std::string &filename;
+
+        void bytes(void *data, const size_t size)
+        {
+            if (!in.read(reinterpret_cast<char *>(data), size))
+                throw std::runtime_error("Checkpoint " + filename + " is incomplete");
+        }
+
+        template <typename T>
+        T get()
+        {
+            T value;
+            bytes(&value, sizeof(T));
+            return value;
+        }
+
+        template <typename T>
+        void get(vector<T> &values)
+        {
+            values.resize(get<uint64_t>());
+            bytes(values.data(), values.size() * sizeof(T));
+        }
+
+        void get(std::string &text)
+        {
+            text.resize(get<uint64_t>());
+            bytes(&text[0], text.size());
+        }
+
+        pin_layout get_layout()
+        {
+            const uint8_t type = get<uint8_t>();
+            const float size = get<float>();
+            vector<coord<float>> points;
+            get(points);
+            std::string name;
+            get(name);
+            if (type > pin_layout::custom)
+                throw std::runtime_error("Checkpoint " + filename + " has an unknown pin layout (" + std::to_string(type) + ")");
+            if (type == pin_layout::custom)
+                return pin_layout(points, size, name);
+            return pin_layout((pin_layout::shape)type, size);
+        }
+
+        template <typename T>
+        void get(cimg_library::CImg<T> &image)
+        {
+            const int32_t width = get<int32_t>();
+            const int32_t height = get<int32_t>();
+            const int32_t depth = get<int32_t>();
+            const int32_t spectrum = get<int32_t>();
+            image.assign(width, height, depth, spectrum);
+            bytes(image.data(), image.size() * sizeof(T));
+        }
+    };
+}
+
+template <typename IMG_TYPE>
+bool checkpoint<IMG_TYPE>::save(const std::string &filename) const
+{
+    const std::string temp_file = filename + ".tmp";
+    {
+        std::ofstream out(temp_file, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(magic, sizeof(magic));
+        put(out, version);
+        put(out, type_tag<IMG_TYPE>());
+        put(out, layout);
+        put(out, score_method);
+        put(out, score_modifier);
+        put(out, score_depth);
+        put(out, wg_localsize);
+        put(out, wg_neighbor);
+        put(out, beam_width);
+        put(out, beam_candidates);
+        put(out, lazy_updates);
+        put(out, error_blur);
+        put(out, plateau_ratio);
+        put(out, plateau_steps);
+        put(out, min_score);
+        put(out, time_budget);
+        put(out, plateau_start);
+        put(out, plateau_error);
+        put(out, pins);
+        put(out, path);
+        put(out, darkness_image);
+        put(out, string_image);
+        put(out, region_size_map ? *region_size_map : tcimg());
+        put(out, line_scores);
+        put(out, line_lengths);
+        put(out, line_totals);
+        put(out, culled);
+        if (!out.flush())
+            return false;
+    }
+    return std::rename(temp_file.c_str(), filename.c_str()) == 0;
+}
+
+template <typename IMG_TYPE>
+checkpoint<IMG_TYPE> checkpoint<IMG_TYPE>::load(const std::string &filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Could not open checkpoint " + filename);
+    reader r{in, filename};
+    char file_magic[sizeof(magic)];
+    r.bytes(file_magic, sizeof(file_magic));
+    if (std::memcmp(file_magic, magic, sizeof(magic)) != 0)
+        throw std::runtime_error(filename + " is not a checkpoint");
+    const uint16_t file_version = r.get<uint16_t>();
+    if (file_version != version)
+        throw std::runtime_error(filename + " has checkpoint version " + std::to_string(file_version) + " (expected " + std::to_string(version) + ")");
+    if (r.get<uint8_t>() != type_tag<IMG_TYPE>())
+        throw std::runtime_error(filename + " was saved with a different image type");
+
+    checkpoint c;
+    c.layout = r.get_layout();
+    c.score_method = r.get<uint8_t>();
+    c.score_modifier = r.get<float>();
+    c.score_depth = r.get<int16_t>();
+    c.wg_localsize = r.get<float>();
+    c.wg_neighbor = r.get<float>();
+    c.beam_width = r.get<int16_t>();
+    c.beam_candidates = r.get<int16_t>();
+    c.lazy_updates = r.get<uint8_t>();
+    c.error_blur = r.get<int16_t>();
+    c.plateau_ratio = r.get<float>();
+    c.plateau_steps = r.get<int16_t>();
+    c.min_score = r.get<float>();
+    c.time_budget = r.get<float>();
+    c.plateau_start = r.get<int16_t>();
+    c.plateau_error = r.get<float>();
+    r.get(c.pins);
+    r.get(c.path);
+    r.get(c.darkness_image);
+    r.get(c.string_image);
+    tcimg region_size_map;
+    r.get(region_size_map);
+    // Saved empty when it wasn't built (see string_art::region_size_map)
+    if (!region_size_map.is_empty())
+        c.region_size_map = std::make_shared<const tcimg>(std::move(region_size_map));
+    r.get(c.line_scores);
+    r.get(c.line_lengths);
+    r.get(c.line_totals);
+    r.get(c.culled);
+    return c;
+}
+
+template <typename IMG_TYPE>
+checkpoint_writer<IMG_TYPE>::checkpoint_writer(const std::string &_filename)
+    : filename(_filename), thread(&checkpoint_writer::run, this)
+{
+}
+
+template <typename IMG_TYPE>
+checkpoint_writer<IMG_TYPE>::~checkpoint_writer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
+
+template <typename IMG_TYPE>
+void checkpoint_writer<IMG_TYPE>::submit(std::unique_ptr<checkpoint<IMG_TYPE>> snapshot)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        waiting = std::move(snapshot);
+    }
+    changed.notify_all();
+}
+
+template <typename IMG_TYPE>
+void checkpoint_writer<IMG_TYPE>::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]()
+                 { return !waiting && !saving; });
+}
+
+template <typename IMG_TYPE>
+int checkpoint_writer<IMG_TYPE>::saved() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return saved_count;
+}
+
+template <typename IMG_TYPE>
+int checkpoint_writer<IMG_TYPE>::failed() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed_count;
+}
+
+template <typename IMG_TYPE>
+void checkpoint_writer<IMG_TYPE>::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        changed.wait(lock, [this]()
+                     { return waiting || stopping; });
+        if (!waiting)
+            return;
+        std::unique_ptr<checkpoint<IMG_TYPE>> snapshot = std::move(waiting);
+        saving = true;
+        lock.unlock();
+        const bool ok = snapshot->save(filename);
+        snapshot.reset();
+        lock.lock();
+        saving = false;
+        (ok ? saved_count : failed_count)++;
+        changed.notify_all();
+    }
+}
+
+template struct checkpoint<short>;
+template struct checkpoint<int>;
+template struct checkpoint<float>;
+template class checkpoint_writer<short>;
+template class checkpoint_writer<int>;
+template class checkpoint_writer<float>;
+template struct checkpoint<u_char>;
+template struct checkpoint<u_short>;
+template class checkpoint_writer<u_char>;
+template class checkpoint_writer<u_short>;
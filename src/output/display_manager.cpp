@@ -190,4 +190,6 @@ void display_manager<T>::update_state(const char* text, bool force_redraw)
 
 template class display_manager<float>;
 template class display_manager<short>;
-template class display_manager<int>;
\ No newline at end of file
+template class display_manager<int>;
+template class display_manager<u_char>;
+template class display_manager<u_short>;
\ No newline at end of file
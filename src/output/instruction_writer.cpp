@@ -0,0 +1,272 @@
+#include <instruction_writer.hpp>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    const char magic[4] = {'S', 'A', 'I', 'N'};
+
+    void put_u8(std::string &out, const uint8_t value)
+    {
+        out.push_back((char)value);
+    }
+
+    void put_u16(std::string &out, const uint16_t value)
+    {
+        put_u8(out, value & 0xff);
+        put_u8(out, value >> 8);
+    }
+
+    void put_u32(std::string &out, const uint32_t value)
+    {
+        put_u16(out, value & 0xffff);
+        put_u16(out, value >> 16);
+    }
+
+    void put_f32(std::string &out, const float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        put_u32(out, bits);
+    }
+
+    void put_varint(std::string &out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            put_u8(out, (value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        put_u8(out, value);
+    }
+
+    /** @brief Reads the values written by the put functions, and fails once past the end */
+    struct reader
+    {
+        std::ifstream &in;
+        bool ok = true;
+
+        uint8_t u8()
+        {
+            const int c = in.get();
+            ok = ok && c != std::char_traits<char>::eof();
+            return ok ? (uint8_t)c : 0;
+        }
+
+        uint16_t u16()
+        {
+            const uint16_t low = u8();
+            return low | (uint16_t)u8() << 8;
+        }
+
+        uint32_t u32()
+        {
+            const uint32_t low = u16();
+            return low | (uint32_t)u16() << 16;
+        }
+
+        float f32()
+        {
+            const uint32_t bits = u32();
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        uint32_t varint()
+        {
+            uint32_t value = 0;
+            for (int shift = 0; ok && shift < 35; shift += 7)
+            {
+                const uint8_t byte = u8();
+                value |= (uint32_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return value;
+            }
+            ok = false;
+            return 0;
+        }
+    };
+
+    /** @brief Difference between two pins around the circle, in [-pin_count/2, pin_count/2) */
+    int wrap_delta(const int from, const int to, const int pin_count)
+    {
+        int delta = ((to - from) % pin_count + pin_count) % pin_count;
+        if (delta >= (pin_count + 1) / 2)
+            delta -= pin_count;
+        return delta;
+    }
+
+    uint32_t zigzag(const int value)
+    {
+        return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    }
+
+    int unzigzag(const uint32_t value)
+    {
+        return (int)(value >> 1) ^ -(int)(value & 1);
+    }
+}
+
+instruction_writer::instruction_writer(const std::string &filename, const format _format, const instruction_header &header, const int _block_steps)
+    : file(filename, std::ios::binary | std::ios::trunc),
+      file_format(_format),
+      pin_count(header.pins.size()),
+      block_steps(_block_steps)
+{
+    if (!file)
+        throw std::runtime_error("Could not open instruction file " + filename);
+    if (block_steps < 1)
+        throw std::domain_error("Steps per block is out of range (" + std::to_string(block_steps) + ")");
+    if (file_format == binary && pin_count < 1)
+        throw std::domain_error("Binary instruction files need the pin layout");
+    if (file_format == binary)
+        write_header(header);
+    else
+        file << "step,pin\n";
+    file.flush();
+}
+
+instruction_writer::~instruction_writer()
+{
+    flush();
+}
+
+void instruction_writer::write(const short pin)
+{
+    if (file_format == binary)
+    {
+        put_varint(pending, zigzag(wrap_delta(last_pin, pin, pin_count)));
+    }
+    else
+    {
+        pending += std::to_string(step_count);
+        pending += ',';
+        pending += std::to_string(pin);
+        pending += '\n';
+    }
+    last_pin = pin;
+    step_count++;
+    if (++pending_steps >= block_steps)
+        flush();
+}
+
+void instruction_writer::write(const short *path, const int count)
+{
+    for (int i = 0; i < count; i++)
+        write(path[i]);
+}
+
+void instruction_writer::flush()
+{
+    if (pending_steps == 0)
+        return;
+    if (file_format == binary)
+    {
+        std::string block_header;
+        put_varint(block_header, pending_steps);
+        put_varint(block_header, pending.size());
+        file << block_header;
+    }
+    file << pending;
+    file.flush();
+    pending.clear();
+    pending_steps = 0;
+}
+
+void instruction_writer::write_header(const instruction_header &header)
+{
+    std::string out(magic, sizeof(magic));
+    put_u16(out, version);
+    put_u16(out, header.width);
+    put_u16(out, header.height);
+    put_f32(out, header.pin_radius);
+    put_u8(out, header.score_method);
+    put_f32(out, header.score_modifier);
+    put_u16(out, header.score_depth);
+    put_u16(out, pin_count);
+    for (const scoord &pin : header.pins)
+    {
+        put_u16(out, (uint16_t)pin.x);
+        put_u16(out, (uint16_t)pin.y);
+    }
+    file << out;
+}
+
+vector<short> instruction_writer::read(const std::string &filename, instruction_header *header)
+{
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("Could not open instruction file " + filename);
+    const std::streamoff file_size = in.tellg();
+    in.seekg(0);
+    reader r{in};
+    char file_magic[sizeof(magic)];
+    for (char &c : file_magic)
+        c = r.u8();
+    if (!r.ok || std::memcmp(file_magic, magic, sizeof(magic)) != 0)
+        throw std::runtime_error(filename + " is not a binary instruction file");
+    const uint16_t file_version = r.u16();
+    if (file_version != version)
+        throw std::runtime_error(filename + " has instruction format version " + std::to_string(file_version) + " (expected " + std::to_string(version) + ")");
+
+    instruction_header h;
+    h.width = r.u16();
+    h.height = r.u16();
+    h.pin_radius = r.f32();
+    h.score_method = r.u8();
+    h.score_modifier = r.f32();
+    h.score_depth = r.u16();
+    const int file_pin_count = r.u16();
+    for (int p = 0; p < file_pin_count && r.ok; p++)
+    {
+        const short x = r.u16();
+        const short y = r.u16();
+        h.pins.emplace_back(x, y);
+    }
+    if (!r.ok || file_pin_count < 1)
+        throw std::runtime_error(filename + " has an incomplete header");
+
+    vector<short> path;
+    short last = 0;
+    while (in.peek() != std::char_traits<char>::eof())
+    {
+        const uint32_t block_steps = r.varint();
+        const uint32_t block_bytes = r.varint();
+        // A cut off or corrupt block: every step takes at least a byte, and the payload can't run past the end
+        if (!r.ok || block_steps > block_bytes || block_bytes > file_size - in.tellg())
+            break;
+        std::string payload(block_bytes, '\0');
+        if (!in.read(&payload[0], block_bytes))
+            break;
+        // Decode from a copy of the payload, so a corrupt block can't read into the next one
+        vector<short> block;
+        size_t i = 0;
+        for (uint32_t s = 0; s < block_steps; s++)
+        {
+            uint32_t value = 0;
+            int shift = 0;
+            while (i < payload.size() && shift < 35)
+            {
+                const uint8_t byte = payload[i++];
+                value |= (uint32_t)(byte & 0x7f) << shift;
+                shift += 7;
+                if (!(byte & 0x80))
+                {
+                    shift = -1;
+                    break;
+                }
+            }
+            if (shift != -1)
+                break;
+            last = ((last + unzigzag(value)) % file_pin_count + file_pin_count) % file_pin_count;
+            block.push_back(last);
+        }
+        if (block.size() != block_steps)
+            break;
+        path.insert(path.end(), block.begin(), block.end());
+    }
+    if (header)
+        *header = std::move(h);
+    return path;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file instruction_test.cpp
+ * @brief Checks that binary instruction files read back as the path that was written
+ * @details Writes a random path of STEPS steps with instruction_writer, in blocks of BLOCK_STEPS, with jumps across the
+ *          whole pin range so the deltas wrap and take multi-byte varints. Then checks that read():
+ *          - returns the whole path and the header of the complete file
+ *          - returns the complete blocks of a file cut off in the middle of each block
+ *          - stops at a block whose size varint is corrupt, without allocating it
+ *
+ *          Exits with 1 on a failed check.
+ */
+#include <instruction_writer.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+#define PIN_COUNT 250
+#define STEPS 1000
+#define BLOCK_STEPS 64
+#define INSTRUCTION_FILE "instruction_test.sain"
+#define CUT_FILE "instruction_test_cut.sain"
+
+/** @brief Write the first size bytes of a file to another one */
+void copy_prefix(const char *from, const char *to, const size_t size)
+{
+    std::ifstream in(from, std::ios::binary);
+    const std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream(to, std::ios::binary) << content.substr(0, size);
+}
+
+/**
+ * @brief Check what read() returns for a file
+ * @param expected The path read() should return
+ * @return False if it returned something else
+ */
+bool reads_as(const char *filename, const vector<short> &expected, const std::string &name)
+{
+    const vector<short> path = instruction_writer::read(filename);
+    if (path != expected)
+    {
+        std::cerr << name << ": read " << path.size() << " steps, expected " << expected.size() << '\n';
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    instruction_header header;
+    header.width = 512;
+    header.height = 384;
+    header.pin_radius = 0.95f;
+    header.score_depth = 2;
+    for (int p = 0; p < PIN_COUNT; p++)
+        header.pins.emplace_back(2 * p, p);
+    std::mt19937 random(1);
+    std::uniform_int_distribution<short> pin(0, PIN_COUNT - 1);
+    vector<short> path(STEPS);
+    for (short &p : path)
+        p = pin(random);
+
+    // File size after each complete block, starting with the header
+    vector<size_t> block_ends;
+    {
+        instruction_writer writer(INSTRUCTION_FILE, instruction_writer::binary, header, BLOCK_STEPS);
+        block_ends.push_back(std::filesystem::file_size(INSTRUCTION_FILE));
+        for (int s = 0; s < STEPS; s++)
+        {
+            writer.write(path[s]);
+            if ((s + 1) % BLOCK_STEPS == 0)
+                block_ends.push_back(std::filesystem::file_size(INSTRUCTION_FILE));
+        }
+    }
+    const size_t file_size = std::filesystem::file_size(INSTRUCTION_FILE);
+    if (STEPS % BLOCK_STEPS != 0)
+        block_ends.push_back(file_size);
+
+    bool passed = true;
+    instruction_header read_header;
+    passed &= reads_as(INSTRUCTION_FILE, path, "complete file");
+    instruction_writer::read(INSTRUCTION_FILE, &read_header);
+    if (read_header.width != header.width || read_header.height != header.height || read_header.pin_radius != header.pin_radius ||
+        read_header.score_depth != header.score_depth || read_header.pins != header.pins)
+    {
+        std::cerr << "complete file: the header doesn't match the written one\n";
+        passed = false;
+    }
+    std::cout << "complete file: " << STEPS << " steps in " << file_size - block_ends[0] << " bytes\n";
+
+    for (size_t block = 0; block + 1 < block_ends.size(); block++)
+    {
+        copy_prefix(INSTRUCTION_FILE, CUT_FILE, (block_ends[block] + block_ends[block + 1]) / 2);
+        const vector<short> complete(path.begin(), path.begin() + block * BLOCK_STEPS);
+        passed &= reads_as(CUT_FILE, complete, "cut in block " + std::to_string(block));
+    }
+    std::cout << "cut files: " << block_ends.size() - 1 << " checked\n";
+
+    // A block of one step claiming a payload of 4 GB
+    copy_prefix(INSTRUCTION_FILE, CUT_FILE, file_size);
+    std::ofstream(CUT_FILE, std::ios::binary | std::ios::app) << "\x01\xff\xff\xff\xff\x0f";
+    passed &= reads_as(CUT_FILE, path, "corrupt block size");
+
+    std::remove(INSTRUCTION_FILE);
+    std::remove(CUT_FILE);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file lazy_test.cpp
+ * @brief Checks that lazy score updates give the same path as eager ones
+ * @details Generates the same image with eager and with lazy updates (see string_art::set_lazy_updates()), and compares the
+ *          paths. Once with score depth 1 and once with the beam search (score depth LOOKAHEAD_DEPTH), with a float and a
+ *          compact image type. Exits with 1 if a path differs.
+ */
+#include <string_art.hpp>
+#include "test_images.hpp"
+
+#define RESOLUTION 256
+#define PIN_COUNT 120
+#define MIN_SEPARATION 10
+#define SCORE_MODIFIER 0.8f
+#define STEPS 600
+#define LOOKAHEAD_DEPTH 3
+#define BEAM_WIDTH 4
+#define BEAM_CANDIDATES 6
+
+/**
+ * @brief Generate with one score depth in both update modes
+ * @return False if the lazy path differs from the eager one
+ */
+template <typename T>
+bool paths_match(std::shared_ptr<const cimg_library::CImg<T>> rgb, std::shared_ptr<const line_set> lines, const short depth,
+                 const std::string &name)
+{
+    vector<short> paths[2];
+    for (const bool lazy : {false, true})
+    {
+        string_art<T> sa(rgb, lines, 0.95f, 0, SCORE_MODIFIER, depth, 0.f, 0.f, false, false);
+        sa.set_lookahead(BEAM_WIDTH, BEAM_CANDIDATES);
+        sa.set_lazy_updates(lazy);
+        short *path = sa.generate(STEPS);
+        paths[lazy].assign(path, path + STEPS);
+        delete[] path;
+    }
+    if (paths[0] != paths[1])
+    {
+        size_t step = 0;
+        while (paths[0][step] == paths[1][step])
+            step++;
+        std::cerr << name << ": the lazy path differs from the eager one from step " << step << '\n';
+        return false;
+    }
+    std::cout << name << ": the lazy path matches the eager one over " << STEPS << " steps\n";
+    return true;
+}
+
+/** @brief Check both score depths with one image type */
+template <typename T>
+bool check_type(const std::string &type_name)
+{
+    auto rgb = std::make_shared<const cimg_library::CImg<T>>(discs<T>(RESOLUTION));
+    auto lines = string_art<T>::make_lines(*rgb, 0.95f, PIN_COUNT, MIN_SEPARATION, line_raster::absolute, false);
+    bool passed = true;
+    passed &= paths_match<T>(rgb, lines, 1, type_name + " depth 1");
+    passed &= paths_match<T>(rgb, lines, LOOKAHEAD_DEPTH, type_name + " beam search");
+    return passed;
+}
+
+int main()
+{
+    bool passed = true;
+    passed &= check_type<float>("float");
+    passed &= check_type<u_char>("u_char");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file raster_test.cpp
+ * @brief Checks the fixed-point rasterizer (line_raster::walk()) against the float one it replaced
+ * @details For every line of each layout in LAYOUTS at each resolution in RESOLUTIONS:
+ *          - walk() and float_walk() take the same number of steps
+ *          - Every step of walk() is on the pixel of the exact position (start + step * direction, in double), unless
+ *            that position is within FIXED_TOLERANCE of a pixel edge
+ *          - A step of float_walk() may only land on another pixel where its float sum could have drifted across a pixel
+ *            edge: one pixel away, on an axis where the exact position is closer to the edge than the rounding error
+ *            of that many float additions (half an ulp of the image width per step, see drift_bound()). Everywhere else
+ *            the pixels are the same.
+ *          - The cached coverage (line_raster, in both encodings) is walk()'s pixels, sorted and de-duplicated
+ *
+ *          Prints the share of steps that land on another pixel. Exits with 1 on a failed check.
+ */
+#include <string_art.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define RESOLUTIONS {256, 1024, 2048}
+#define LAYOUTS {pin_layout(pin_layout::circle, 0.95f), pin_layout(pin_layout::rectangle, 0.95f)}
+#define PIN_COUNT 250
+#define MIN_SEPARATION 10
+/** End buffer of the rasterizers (the line_raster default) */
+#define RASTER_BUFFER 3
+/** Largest distance from a pixel edge, in pixels, at which walk()'s 32.32 fixed point may round differently */
+#define FIXED_TOLERANCE 1e-6
+typedef float IMG_TYPE;
+typedef cimg_library::CImg<IMG_TYPE> tcimg;
+typedef coord<short> scoord;
+
+/** @brief Distance of an exact coordinate from the nearest pixel edge */
+double edge_distance(const double position)
+{
+    return std::abs(position - std::round(position));
+}
+
+/** @brief Largest error of a float coordinate below width after step additions: half an ulp each */
+double drift_bound(const long step, const int width)
+{
+    return step * width * (double)std::numeric_limits<float>::epsilon() / 2;
+}
+
+/**
+ * @brief Compare the two rasterizers on one line
+ * @param differing Increased by the number of steps that land on another pixel
+ * @return False if the line doesn't conform
+ */
+bool conforms(const scoord a, const scoord b, const int width, double &differing)
+{
+    vector<uint32_t> float_pixels, fixed_pixels;
+    line_raster::float_walk(a, b, width, RASTER_BUFFER, float_pixels);
+    line_raster::walk(a, b, width, RASTER_BUFFER, fixed_pixels);
+    if (float_pixels.size() != fixed_pixels.size())
+        return false;
+    // The exact positions of the steps, with the float direction both rasterizers start from
+    const scoord start = (a.x < b.x) ? a : b;
+    const scoord end = (a.x < b.x) ? b : a;
+    const float length = coordinates::distance(coord<float>(start), coord<float>(end));
+    const double dx = (end.x - start.x) / length, dy = (end.y - start.y) / length;
+    for (size_t i = 0; i < float_pixels.size(); i++)
+    {
+        const long step = i + RASTER_BUFFER;
+        const double x = start.x + dx * step, y = start.y + dy * step;
+        if ((edge_distance(x) > FIXED_TOLERANCE && fixed_pixels[i] % width != (uint32_t)std::floor(x)) ||
+            (edge_distance(y) > FIXED_TOLERANCE && fixed_pixels[i] / width != (uint32_t)std::floor(y)))
+            return false;
+        if (float_pixels[i] == fixed_pixels[i])
+            continue;
+        differing++;
+        const int off_x = std::abs((int)(float_pixels[i] % width) - (int)(fixed_pixels[i] % width));
+        const int off_y = std::abs((int)(float_pixels[i] / width) - (int)(fixed_pixels[i] / width));
+        const double drift = drift_bound(step, width);
+        if (off_x > 1 || off_y > 1 || (off_x == 1 && edge_distance(x) > drift) || (off_y == 1 && edge_distance(y) > drift))
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    bool passed = true;
+    for (const int resolution : RESOLUTIONS)
+    {
+        const tcimg blank(resolution, resolution, 1, 3, 255);
+        for (const pin_layout &layout : LAYOUTS)
+        {
+            auto lines = string_art<IMG_TYPE>::make_lines(blank, layout, PIN_COUNT, MIN_SEPARATION, line_raster::absolute, false);
+            const line_raster deltas(resolution, resolution, lines->pins.data(), lines->line_pairs.data(), lines->line_count,
+                                     RASTER_BUFFER, line_raster::delta, false);
+            double steps = 0, differing = 0;
+            vector<uint32_t> walked, cached;
+            for (int l = 0; l < lines->line_count; l++)
+            {
+                const scoord &a = lines->pins[lines->line_pairs[l].x], &b = lines->pins[lines->line_pairs[l].y];
+                if (!conforms(a, b, resolution, differing))
+                {
+                    std::cerr << layout.name() << ' ' << resolution << "px: line " << l << " (" << a.x << ',' << a.y << ")-(" << b.x << ','
+                              << b.y << ") doesn't conform to the float rasterizer\n";
+                    passed = false;
+                }
+                line_raster::walk(a, b, resolution, RASTER_BUFFER, walked);
+                steps += walked.size();
+                std::sort(walked.begin(), walked.end());
+                walked.erase(std::unique(walked.begin(), walked.end()), walked.end());
+                for (const line_raster *raster : {&lines->raster, &deltas})
+                {
+                    raster->decode(l, cached);
+                    if (cached != walked)
+                    {
+                        std::cerr << layout.name() << ' ' << resolution << "px: the cached pixels of line " << l << " aren't the walked ones\n";
+                        passed = false;
+                    }
+                }
+            }
+            std::cout << layout.name() << ' ' << resolution << "px: " << differing << " of " << steps << " steps on another pixel\n";
+        }
+    }
+    return passed ? 0 : 1;
+}
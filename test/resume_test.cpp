@@ -0,0 +1,184 @@
+/**
+ * @file resume_test.cpp
+ * @brief Checks that a path resumed from a checkpoint matches the uninterrupted one
+ * @details Generates STEPS steps in one go, then half of them with checkpoints, resumes the rest from the last
+ *          checkpoint (see string_art::set_checkpoint()), and compares the paths. Once with eager and once with lazy
+ *          score updates, on a circle, a rectangle and a custom frame. <br>
+ *          Then checks that a resume keeps the checkpoint's lookahead, error blur, update mode and plateau stop, and that
+ *          a checkpoint isn't resumed with the lines of another frame. Exits with 1 if a check fails.
+ */
+#include <string_art.hpp>
+#include "test_images.hpp"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#define RESOLUTION 256
+#define PIN_COUNT 120
+#define MIN_SEPARATION 10
+#define SCORE_MODIFIER 0.8f
+#define STEPS 600
+#define CHECKPOINT_FILE "resume_test.checkpoint"
+/** Settings a resume takes from the checkpoint (see settings_resumed()). With few pins, the lines that cover the
+ *  discs run out and the error plateaus after the checkpoint. */
+#define SETTINGS_PIN_COUNT 40
+#define SETTINGS_SEPARATION 5
+#define LOOKAHEAD_DEPTH 2
+#define BEAM_WIDTH 3
+#define BEAM_CANDIDATES 5
+#define ERROR_BLUR 1
+#define PLATEAU_RATIO 0.01f
+#define PLATEAU_STEPS 70
+/** Custom layout written by the test, and removed once it's loaded */
+#define PIN_FILE "resume_test.pins"
+typedef float IMG_TYPE;
+typedef cimg_library::CImg<IMG_TYPE> tcimg;
+
+/** @brief Write a custom layout: PIN_COUNT pins around an ellipse twice as wide as it is tall */
+void write_pin_file(const char *filename)
+{
+    std::ofstream out(filename);
+    for (int i = 0; i < PIN_COUNT; i++)
+    {
+        const float angle = 2 * M_PI * i / PIN_COUNT;
+        out << 2 * std::cos(angle) << ' ' << std::sin(angle) << '\n';
+    }
+}
+
+/**
+ * @brief Check one layout in both update modes
+ * @return False if a resumed path differs
+ */
+bool resume_matches(std::shared_ptr<const tcimg> rgb, const pin_layout &layout)
+{
+    auto lines = string_art<IMG_TYPE>::make_lines(*rgb, layout, PIN_COUNT, MIN_SEPARATION, line_raster::absolute, false);
+    bool passed = true;
+    for (const bool lazy : {false, true})
+    {
+        string_art<IMG_TYPE> whole(rgb, lines, layout, 0, SCORE_MODIFIER, 1, 0.f, 0.f, false, false);
+        whole.set_lazy_updates(lazy);
+        short *path = whole.generate(STEPS);
+        const vector<short> expected(path, path + STEPS);
+        delete[] path;
+
+        {
+            string_art<IMG_TYPE> first_half(rgb, lines, layout, 0, SCORE_MODIFIER, 1, 0.f, 0.f, false, false);
+            first_half.set_lazy_updates(lazy);
+            first_half.set_checkpoint(CHECKPOINT_FILE, STEPS / 8);
+            delete[] first_half.generate(STEPS / 2);
+        }
+        string_art<IMG_TYPE> resumed(rgb, lines, CHECKPOINT_FILE, false, false);
+        resumed.set_lazy_updates(lazy);
+        path = resumed.generate(STEPS);
+        const vector<short> actual(path, path + STEPS);
+        delete[] path;
+        std::remove(CHECKPOINT_FILE);
+
+        const std::string name = layout.name() + (lazy ? " lazy" : " eager");
+        if (actual != expected)
+        {
+            size_t step = 0;
+            while (actual[step] == expected[step])
+                step++;
+            std::cerr << name << ": the resumed path differs from step " << step << '\n';
+            passed = false;
+        }
+        else
+        {
+            std::cout << name << ": the resumed path matches\n";
+        }
+    }
+    return passed;
+}
+
+/**
+ * @brief Check that a resume continues with the checkpoint's settings
+ * @details The first run sets a lookahead, an error blur, lazy updates and a plateau stop, and the resumed one sets
+ *          nothing. The checkpoint is taken in the middle of a plateau window, and the plateau stop comes after it.
+ * @return False if the resumed path, or the step it stops at, differs
+ */
+bool settings_resumed(std::shared_ptr<const tcimg> rgb, const pin_layout &layout)
+{
+    auto lines = string_art<IMG_TYPE>::make_lines(*rgb, layout, SETTINGS_PIN_COUNT, SETTINGS_SEPARATION, line_raster::absolute, false);
+    stop_criteria stop;
+    stop.plateau_ratio = PLATEAU_RATIO;
+    stop.plateau_steps = PLATEAU_STEPS;
+    auto configure = [&](string_art<IMG_TYPE> &sa)
+    {
+        sa.set_lookahead(BEAM_WIDTH, BEAM_CANDIDATES);
+        sa.set_error_blur(ERROR_BLUR);
+        sa.set_lazy_updates(true);
+        sa.set_stop_criteria(stop);
+    };
+    string_art<IMG_TYPE> whole(rgb, lines, layout, 0, SCORE_MODIFIER, LOOKAHEAD_DEPTH, 0.f, 0.f, false, false);
+    configure(whole);
+    short expected_steps;
+    short *path = whole.generate(STEPS, expected_steps);
+    const vector<short> expected(path, path + expected_steps);
+    delete[] path;
+
+    {
+        string_art<IMG_TYPE> first_half(rgb, lines, layout, 0, SCORE_MODIFIER, LOOKAHEAD_DEPTH, 0.f, 0.f, false, false);
+        configure(first_half);
+        first_half.set_checkpoint(CHECKPOINT_FILE, STEPS / 8);
+        delete[] first_half.generate(STEPS / 2);
+    }
+    string_art<IMG_TYPE> resumed(rgb, lines, CHECKPOINT_FILE, false, false);
+    short actual_steps;
+    path = resumed.generate(STEPS, actual_steps);
+    const vector<short> actual(path, path + actual_steps);
+    delete[] path;
+    std::remove(CHECKPOINT_FILE);
+
+    if (actual != expected)
+    {
+        std::cerr << "resumed settings: the resumed path has " << actual_steps << " steps, the uninterrupted one " << expected_steps << '\n';
+        return false;
+    }
+    std::cout << "resumed settings: the resumed path matches, and stops at step " << actual_steps << '\n';
+    return true;
+}
+
+/**
+ * @brief Check that a checkpoint isn't resumed with the lines of another layout
+ * @return False if it was
+ */
+bool other_lines_rejected(std::shared_ptr<const tcimg> rgb, const pin_layout &layout, const pin_layout &other)
+{
+    auto lines = string_art<IMG_TYPE>::make_lines(*rgb, layout, PIN_COUNT, MIN_SEPARATION, line_raster::absolute, false);
+    auto other_lines = string_art<IMG_TYPE>::make_lines(*rgb, other, PIN_COUNT, MIN_SEPARATION, line_raster::absolute, false);
+    {
+        string_art<IMG_TYPE> sa(rgb, lines, layout, 0, SCORE_MODIFIER, 1, 0.f, 0.f, false, false);
+        sa.set_checkpoint(CHECKPOINT_FILE, STEPS);
+        delete[] sa.generate(STEPS / 8);
+    }
+    bool rejected = false;
+    try
+    {
+        string_art<IMG_TYPE> resumed(rgb, other_lines, CHECKPOINT_FILE, false, false);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cout << layout.name() << " checkpoint with " << other.name() << " lines: " << e.what() << '\n';
+        rejected = true;
+    }
+    std::remove(CHECKPOINT_FILE);
+    if (!rejected)
+        std::cerr << "A " << layout.name() << " checkpoint was resumed with " << other.name() << " lines\n";
+    return rejected;
+}
+
+int main()
+{
+    auto rgb = std::make_shared<const tcimg>(discs<IMG_TYPE>(RESOLUTION));
+    write_pin_file(PIN_FILE);
+    const pin_layout custom = pin_layout::load(PIN_FILE, 0.95f);
+    std::remove(PIN_FILE);
+
+    bool passed = true;
+    for (const pin_layout &layout : {pin_layout(0.95f), pin_layout(pin_layout::rectangle, 0.95f), custom})
+        passed &= resume_matches(rgb, layout);
+    passed &= settings_resumed(rgb, pin_layout(0.95f));
+    passed &= other_lines_rejected(rgb, custom, pin_layout(0.95f));
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file score_test.cpp
+ * @brief Checks that the incrementally updated line scores match the darkness they were updated for
+ * @details Generates STEPS steps with every image type, with eager and lazy score updates, then recalculates each line's
+ *          total from darkness_image and compares it with line_totals and line_scores. Lines on the path (scored 0 when
+ *          drawn) and culled lines are skipped. <br>
+ *          The totals are float sums, so they may differ by TOTAL_TOLERANCE of the recalculated total. Integer scores are
+ *          the total over the length truncated, so they may be up to one darkness unit lower. <br>
+ *          Then covers the best line with a string of another layer (see string_art::cover_line()), and checks that its
+ *          score drops to its new darkness, in line_scores and in the score tree. Exits with 1 on a failed check.
+ */
+#include <string_art.hpp>
+#include "test_images.hpp"
+#include <cmath>
+#include <set>
+
+#define RESOLUTION 256
+#define PIN_COUNT 120
+#define MIN_SEPARATION 10
+#define SCORE_MODIFIER 0.8f
+#define STEPS 600
+/** Largest relative difference between a line's total and the one recalculated from darkness_image */
+#define TOTAL_TOLERANCE 1e-5
+
+/**
+ * @brief Reads the scoring state of string_art
+ * @details Declared a friend of string_art.
+ */
+class string_art_test
+{
+public:
+    /**
+     * @brief Compare every line's score with its darkness
+     * @param name Printed with the result
+     * @return False if a line's score doesn't match
+     */
+    template <typename T>
+    static bool scores_match(const string_art<T> &sa, const vector<short> &path, const std::string &name)
+    {
+        std::set<int> drawn;
+        for (size_t i = 1; i < path.size(); i++)
+            drawn.insert(sa.line_index(path[i - 1], path[i]));
+        const T *darkness = sa.darkness_image.data();
+        double worst_total = 0, worst_score = 0;
+        int failed = 0;
+        for (int l = 0; l < sa.line_count; l++)
+        {
+            if (sa.culled[l] || drawn.count(l) || sa.line_lengths[l] == 0)
+                continue;
+            double total = 0;
+            sa.raster.for_each(l, [&](const uint32_t p)
+                               { total += darkness[p]; });
+            const double total_error = std::abs(sa.line_totals[l] - total) / std::max(total, 1.0);
+            const double score_error = total / sa.line_lengths[l] - sa.line_scores[l];
+            worst_total = std::max(worst_total, total_error);
+            worst_score = std::max(worst_score, std::abs(score_error));
+            const bool score_ok = std::is_integral<T>::value ? (score_error > -1e-3 && score_error < 1 + 1e-3)
+                                                             : std::abs(score_error) <= TOTAL_TOLERANCE * std::max(total / sa.line_lengths[l], 1.0);
+            if (total_error > TOTAL_TOLERANCE || !score_ok)
+            {
+                if (failed++ < 5)
+                    std::cerr << name << ": line " << l << " has total " << sa.line_totals[l] << " and score " << (float)sa.line_scores[l]
+                              << ", its darkness sums to " << total << " over " << sa.line_lengths[l] << " pixels\n";
+            }
+        }
+        std::cout << name << ": largest total error " << worst_total << ", largest score error " << worst_score << '\n';
+        return failed == 0;
+    }
+
+    /**
+     * @brief Cover the best line with another layer's string (see string_art::cover_line()), and check that its score
+     *        drops by the darkness taken off its pixels
+     * @param name Printed with the result
+     * @return False if the score, or its entry in the score tree, wasn't updated
+     */
+    template <typename T>
+    static bool cover_drops_score(string_art<T> &sa, const std::string &name)
+    {
+        int best = 0;
+        for (int l = 1; l < sa.line_count; l++)
+        {
+            if (!sa.culled[l] && sa.line_scores[l] > sa.line_scores[best])
+                best = l;
+        }
+        const T before = sa.line_scores[best];
+        sa.cover_line(best);
+        const T *darkness = sa.darkness_image.data();
+        double total = 0;
+        sa.raster.for_each(best, [&](const uint32_t p)
+                           { total += darkness[p]; });
+        const T expected = (T)(total / sa.line_lengths[best]);
+        const short a = sa.line_pairs[best].x, b = sa.line_pairs[best].y;
+        const bool stale = sa.lazy_updates && sa.stale[best];
+        const bool passed = sa.line_scores[best] < before && std::abs((double)sa.line_scores[best] - expected) <= std::max(1e-3 * expected, 1e-3) &&
+                            !stale && sa.score_tree.score(a, b) == sa.line_scores[best];
+        std::cout << name << ": covering line " << best << " took its score from " << (float)before << " to " << (float)sa.line_scores[best]
+                  << " (darkness " << (float)expected << ")\n";
+        if (!passed)
+            std::cerr << name << ": the covered line's score in the tree is " << (float)sa.score_tree.score(a, b) << (stale ? " (stale)\n" : "\n");
+        return passed;
+    }
+};
+
+/** @brief Check both update modes with one image type */
+template <typename T>
+bool check_type(const std::string &type_name)
+{
+    auto rgb = std::make_shared<const cimg_library::CImg<T>>(discs<T>(RESOLUTION));
+    auto lines = string_art<T>::make_lines(*rgb, 0.95f, PIN_COUNT, MIN_SEPARATION, line_raster::absolute, false);
+    bool passed = true;
+    for (const bool lazy : {false, true})
+    {
+        string_art<T> sa(rgb, lines, 0.95f, 0, SCORE_MODIFIER, 1, 0.f, 0.f, false, false);
+        sa.set_lazy_updates(lazy);
+        short *path = sa.generate(STEPS);
+        const vector<short> steps(path, path + STEPS);
+        delete[] path;
+        passed &= string_art_test::scores_match(sa, steps, type_name + (lazy ? " lazy" : " eager"));
+        passed &= string_art_test::cover_drops_score(sa, type_name + (lazy ? " lazy" : " eager"));
+    }
+    return passed;
+}
+
+int main()
+{
+    bool passed = true;
+    passed &= check_type<float>("float");
+    passed &= check_type<int>("int");
+    passed &= check_type<short>("short");
+    passed &= check_type<u_short>("u_short");
+    passed &= check_type<u_char>("u_char");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file test_images.hpp
+ * @brief Target images shared by the tests
+ */
+#ifndef TEST_IMAGES_H
+#define TEST_IMAGES_H
+#include <string_art.hpp>
+#include <random>
+
+/** @brief Dark discs on white, the same for every call of a size */
+template <typename T>
+cimg_library::CImg<T> discs(const int size)
+{
+    cimg_library::CImg<T> image(size, size, 1, 3, 255);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(0.2f * size, 0.8f * size), radius(0.05f * size, 0.2f * size);
+    for (int i = 0; i < 6; i++)
+    {
+        const float cx = position(random), cy = position(random), r = radius(random);
+        cimg_forXY(image, x, y)
+        {
+            if ((x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r)
+            {
+                cimg_forC(image, c)
+                {
+                    image(x, y, c) = 0;
+                }
+            }
+        }
+    }
+    return image;
+}
+
+#endif